@@ -0,0 +1,105 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <GL/glew.h>
+#include "ThreadPool.h"
+#include "MipGenerator.h"
+
+// 1x1 RGBA texels a texture shows until its image has been uploaded
+const unsigned char PLACEHOLDER_WHITE[4] = {255, 255, 255, 255};
+const unsigned char PLACEHOLDER_FLAT_NORMAL[4] = {128, 128, 255, 255};
+
+// Staging ring defaults: three 4 MB pixel buffers
+const size_t ASYNC_TEXTURE_STAGING_BUFFER_SIZE = 4 << 20;
+const unsigned int ASYNC_TEXTURE_STAGING_BUFFER_COUNT = 3;
+
+// Mip levels up to this size are uploaded straight from memory rather than taking a
+// staging buffer each
+const size_t ASYNC_TEXTURE_DIRECT_UPLOAD_BYTES = 64 << 10;
+
+struct AsyncTextureStats {
+    unsigned int queueDepth = 0;        // Requested textures not yet swapped in
+    unsigned int decoding = 0;          // Of those, the ones still being decoded
+    unsigned int completedTextures = 0;
+    unsigned int failedTextures = 0;
+    size_t uploadedBytes = 0;           // Pixel bytes the last Update copied to the GPU
+    size_t decodedBytes = 0;            // Decoded pixel bytes since the loader was created
+    double decodeMilliseconds = 0.0;    // Summed over the decode threads
+    double mipMilliseconds = 0.0;       // Mip chain generation, summed over the decode threads
+    
+    // Decoded megabytes per second of decode thread time
+    double GetDecodeThroughput() const;
+};
+
+// Loads 2D textures without blocking the render thread. LoadTexture returns a texture
+// name at once, showing a 1x1 placeholder; the file is decoded and its mip chain built on
+// worker threads, and Update streams the rows of every level to the GPU through a ring of
+// pixel buffer objects, a few per frame, before the finished chain replaces the
+// placeholder. The name never changes, so it can be handed to a Material straight away.
+// The caller owns every returned texture and must Cancel one that is deleted before it
+// has finished loading; holders that may outlive the loader reach it through GetHandle.
+class AsyncTextureLoader {
+public:
+    // threadCount 0 leaves one hardware thread to the renderer. Rows are staged through
+    // stagingBufferCount buffers of stagingBufferSize bytes each.
+    explicit AsyncTextureLoader(unsigned int threadCount = 0,
+                                size_t stagingBufferSize = ASYNC_TEXTURE_STAGING_BUFFER_SIZE,
+                                unsigned int stagingBufferCount = ASYNC_TEXTURE_STAGING_BUFFER_COUNT);
+    ~AsyncTextureLoader();
+    
+    AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+    AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+    
+    // Start loading an image file; the texture shows placeholder until it is ready. filter
+    // decides the color space and how the mips are built; with MipFilter::SRGB the
+    // placeholder is sRGB-encoded as well.
+    unsigned int LoadTexture(const char* path, MipFilter filter = MipFilter::Linear,
+                             const unsigned char placeholder[4] = PLACEHOLDER_WHITE);
+    
+    // Upload up to budgetBytes of decoded rows and swap in every texture that is complete;
+    // call once per frame. Returns how many textures were swapped in.
+    unsigned int Update(size_t budgetBytes);
+    
+    // Stop loading a texture that is about to be deleted; false if it is not pending
+    bool Cancel(unsigned int texture);
+    
+    // Block until every requested texture has been decoded and uploaded
+    void Finish();
+    
+    // Textures requested but not yet swapped in
+    unsigned int GetQueueDepth() const;
+    
+    const AsyncTextureStats& GetStats() const;
+    
+    // Handle to this loader that expires when it is destroyed
+    std::weak_ptr<AsyncTextureLoader> GetHandle() const;
+
+private:
+    struct Request;
+    struct StagingBuffer {
+        unsigned int buffer = 0;
+        GLsync fence = nullptr;     // Signalled once the last upload from the buffer has read it
+    };
+    
+    // Does not own the loader: it shares a token, released first by the destructor
+    std::shared_ptr<AsyncTextureLoader> handle;
+    
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::shared_ptr<Request>> requests;
+    std::vector<StagingBuffer> staging;
+    size_t stagingBufferSize;
+    unsigned int nextStagingBuffer;
+    AsyncTextureStats stats;
+    
+    // Copy rows of the level being uploaded into the next free staging buffer and issue
+    // their upload; returns the bytes sent, or 0 if every staging buffer is still in flight
+    size_t uploadRows(Request &request, size_t budgetBytes);
+    
+    // Allocate the full-size chain behind the placeholder once the image size is known
+    void beginUpload(Request &request);
+    
+    // Expose the uploaded chain
+    void completeUpload(Request &request);
+};
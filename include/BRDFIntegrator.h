@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+
+// Importance samples per LUT texel; brdf.fs uses the same count
+const unsigned int BRDF_SAMPLE_COUNT = 1024;
+
+// Split-sum scale and bias applied to F0 for one view angle and roughness, integrated
+// the same way brdf.fs does it (Hammersley points, GGX importance sampling, Smith-Schlick
+// geometry with k = a^2 / 2)
+glm::vec2 IntegrateBRDF(float NdotV, float roughness, unsigned int sampleCount = BRDF_SAMPLE_COUNT);
+
+// Integrate a size x size lookup table as interleaved RG floats. Columns run over NdotV
+// and rows over roughness, both sampled at texel centers as the shader pass does. Rows
+// are integrated in parallel on pool if one is given; the result does not depend on it.
+std::vector<float> GenerateBRDFLUT(unsigned int size, ThreadPool *pool = nullptr);
+
+// Bilinearly sample an RG lookup table with clamp-to-edge addressing, as GL_LINEAR does
+glm::vec2 SampleBRDFLUT(const float *lut, unsigned int size, float NdotV, float roughness);
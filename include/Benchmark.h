@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "FrameUniforms.h"
+#include "MaterialRegistry.h"
+#include "IBL.h"
+#include "Model.h"
+
+// Render a grid of spheres with one draw call per object and then instanced,
+// and print the frame time and draw call count of each path
+void RunInstancingBenchmark(GLFWwindow* window, FrameUniforms &frameUniforms, MaterialRegistry &registry,
+                            IBL &ibl, unsigned int instanceCount);
+
+// Measure vertex-stage cost of the per-vertex normal-matrix inverse against the
+// CPU-precomputed uniform (rasterizer discard isolates the vertex stage), and the
+// CPU cost of the batched normal-matrix computation
+void RunNormalMatrixBenchmark(GLFWwindow* window, FrameUniforms &frameUniforms, MaterialRegistry &registry,
+                              unsigned int objectCount);
+
+// Print the vertex memory saved by VertexFormat::Packed for a model's meshes and
+// the worst-case reconstruction error of normals, tangents and texture coordinates.
+// Needs the model's meshes to be MeshStorage::Retained.
+void ReportVertexPacking(const char* name, const Model &model);
+
+// Print the ACMR/ATVR of each mesh before and after construction-time optimization
+void ReportMeshOptimization(const char* name, const Model &model);
+
+// Load a glTF model single-threaded and then with one worker per hardware thread,
+// printing the parse, decode and upload phases of each
+void RunLoadBenchmark(const std::string &path);
+
+// Load a glTF model into an empty mesh cache directory and then again from the
+// cache it wrote, printing the phases of both loads
+void RunMeshCacheBenchmark(const std::string &path);
+
+// Bake the irradiance convolution cubemap and print its cost and the error of the
+// spherical harmonics irradiance against it
+void ReportIrradianceSH(IBL &ibl);
+
+// Integrate the BRDF LUT with the shader pass and print its cost and the error of the
+// table compiled into the executable against it
+void ReportBRDFLookUpTexture(IBL &ibl);
+
+// Bake the prefiltered specular map brute force and with filtered importance sampling,
+// printing the bake time of each and the per-mip difference between the two
+void RunPrefilterBenchmark(IBL &ibl);
+
+// Bake an environment on the CPU and print how far the GPU-baked maps of it in ibl differ
+void ReportCPUBake(IBL &ibl, const std::string &hdrPath);
+
+// Build the mips of a synthetic sRGB RGBA cutout image with glGenerateMipmap and with
+// MipGenerator on one thread and on a pool, printing the time of each and, per level, the
+// difference between the two chains and the alpha-test coverage each keeps
+void RunMipBenchmark(unsigned int size);
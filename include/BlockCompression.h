@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "ThreadPool.h"
+
+// 4x4 block-compressed formats textures are cooked to. BC1 (S3TC DXT1) holds RGB in 8
+// bytes per block, BC4 (RGTC1) one channel in 8 bytes and BC5 (RGTC2) two channels in 16.
+enum class BlockFormat {
+    BC1,
+    BC4,
+    BC5
+};
+
+// Bytes of one 4x4 block
+size_t GetBlockBytes(BlockFormat format);
+
+// Bytes of a width x height image, partial blocks at the edges included
+size_t GetCompressedSize(BlockFormat format, unsigned int width, unsigned int height);
+
+// Compress an RGBA8 image with tightly packed rows. BC1 keeps RGB, BC4 red and BC5 red
+// and green; partial edge blocks repeat the edge texels. Block rows are spread over pool
+// if one is given.
+std::vector<unsigned char> CompressImage(const unsigned char* rgba, unsigned int width, unsigned int height,
+                                         BlockFormat format, ThreadPool* pool = nullptr);
+
+// Decode blocks back to RGBA8 the way GL samples them: missing color channels are zero
+// and alpha is opaque
+std::vector<unsigned char> DecompressImage(const unsigned char* blocks, unsigned int width, unsigned int height,
+                                           BlockFormat format);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+// Channels of a packed occlusion/roughness/metallic (ORM) texture, the glTF layout
+enum ORMChannel {
+    ORM_OCCLUSION_CHANNEL = 0,
+    ORM_ROUGHNESS_CHANNEL,
+    ORM_METALLIC_CHANNEL,
+    ORM_CHANNEL_COUNT
+};
+
+// Where one channel of a packed image comes from: a channel of an 8-bit image, or a
+// constant where there is no map
+struct ChannelSource {
+    const unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    int channel = 0;                // Clamped to the image's last component
+    unsigned char constant = 255;
+};
+
+// Pack count sources into an image with one component per source and tightly packed
+// rows. The image takes the size of the largest source (1x1 if all are constants);
+// smaller sources are resampled nearest-neighbour.
+std::vector<unsigned char> PackChannels(const ChannelSource* sources, int count, int &width, int &height);
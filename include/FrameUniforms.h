@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "SphericalHarmonics.h"
+
+// Upper bound on lights; the shaders loop over lightCount, not this
+const unsigned int MAX_FRAME_LIGHTS = 32;
+
+// std140 mirror of the FrameUniforms block declared in the shaders
+struct FrameLight {
+    glm::vec4 position;    // xyz = world position
+    glm::vec4 color;       // rgb = radiant intensity
+};
+
+struct FrameUniformData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 camPos;      // xyz = camera position
+    int lightCount;
+    float exposure;
+    float time;
+    float padding;
+    glm::vec4 irradianceSH[SH_COEFFICIENT_COUNT];   // rgb = IrradianceSH coefficients
+    FrameLight lights[MAX_FRAME_LIGHTS];
+};
+
+// Per-frame camera and light data shared by every program through one UBO
+class FrameUniforms {
+public:
+    // Binding point all programs attach their FrameUniforms block to
+    static const unsigned int BINDING_POINT = 0;
+    
+    FrameUniformData data;
+    
+    // Constructor creates the uniform buffer and binds it to BINDING_POINT
+    FrameUniforms();
+    ~FrameUniforms();
+    
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+    
+    // Bind the shader's FrameUniforms block to the shared binding point
+    void Attach(Shader &shader) const;
+    
+    // Set frame values
+    void SetCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position);
+    void SetLights(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &colors);
+    void SetExposure(float value);
+    void SetTime(float value);
+    void SetIrradianceSH(const IrradianceSH &sh);
+    
+    // Write the frame data to the GPU (call once per frame, after all Set* calls)
+    void Upload();
+    
+private:
+    unsigned int UBO;
+};
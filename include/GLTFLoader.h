@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "VertexFormat.h"
+#include "MeshOptimizer.h"
+#include "Material.h"
+#include "ThreadPool.h"
+#include "MipGenerator.h"
+
+// Decoded 8-bit image ready for upload, with its mip chain
+struct GLTFImage {
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    MipFilter filter = MipFilter::Linear;
+    std::vector<unsigned char> pixels;
+    MipChain mips;
+};
+
+// Material parameters; images holds an index into GLTFScene::images per
+// MaterialTextureUnit, or -1 where the material has no such map. Occlusion,
+// roughness and metallic arrive packed in the ORM unit.
+struct GLTFMaterial {
+    glm::vec3 albedo = glm::vec3(1.0f);
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+    float ao = 1.0f;
+    int images[MATERIAL_TEXTURE_UNIT_COUNT] = {-1, -1, -1, -1, -1, -1};
+};
+
+// One triangle list in model space (node transforms applied), already passed
+// through OptimizeMesh
+struct GLTFPrimitive {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    MeshOptimizationStats optimizationStats;
+    int material = -1;  // Index into GLTFScene::materials, -1 for the default material
+};
+
+struct GLTFScene {
+    std::vector<GLTFPrimitive> primitives;
+    std::vector<GLTFMaterial> materials;
+    std::vector<GLTFImage> images;
+};
+
+// Wall-clock time of each load phase
+struct GLTFLoadStats {
+    double parseMilliseconds = 0.0;   // File mapping, JSON, buffers and node hierarchy
+    double decodeMilliseconds = 0.0;  // Vertex decoding, tangents, mesh optimization, image decoding, ORM packing and mips
+    double uploadMilliseconds = 0.0;  // GL buffer and texture creation (filled in by Model)
+    double meshCacheMilliseconds = 0.0;  // Validating or writing the mesh cache (filled in by Model)
+    bool fromMeshCache = false;          // Geometry came from the mesh cache instead of the file
+    size_t fileBytes = 0;
+    unsigned int threadCount = 0;
+};
+
+class GLTFLoader {
+public:
+    // Load a glTF 2.0 file (.gltf or .glb). Meshes and images are decoded on the
+    // pool; no GL calls are made, so the result can be uploaded by the GL thread.
+    // Without decodePrimitives only materials and images are loaded (scene.primitives
+    // stays empty), for when the geometry comes from a mesh cache.
+    static bool Load(const std::string &path, ThreadPool &pool, GLTFScene &scene, GLTFLoadStats &stats,
+                     bool decodePrimitives = true);
+};
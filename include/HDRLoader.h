@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "ThreadPool.h"
+
+// Decode an equirectangular HDR image to RGB texels, bottom row first as a GL texture holds
+// them. Radiance RGBE files (.hdr) are memory-mapped and their scanlines, run-length
+// encoded or flat, decoded in parallel over pool if one is given; pass none from a task
+// already running on a pool. Any other format stb_image reads is decoded by it on the
+// calling thread. Returns false, logging why, if the file cannot be read.
+bool LoadHDRImage(const char* path, int &width, int &height, std::vector<float> &pixels, ThreadPool* pool = nullptr);
+
+// The same as half floats, for a GL_HALF_FLOAT upload at half the bytes of float texels
+bool LoadHDRImage(const char* path, int &width, int &height, std::vector<uint16_t> &pixels, ThreadPool* pool = nullptr);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// 64-bit non-cryptographic hash (the xxHash64 algorithm), fast enough to
+// checksum large cache files at close to memory bandwidth
+inline uint64_t Hash64(const void* input, size_t length, uint64_t seed = 0) {
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto read64 = [](const unsigned char* p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; };
+    auto read32 = [](const unsigned char* p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; };
+    auto round = [&](uint64_t acc, uint64_t lane) { return rotl(acc + lane * PRIME2, 31) * PRIME1; };
+    auto merge = [&](uint64_t acc, uint64_t lane) { return (acc ^ round(0, lane)) * PRIME1 + PRIME4; };
+
+    const unsigned char* p = static_cast<const unsigned char*>(input);
+    const unsigned char* end = p + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    } else {
+        hash = seed + PRIME5;
+    }
+
+    hash += static_cast<uint64_t>(length);
+    for (; p + 8 <= end; p += 8)
+        hash = rotl(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    if (p + 4 <= end) {
+        hash = rotl(hash ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+        hash = rotl(hash ^ (*p * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -2,43 +2,166 @@
 
 #include <vector>
 #include <string>
+#include <unordered_set>
+#include <memory>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "Shader.h"
+#include "IBLCache.h"
+#include "IBLBakeContext.h"
+#include "SphericalHarmonics.h"
 
 class IBL {
 public:
     // IBL maps
     unsigned int envCubemap;
-    unsigned int irradianceMap;
+    unsigned int irradianceMap;     // Convolution reference; only baked by CompareIrradianceSH
     unsigned int prefilterMap;
     unsigned int brdfLUTTexture;
     
+    // How the prefiltered specular map is integrated
+    enum class PrefilterMode {
+        BruteForce,     // 1024 samples of the source's level 0 for every mip
+        Filtered        // Mip 0 copied, then roughness-scaled sample counts with filtered importance sampling
+    };
+    
+    // Bake cost of both prefilter modes and the difference of the filtered map from the brute-force one
+    struct PrefilterComparison {
+        double bruteForceMilliseconds = 0.0;
+        double filteredMilliseconds = 0.0;
+        std::vector<unsigned int> sampleCounts;     // Filtered samples per texel of each mip; 0 for the copy
+        std::vector<float> meanRelativeError;       // Luminance difference of each mip
+        std::vector<float> maxRelativeError;
+    };
+    
+    // Accuracy and cost of the SH irradiance against the convolution cubemap
+    struct IrradianceComparison {
+        double shMilliseconds = 0.0;            // Environment readback and projection
+        double convolutionMilliseconds = 0.0;   // Convolution bake
+        float meanRelativeError = 0.0f;         // Luminance error over all cubemap texels
+        float maxRelativeError = 0.0f;
+    };
+    
+    // Accuracy and cost of the embedded BRDF LUT against the shader-integrated one
+    struct BRDFLookUpComparison {
+        unsigned int embeddedSize = 0;
+        unsigned int shaderSize = 0;
+        double uploadMilliseconds = 0.0;        // Embedded table upload
+        double shaderMilliseconds = 0.0;        // Shader compile and integration pass
+        float meanError = 0.0f;                 // Absolute scale/bias error over the shader LUT's texels
+        float maxError = 0.0f;
+    };
+    
+    // Difference of the GPU bake from the CPU reference bake of the same environment
+    struct CPUBakeComparison {
+        unsigned int threadCount = 0;           // 0 if the HDR could not be loaded
+        double cpuMilliseconds = 0.0;           // Environment and prefilter bake
+        float environmentMeanError = 0.0f;      // Luminance difference of the environment's level 0
+        float environmentMaxError = 0.0f;
+        std::vector<float> prefilterMeanError;  // Luminance difference of each prefilter mip
+        std::vector<float> prefilterMaxError;
+        float shMaxError = 0.0f;                // Largest coefficient difference relative to the DC term
+    };
+    
     // Constructor
     IBL();
     
-    // Load an HDR environment map and generate all IBL maps
+    // Destructor; releases the maps and waits for a background decode still running
+    ~IBL();
+    
+    // Load an HDR environment map and generate all IBL maps. With a cache directory
+    // set, the maps are read back from a previous bake of the same file instead.
     void LoadEnvironmentMap(const char* hdrPath);
     
+    // Switch to another HDR environment without stalling rendering. The file is decoded, or
+    // its cached maps read, on a background thread; UpdateEnvironmentBake then bakes it a few
+    // faces at a time while the current maps stay bound. A new request replaces a pending one.
+    void RequestEnvironmentMap(const char* hdrPath);
+    
+    // Compile the capture programs streamed bakes share, e.g. at load time, so no frame's bake
+    // step compiles a shader. The first RequestEnvironmentMap does it otherwise, outside the budget.
+    void PrepareEnvironmentStreaming();
+    
+    // Advance a requested environment by about budgetMilliseconds of GPU and upload work;
+    // call once per frame. Returns true on the frame its maps and SH replace the current ones.
+    bool UpdateEnvironmentBake(double budgetMilliseconds);
+    
+    // Whether a requested environment is still being decoded or baked
+    bool IsEnvironmentBakePending() const;
+    
+    // Directory for baked IBL maps, keyed by the HDR contents and bake parameters;
+    // created on first write. Empty (the default) disables caching.
+    static void SetCacheDirectory(const std::string &directory);
+    
     // Apply IBL to shader
     void Apply(Shader &shader);
     
+    // Diffuse irradiance of the environment, for FrameUniforms::SetIrradianceSH
+    const IrradianceSH& GetIrradianceSH() const;
+    
+    // Re-project the SH, bake the convolution cubemap and compare the two
+    IrradianceComparison CompareIrradianceSH();
+    
+    // Bake the prefiltered map both ways and compare the results mip by mip
+    PrefilterComparison ComparePrefilterModes();
+    
+    // Integrate the BRDF LUT with brdf.fs and compare the embedded table against it
+    BRDFLookUpComparison CompareBRDFLookUpTexture();
+    
+    // Bake the loaded environment again on the CPU and compare the current maps against it
+    CPUBakeComparison CompareCPUBake(const char* hdrPath);
+    
     // Draw skybox
     void DrawSkybox(Shader &skyboxShader, unsigned int cubeVAO);
-    
+
 private:
+    // Programs whose IBL sampler units have already been assigned
+    std::unordered_set<unsigned int> configuredPrograms;
+    
+    IrradianceSH irradianceSH;
+    
+    // Requested environments and the bake state reused between them; defined in IBL.cpp
+    struct EnvironmentStream;
+    std::unique_ptr<EnvironmentStream> stream;
+    
+    static std::string cacheDirectory;
+    
+    // Replace the baked maps with textures from a cache file; false on a miss
+    bool loadFromCache(const std::string &path, uint64_t key);
+    
+    // Read the baked maps back into a cache file
+    void saveToCache(const std::string &path, uint64_t key, double bakeMilliseconds);
+    
+    // Copy every level and face of a texture to host memory as half floats
+    static IBLCacheTexture readTexture(unsigned int texture, GLenum target, GLenum internalFormat,
+                                       GLenum format, unsigned int levelCount);
+    
+    // Create a texture from cached levels
+    static unsigned int createTexture(const IBLCacheTexture &cached);
+    
     // Generate a cubemap from an HDR equirectangular environment map
-    unsigned int EquirectangularToCubemap(const char* hdrPath);
+    unsigned int EquirectangularToCubemap(IBLBakeContext &context, const char* hdrPath);
     
     // Generate an irradiance cubemap from an environment cubemap
-    unsigned int GenerateIrradianceMap(unsigned int envMap);
+    unsigned int GenerateIrradianceMap(IBLBakeContext &context, unsigned int envMap);
+    
+    // Project a downsampled environment cubemap onto L2 spherical harmonics, spreading
+    // the projection over a thread pool if parallel
+    IrradianceSH GenerateIrradianceSH(unsigned int envMap, bool parallel = true);
+    
+    // Queue the steps that bake a decoded environment over several frames
+    void queueStreamedBake();
+    
+    // Make the streamed environment's maps current
+    void finishStreamedBake();
     
     // Generate a prefiltered environment map for specular IBL
-    unsigned int GeneratePrefilterMap(unsigned int envMap);
+    unsigned int GeneratePrefilterMap(IBLBakeContext &context, unsigned int envMap,
+                                      PrefilterMode mode = PrefilterMode::Filtered);
     
-    // Generate a BRDF LUT for split-sum approximation
+    // Generate a BRDF LUT for split-sum approximation with brdf.fs; only used as a reference
     unsigned int GenerateBRDFLookUpTexture();
     
-    // Setup a cube VAO for rendering to cubemap faces
-    unsigned int setupCubeVAO();
+    // Upload the BRDF LUT integrated at build time by tools/brdf_lut_gen
+    unsigned int LoadBRDFLookUpTexture();
 };
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+// Resources shared by the IBL bake passes: one capture framebuffer, a unit cube and
+// the six capture view-projections. Each Render fills all faces of a cubemap level in
+// a single layered draw, selecting the face with gl_Layer from the vertex shader where
+// the driver supports it and from a geometry shader otherwise. Everything is released
+// when the context is destroyed; it needs the GL context that created it.
+class IBLBakeContext {
+public:
+    // Vertex and geometry stages of every capture program; part of the IBL cache key
+    static constexpr const char* VERTEX_SHADER = "shaders/cubemap_capture.vs";
+    static constexpr const char* GEOMETRY_SHADER = "shaders/cubemap_capture.gs";
+    
+    IBLBakeContext();
+    ~IBLBakeContext();
+    
+    IBLBakeContext(const IBLBakeContext&) = delete;
+    IBLBakeContext& operator=(const IBLBakeContext&) = delete;
+    
+    // Build a capture program from a fragment shader that reads "in vec3 localPos".
+    // The program is left in use with its capture matrices set, targeting every face.
+    Shader CreateShader(const char* fragmentPath, std::vector<std::string> defines = {}) const;
+    
+    // Render the program in use into every face of one level of a cubemap
+    void Render(unsigned int cubemap, unsigned int level, unsigned int size);
+    
+    // Render a capture program into a single face, for bakes spread over several frames
+    void RenderFace(Shader &shader, unsigned int cubemap, unsigned int level, unsigned int size, unsigned int face);
+    
+    // Copy every face of one cubemap level into another, scaling linearly if the sizes differ
+    void Copy(unsigned int source, unsigned int sourceLevel, unsigned int sourceSize,
+              unsigned int destination, unsigned int destinationLevel, unsigned int destinationSize);
+    
+    // Draw calls issued by Render so far
+    unsigned int GetDrawCount() const;
+    
+    // Whether faces are selected in the vertex stage rather than a geometry shader
+    bool UsesVertexLayer() const;
+
+private:
+    unsigned int captureFBO;
+    unsigned int copyFBO;
+    unsigned int cubeVAO;
+    unsigned int cubeVBO;
+    glm::mat4 viewProjections[6];
+    std::vector<std::string> layerDefines;
+    unsigned int drawCount;
+};
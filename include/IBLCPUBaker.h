@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+#include "IBLCache.h"
+
+// Host-side IBL bake that needs no GL context. Every pass follows the GPU bake in IBL
+// closely enough to be compared with it texel by texel, and its maps can be written to
+// the same cache files. Rows are spread over pool if one is given; the result does not
+// depend on it.
+
+// An equirectangular HDR image as RGB floats, bottom row first as the GL texture holds it
+struct EquirectangularImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+// A cubemap mip chain in host memory. Each level holds six RGB float faces in GL face
+// order, rows as glGetTexImage returns them, so CubemapTexelDirection addresses its texels.
+struct HostCubemap {
+    unsigned int size = 0;
+    std::vector<std::vector<float>> levels;
+    
+    unsigned int GetLevelSize(unsigned int level) const;
+    
+    // Trilinear lookup at a fractional level, clamped to the chain. Each face is clamped
+    // to its edges, as a GL cube map samples without seamless filtering.
+    glm::vec3 Sample(const glm::vec3 &direction, float level) const;
+};
+
+// Decode an HDR file with LoadHDRImage; false, logging why, if it cannot be read
+bool LoadEquirectangularImage(const char* path, EquirectangularImage &image, ThreadPool *pool = nullptr);
+
+// Resample onto a size x size cubemap with a full chain of 2x2 box-filtered mips, as the
+// capture pass and glGenerateMipmap produce it
+HostCubemap BakeEnvironmentCubemap(const EquirectangularImage &image, unsigned int size, ThreadPool *pool = nullptr);
+
+// Irradiance / pi of every texel, integrated exactly over the environment's first level
+// no wider than sourceSize; the quantity irradiance_convolution.fs approximates
+HostCubemap BakeIrradianceCubemap(const HostCubemap &environment, unsigned int size, unsigned int sourceSize,
+                                  ThreadPool *pool = nullptr);
+
+// GGX-prefiltered specular map as IBL bakes it with PrefilterMode::Filtered: mip 0 is the
+// environment at that size, rougher mips take FilteredSampleCount samples of its mips
+HostCubemap BakePrefilterCubemap(const HostCubemap &environment, unsigned int size, unsigned int levelCount,
+                                 ThreadPool *pool = nullptr);
+
+// The first levelCount levels of a cubemap in the half-float layout IBL caches
+IBLCacheTexture CubemapToCacheTexture(const HostCubemap &cubemap, unsigned int levelCount);
+
+// An RG float BRDF LUT from GenerateBRDFLUT in the half-float layout IBL caches
+IBLCacheTexture BRDFLUTToCacheTexture(const std::vector<float> &lut, unsigned int size);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Bump whenever the file layout or the way IBL maps are baked changes
+const uint32_t IBL_CACHE_VERSION = 4;
+
+// Cached map sizes, shared by the GPU bake in IBL and the CPU baker; part of the cache key
+const unsigned int IBL_ENVIRONMENT_SIZE = 512;
+const unsigned int IBL_PREFILTER_SIZE = 128;
+const unsigned int IBL_PREFILTER_MIP_LEVELS = 5;
+
+// Filtered importance sampling reads prefiltered source mips, so a sample count that
+// grows with the lobe width is enough; the brute-force mode always takes 1024
+const unsigned int IBL_FILTERED_MIN_SAMPLES = 32;
+const unsigned int IBL_FILTERED_MAX_SAMPLES = 512;
+
+// Samples per texel of a filtered prefilter mip; 0 for the mirror-like level that is copied
+inline unsigned int FilteredSampleCount(float roughness) {
+    if (roughness <= 0.0f)
+        return 0;
+    return IBL_FILTERED_MIN_SAMPLES +
+           static_cast<unsigned int>(roughness * (IBL_FILTERED_MAX_SAMPLES - IBL_FILTERED_MIN_SAMPLES) + 0.5f);
+}
+
+// One baked texture with every mip level of every face. data holds the levels in
+// order, each level's faces in GL face order, each image as tightly packed rows.
+struct IBLCacheTexture {
+    uint32_t target = 0;          // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+    uint32_t internalFormat = 0;
+    uint32_t format = 0;          // Pixel transfer format and type of data
+    uint32_t type = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levelCount = 0;
+    uint32_t faceCount = 0;
+    std::vector<unsigned char> data;
+};
+
+// Baked IBL maps on disk, tagged with a key of the source environment and bake
+// parameters. The file format knows nothing about GL beyond the enum values it stores.
+class IBLCache {
+public:
+    // Key of a bake: the HDR file's contents, the map sizes and the bake shader sources.
+    // False if the file cannot be read.
+    static bool ComputeKey(const char* hdrPath, uint64_t &key);
+    
+    // Cache file of an HDR environment within a cache directory, named after its absolute path
+    static std::string GetFilePath(const std::string &directory, const char* hdrPath);
+    
+    // Read a cache file; returns false, logging why, if it is missing, from another
+    // version, built for a different key, or corrupt
+    static bool Read(const std::string &path, uint64_t key, std::vector<IBLCacheTexture> &textures,
+                     double &bakeMilliseconds);
+    
+    // Write a cache file, creating its directory; bakeMilliseconds is what a hit saves
+    static bool Write(const std::string &path, uint64_t key, const std::vector<IBLCacheTexture> &textures,
+                      double bakeMilliseconds);
+};
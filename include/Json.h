@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// Minimal JSON document model, enough for asset manifests such as glTF.
+// Lookups of missing members or elements return a shared null value, so
+// chains like doc["materials"][0]["name"] never throw.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+    
+    JsonValue();
+    
+    // Parse a complete document; on failure returns false and describes the error
+    static bool Parse(const char* text, size_t length, JsonValue &result, std::string &error);
+    
+    Type GetType() const;
+    bool IsNull() const;
+    bool IsArray() const;
+    bool IsObject() const;
+    bool IsNumber() const;
+    bool IsString() const;
+    
+    // Typed accessors returning the fallback when the value has another type
+    bool AsBool(bool fallback = false) const;
+    double AsNumber(double fallback = 0.0) const;
+    int AsInt(int fallback = 0) const;
+    const std::string& AsString() const;
+    
+    // Array and object access
+    size_t Size() const;
+    const JsonValue& operator[](size_t index) const;
+    const JsonValue& operator[](const std::string &key) const;
+    bool Has(const std::string &key) const;
+    const std::vector<std::pair<std::string, JsonValue>>& Members() const;
+    
+private:
+    Type type;
+    bool boolValue;
+    double numberValue;
+    std::string stringValue;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+    
+    friend class JsonParser;
+};
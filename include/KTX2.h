@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MappedFile.h"
+#include "BlockCompression.h"
+
+// Vulkan format numbers of the block-compressed textures the cooker writes
+const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+const uint32_t VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+
+// Block format of a supported vkFormat; false for any other format
+bool GetKTX2BlockFormat(uint32_t vkFormat, BlockFormat &format, bool &srgb);
+
+// vkFormat a block format is stored as
+uint32_t GetKTX2Format(BlockFormat format, bool srgb);
+
+// One mip level's blocks
+struct KTX2Level {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Write a 2D KTX2 file (Khronos KTX 2.0, no supercompression) of a block format with a
+// basic data format descriptor. levels holds each mip's blocks, largest first.
+bool WriteKTX2File(const std::string &path, BlockFormat format, bool srgb, uint32_t width, uint32_t height,
+                   const std::vector<std::vector<unsigned char>> &levels);
+
+// Read-only view of a KTX2 file holding a 2D texture in one of the formats above. The file
+// stays mapped while open and the levels point straight into it.
+class KTX2File {
+public:
+    // Map and validate a file; returns false, logging why, if it cannot be read, is not
+    // KTX2, is supercompressed, an array, cubemap or 3D texture, or has another format
+    bool Open(const std::string &path);
+    void Close();
+    
+    BlockFormat GetBlockFormat() const;
+    bool IsSRGB() const;
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    
+    // Levels stored in the file; level 0 is the full-size image
+    size_t GetLevelCount() const;
+    const KTX2Level& GetLevel(size_t level) const;
+    
+    // Size of the mapped file
+    size_t GetFileSize() const;
+
+private:
+    MappedFile file;
+    BlockFormat format = BlockFormat::BC1;
+    bool srgb = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<KTX2Level> levels;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+
+// Read-only view of a whole file, memory-mapped where the platform supports it
+// so large assets can be parsed in place without copying them into the heap
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Map a file; returns false if it cannot be opened
+    bool Open(const std::string &path);
+    void Close();
+    
+    const unsigned char* GetData() const;
+    size_t GetSize() const;
+    bool IsOpen() const;
+    
+private:
+    const unsigned char* data;
+    size_t size;
+    bool mapped;
+    
+    // Fallback storage where mapping is unavailable
+    std::vector<unsigned char> buffer;
+};
+
+// True on hosts that store integers little-endian, the byte order of the binary cache files
+bool IsLittleEndian();
+
+// Create the parent directories and write a file through writer under a temporary name,
+// then rename it over path so readers see either the old file or the complete new one.
+// Returns false, leaving any old file in place, if a write or the rename fails.
+bool WriteFileReplacing(const std::string &path, const std::function<void(std::ostream &out)> &writer);
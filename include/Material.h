@@ -1,8 +1,26 @@
 #pragma once
 
+#include <memory>
 #include <glm/glm.hpp>
 #include "Shader.h"
 #include "TextureLoader.h"
+#include "AsyncTextureLoader.h"
+
+// Sentinel for materials that have not been registered with a MaterialRegistry
+const unsigned int INVALID_MATERIAL_ID = 0xFFFFFFFFu;
+
+struct MaterialSlot;
+
+// Fixed texture units for material maps
+enum MaterialTextureUnit {
+    ALBEDO_TEXTURE_UNIT = 0,
+    NORMAL_TEXTURE_UNIT,
+    METALLIC_TEXTURE_UNIT,
+    ROUGHNESS_TEXTURE_UNIT,
+    AO_TEXTURE_UNIT,
+    ORM_TEXTURE_UNIT,
+    MATERIAL_TEXTURE_UNIT_COUNT
+};
 
 class Material {
 public:
@@ -18,29 +36,82 @@ public:
     unsigned int metallicMap;
     unsigned int roughnessMap;
     unsigned int aoMap;
+    unsigned int ormMap;   // Occlusion, roughness and metallic packed in R, G and B
     
     bool useAlbedoMap;
     bool useNormalMap;
     bool useMetallicMap;
     bool useRoughnessMap;
     bool useAoMap;
+    bool useOrmMap;
+    
+    // Slot in the MaterialRegistry parameter buffer; reset whenever a property changes
+    unsigned int registryID;
     
     // Constructor
     Material();
     
-    // Apply material to shader
+    // Select this material's parameter slot and bind its textures.
+    // The material must be registered with a MaterialRegistry first; an unregistered one
+    // still binds its textures but leaves the shader's slot index as it was.
     void Apply(Shader &shader);
     
-    // Load texture maps
+    // Texture bound to a material unit, or 0 if that map is unused
+    unsigned int GetTexture(MaterialTextureUnit unit) const;
+    
+    // True if both materials would render identically
+    bool SameAs(const Material &other) const;
+    
+    // Load texture maps through the shared texture cache, so materials using the same file
+    // share one texture. With an async loader set a new map is decoded and uploaded in the
+    // background, showing the material's scalar value until it is ready.
     void LoadAlbedoMap(const char* path);
     void LoadNormalMap(const char* path);
     void LoadMetallicMap(const char* path);
     void LoadRoughnessMap(const char* path);
     void LoadAoMap(const char* path);
     
+    // Use one packed occlusion (R), roughness (G) and metallic (B) texture, such as a glTF
+    // occlusion/metallic-roughness image or a texture_cook orm file, in place of the three
+    // separate maps: one binding and one fetch instead of three
+    void LoadOrmMap(const char* path);
+    
+    // Pack separate occlusion, roughness and metallic maps into one ORM texture at load
+    // time; a nullptr path keeps that property's scalar value. Packing is synchronous.
+    void PackOrmMaps(const char* aoPath, const char* roughnessPath, const char* metallicPath);
+    
+    // Loader the Load*Map calls stream through, or nullptr to load synchronously. Only a
+    // handle is kept, so loads turn synchronous again once the loader is destroyed.
+    static void SetAsyncTextureLoader(AsyncTextureLoader* loader);
+    
+    // Use an existing texture for a map (0 disables it); the caller keeps ownership.
+    // Maps are scaled by their scalar values like glTF factors, but attaching one resets
+    // its scalars to 1, so a factor to apply has to be set after the map. A packed ORM
+    // map and the separate metallic, roughness and AO maps exclude each other: setting
+    // one side drops the other.
+    void SetTexture(MaterialTextureUnit unit, unsigned int texture);
+    
+    // Use a cached texture for a map; the material shares ownership of it
+    void SetTexture(MaterialTextureUnit unit, const TextureRef &texture);
+    
     // Set scalar values
     void SetAlbedo(const glm::vec3 &color);
     void SetMetallic(float value);
     void SetRoughness(float value);
     void SetAo(float value);
+    
+private:
+    friend class MaterialRegistry;
+    
+    // Cached maps loaded by Load*Map, released with the last material copy using them
+    TextureRef mapReferences[MATERIAL_TEXTURE_UNIT_COUNT];
+    
+    // Registry slot shared by the copies using registryID, freed with the last of them
+    std::shared_ptr<MaterialSlot> registrySlot;
+    
+    // Drop the registry slot after a property change
+    void Unregister();
+    
+    // Bind a packed ORM map and drop the separate maps it replaces
+    void SetOrmTexture(const TextureRef &texture);
 };
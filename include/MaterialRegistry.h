@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Material.h"
+#include "Model.h"
+
+// Capacity of the material parameter buffer (8 KB, well inside the 16 KB UBO minimum)
+const unsigned int MAX_MATERIALS = 256;
+
+// Bits of MaterialParams::flags, one per texture map in use
+enum MaterialFlags {
+    MATERIAL_ALBEDO_MAP    = 1 << 0,
+    MATERIAL_NORMAL_MAP    = 1 << 1,
+    MATERIAL_METALLIC_MAP  = 1 << 2,
+    MATERIAL_ROUGHNESS_MAP = 1 << 3,
+    MATERIAL_AO_MAP        = 1 << 4,
+    MATERIAL_ORM_MAP       = 1 << 5   // Supersedes the metallic, roughness and AO maps
+};
+
+// std140 mirror of one MaterialParams entry in the MaterialBlock shader block
+struct MaterialParams {
+    glm::vec3 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+    int flags;
+    float padding;
+};
+
+// What Material::SameAs compares: the scalars and the GL name bound to each unit. Slots
+// keep this rather than a Material copy, so they hold no references to its maps.
+struct MaterialKey {
+    glm::vec3 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+    unsigned int textures[MATERIAL_TEXTURE_UNIT_COUNT];
+    
+    explicit MaterialKey(const Material &material);
+    bool operator==(const MaterialKey &other) const;
+};
+
+// A parameter slot in use, shared by every material registered to it. When the last of
+// them changes or is destroyed its ID goes back to the registry's free list, if the
+// registry still exists.
+struct MaterialSlot {
+    unsigned int id;
+    MaterialKey key;        // Properties the slot was written from
+    std::weak_ptr<std::vector<unsigned int>> freeIDs;
+    
+    MaterialSlot(unsigned int id, const Material &material, const std::shared_ptr<std::vector<unsigned int>> &freeIDs);
+    
+    ~MaterialSlot();
+};
+
+// Assigns every unique Material an ID and keeps its scalars in a shared UBO slot
+class MaterialRegistry {
+public:
+    // Binding point all programs attach their MaterialBlock to
+    static const unsigned int BINDING_POINT = 1;
+    
+    // Constructor creates the parameter buffer and binds it to BINDING_POINT
+    MaterialRegistry();
+    ~MaterialRegistry();
+    
+    MaterialRegistry(const MaterialRegistry&) = delete;
+    MaterialRegistry& operator=(const MaterialRegistry&) = delete;
+    
+    // Bind the shader's MaterialBlock and assign its material sampler units
+    void Attach(Shader &shader) const;
+    
+    // Register a material and store its ID, sharing the slot of an identical material or
+    // taking a free one. Returns INVALID_MATERIAL_ID, leaving the material unregistered,
+    // if all MAX_MATERIALS slots are in use.
+    unsigned int Register(Material &material);
+    
+    // Register the materials of every mesh in a model
+    void Register(Model &model);
+    
+    // Number of slots currently in use
+    unsigned int GetMaterialCount() const;
+    
+private:
+    // Slot of each ID handed out so far, expired once its materials have released it
+    std::vector<std::weak_ptr<MaterialSlot>> slots;
+    std::shared_ptr<std::vector<unsigned int>> freeIDs;
+    bool overflowReported;
+    unsigned int UBO;
+    
+    // Write a material's scalars and map flags into its slot
+    void writeSlot(unsigned int id, const Material &material);
+};
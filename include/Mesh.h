@@ -1,37 +1,138 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <string>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "Shader.h"
 #include "Material.h"
+#include "VertexFormat.h"
+#include "MeshOptimizer.h"
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
+// Whether a Mesh keeps its vertex and index arrays in host memory after upload
+enum class MeshStorage {
+    GPUOnly,    // Release the CPU copies once uploaded
+    Retained    // Keep them for CPU access (picking, collision, BVH builds)
+};
+
+// Vertex and index streams already in a Mesh's upload layout, e.g. mapped from a MeshCache
+struct MeshBufferView {
+    const void* vertexData = nullptr;   // vertexCount vertices in format's layout
+    const void* indexData = nullptr;    // indexCount indices of indexType
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    VertexFormat format = VertexFormat::Standard;
+    MeshOptimizationStats optimizationStats;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
 };
 
 class Mesh {
 public:
-    // Mesh data
+    // Mesh data; vertices is empty after upload unless the mesh is Retained
     std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
     Material material;
     
-    // Constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, Material material);
+    // Layout of the uploaded vertex buffer; retained vertices are always kept at full precision
+    VertexFormat format;
+    MeshStorage storage;
+    
+    // Constructor; takes ownership of the arrays, which OptimizeMesh reorders before upload
+    Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, Material material,
+         VertexFormat format = VertexFormat::Standard, MeshStorage storage = MeshStorage::GPUOnly);
+    
+    // Constructor for arrays that already went through OptimizeMesh (e.g. on a loader thread)
+    Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices,
+         const MeshOptimizationStats &optimizationStats, Material material,
+         VertexFormat format = VertexFormat::Standard, MeshStorage storage = MeshStorage::GPUOnly);
+    
+    // Constructor for streams already in the upload layout; they are passed to
+    // glBufferData as-is and only copied if the mesh is Retained
+    Mesh(const MeshBufferView &buffers, Material material, MeshStorage storage = MeshStorage::GPUOnly);
+    ~Mesh();
+    
+    // Meshes own their VAO and buffers, so they can be moved but not copied
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh &&other) noexcept;
+    Mesh& operator=(Mesh &&other) noexcept;
     
     // Render the mesh
     void Draw(Shader &shader);
     
+    // Issue the indexed draw call; expects this mesh's VAO to be bound
+    void DrawElements() const;
+    
+    // Issue an instanced draw call; expects this mesh's VAO to be bound
+    void DrawElementsInstanced(unsigned int instanceCount) const;
+    
+    // Source per-instance attributes (locations 5-11 in pbr.vs) from a buffer holding
+    // tightly packed model matrices at offset 0 and normal matrices at normalMatrixOffset
+    void SetInstanceBuffer(unsigned int instanceVBO, size_t normalMatrixOffset);
+    
+    // Vertex array object holding this mesh's buffers and attribute layout
+    unsigned int GetVAO() const;
+    
+    // Vertex cache statistics before and after construction-time optimization
+    const MeshOptimizationStats& GetOptimizationStats() const;
+    
+    // Index storage: GL_UNSIGNED_SHORT when every vertex fits in 16 bits, GL_UNSIGNED_INT otherwise
+    GLenum GetIndexType() const;
+    size_t GetIndexCount() const;
+    size_t GetIndexBufferSize() const;
+    
+    // Read back an index; only valid while HasCPUData()
+    unsigned int GetIndex(size_t i) const;
+    
+    size_t GetVertexCount() const;
+    bool HasCPUData() const;
+    
+    // Model-space axis-aligned bounding box
+    const glm::vec3& GetBoundsMin() const;
+    const glm::vec3& GetBoundsMax() const;
+    
+    // Memory held by the CPU copies and by the vertex and index buffers
+    size_t GetHostMemorySize() const;
+    size_t GetGPUMemorySize() const;
+    
+    // VAOs and buffers currently owned by all meshes, for leak checks
+    static unsigned int GetLiveGLObjectCount();
+    
+    // Index type a mesh with this many vertices is stored with
+    static GLenum SelectIndexType(size_t vertexCount);
+
 private:
-    // Render data
-    unsigned int VAO, VBO, EBO;
+    // Render data (0 once released or moved from)
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    
+    // Indices in the narrowest type that addresses every vertex; only one is filled
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+    GLenum indexType;
+    size_t vertexCount;
+    size_t indexCount;
+    
+    glm::vec3 boundsMin, boundsMax;
+    MeshOptimizationStats optimizationStats;
+    
+    static unsigned int liveGLObjects;
+    
+    // Instance buffer layout currently wired into the VAO (0 if none)
+    unsigned int instanceBuffer = 0;
+    size_t instanceNormalOffset = 0;
+    
+    // Initializes all the buffer objects/arrays from streams in the upload layout
+    void setupMesh(const void* vertexData, const void* indexData);
+    
+    // Free the host arrays of a GPUOnly mesh
+    void releaseCPUData();
+    
+    // Delete the GL objects, if any, and reset the handles
+    void releaseGLObjects();
     
-    // Initializes all the buffer objects/arrays
-    void setupMesh();
+    // Attribute layouts for each vertex format (VAO and VBO bound)
+    void setupStandardAttributes();
+    void setupPackedAttributes();
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "MappedFile.h"
+
+// Bump whenever the file layout, Vertex/PackedVertex or the mesh generators change
+const uint32_t MESH_CACHE_VERSION = 1;
+
+// Scalar material parameters stored alongside the meshes so a cache describes its
+// meshes without the source file; textures are not cached
+struct MeshCacheMaterial {
+    glm::vec3 albedo = glm::vec3(1.0f);
+    float metallic = 1.0f;
+    float roughness = 1.0f;
+    float ao = 1.0f;
+};
+
+// Builds a mesh cache file: a little-endian header, a mesh table, a material table,
+// then each mesh's vertex and index streams in the exact layout Mesh uploads
+class MeshCacheWriter {
+public:
+    // Add a mesh that already went through OptimizeMesh; the streams are packed and
+    // narrowed here the same way Mesh does it. material indexes the material table (-1: none).
+    void AddMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                 const MeshOptimizationStats &optimizationStats, VertexFormat format, int material);
+    void AddMaterial(const MeshCacheMaterial &material);
+    
+    // Write the file, creating its directory, tagged with the key of whatever it was built
+    // from. It is written under a temporary name and renamed, so readers never see a partial cache.
+    bool Write(const std::string &path, uint64_t sourceKey) const;
+
+private:
+    struct Entry {
+        std::vector<unsigned char> vertexData;
+        std::vector<unsigned char> indexData;
+        MeshBufferView view;  // Counts, types and statistics; the pointers are unused
+        int material;
+    };
+    std::vector<Entry> entries;
+    std::vector<MeshCacheMaterial> materials;
+};
+
+// Read-only view of a mesh cache file. The file stays mapped while open and the
+// mesh views point straight into it, so they can be handed to Mesh without copying.
+class MeshCache {
+public:
+    // Map and validate a cache file. Returns false, logging why, if it is missing,
+    // from another version, built from a different source key, or corrupt.
+    bool Open(const std::string &path, uint64_t sourceKey);
+    void Close();
+    
+    size_t GetMeshCount() const;
+    const MeshBufferView& GetMesh(size_t i) const;
+    
+    // Material table index of a mesh, or -1 for none
+    int GetMeshMaterial(size_t i) const;
+    
+    const std::vector<MeshCacheMaterial>& GetMaterials() const;
+    
+    // Size of the mapped file
+    size_t GetFileSize() const;
+
+private:
+    MappedFile file;
+    std::vector<MeshBufferView> meshes;
+    std::vector<int> meshMaterials;
+    std::vector<MeshCacheMaterial> materials;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "VertexFormat.h"
+
+// Post-transform cache efficiency of an index buffer, simulated on a FIFO cache
+struct VertexCacheStats {
+    float acmr = 0.0f;  // Average cache miss ratio: vertex shader runs per triangle (0.5 - 3.0)
+    float atvr = 0.0f;  // Average transformed vertex ratio: runs per referenced vertex (1.0 is optimal)
+};
+
+// Before/after statistics of OptimizeMesh
+struct MeshOptimizationStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    double milliseconds = 0.0;
+};
+
+// FIFO size used for statistics; typical of the post-transform caches of recent GPUs
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// Simulate a FIFO post-transform cache over an indexed triangle list
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorder triangles for post-transform cache reuse (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// Reorder clusters of a cache-optimized index buffer so outward-facing clusters
+// are drawn first, reducing overdraw from most viewpoints. Clusters are split where
+// the running ACMR stays within threshold times the cluster's own ACMR.
+void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      float threshold = 1.05f);
+
+// Reorder vertices into first-use order for sequential vertex fetch and rewrite
+// the indices to match; unreferenced vertices are dropped
+void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// Run all three passes in order and return the cache statistics before and after
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "ThreadPool.h"
+
+// How the texels of an image are averaged into its mips
+enum class MipFilter {
+    Linear,     // Every channel averaged as stored (metallic, roughness, AO, ORM)
+    SRGB,       // RGB averaged in linear light, alpha as stored; 1-2 channel images stay linear
+    Normal      // Tangent-space normals in RGB averaged and renormalized
+};
+
+// Alpha-test threshold whose coverage the mips of sRGB RGBA images keep by default
+const float MIP_ALPHA_COVERAGE_CUTOFF = 0.5f;
+
+// Mip levels 1 and below of an 8-bit image, down to 1x1, in one allocation with tightly
+// packed rows; level 0 stays with the caller
+struct MipChain {
+    struct Level {
+        int width = 0;
+        int height = 0;
+        size_t offset = 0;      // Into pixels
+    };
+    std::vector<Level> levels;  // levels[0] is mip level 1
+    std::vector<unsigned char> pixels;
+    
+    const unsigned char* GetLevelData(size_t index) const;
+};
+
+// Levels in a full mip chain down to 1x1, level 0 included
+int GetMipLevelCount(int width, int height);
+
+// Build the mip chain of an image with 1-4 components with a 2x2 box filter, clamped at
+// odd edges. Levels are filtered from the unrounded floats of the level above, with SSE
+// where available. For sRGB RGBA images with alphaCoverageCutoff > 0, each level's alpha
+// is scaled so the fraction of texels passing that alpha test matches level 0, keeping
+// cutouts from thinning out with distance. Rows are spread over pool if one is given;
+// pass none from a task already running on a pool.
+MipChain GenerateMipChain(const unsigned char* pixels, int width, int height, int components, MipFilter filter,
+                          ThreadPool* pool = nullptr, float alphaCoverageCutoff = MIP_ALPHA_COVERAGE_CUTOFF);
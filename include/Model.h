@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 #include "Mesh.h"
 #include "Shader.h"
+#include "GLTFLoader.h"
 
 class Model {
 public:
@@ -14,25 +15,74 @@ public:
     
     // Constructor
     Model();
+    ~Model();
     
-    // Generate primitives
-    void CreateSphere(unsigned int xSegments, unsigned int ySegments, float radius, Material material);
-    void CreateCube(float size, Material material);
-    void CreatePlane(float width, float height, Material material);
+    // Models own GL buffers, so they cannot be copied
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
     
-    // Load model from file
-    bool LoadModel(const std::string &path);
+    // Residency of meshes created from here on (GPUOnly by default)
+    void SetMeshStorage(MeshStorage storage);
     
-    // Draw the model
+    // Generate primitives; VertexFormat::Packed meshes need a PACKED_VERTEX shader variant
+    void CreateSphere(unsigned int xSegments, unsigned int ySegments, float radius, Material material,
+                      VertexFormat format = VertexFormat::Standard);
+    void CreateCube(float size, Material material, VertexFormat format = VertexFormat::Standard);
+    void CreatePlane(float width, float height, Material material, VertexFormat format = VertexFormat::Standard);
+    
+    // Load a glTF 2.0 model (.gltf or .glb). Meshes and images are decoded on
+    // threadCount workers (0: one per hardware thread); GL uploads stay on this thread.
+    // With a mesh cache directory set, geometry is read from the cache when it is
+    // newer than the file and the cache is (re)built otherwise.
+    bool LoadModel(const std::string &path, VertexFormat format = VertexFormat::Standard, unsigned int threadCount = 0);
+    
+    // Phase timings of the last LoadModel call
+    const GLTFLoadStats& GetLoadStats() const;
+    
+    // Directory for binary mesh caches of loaded and generated meshes, shared by all
+    // models; created on first write. Empty (the default) disables caching.
+    static void SetMeshCacheDirectory(const std::string &directory);
+    
+    // Index memory across all meshes, and what it would take with 32-bit indices
+    size_t GetIndexBufferSize() const;
+    size_t GetIndexCount() const;
+    
+    // Memory held in host arrays and in GL objects, including the instance buffer and textures
+    size_t GetHostMemorySize() const;
+    size_t GetGPUMemorySize() const;
+    
+    // Draw the model; the caller sets the "model" and "normalMatrix" uniforms
     void Draw(Shader &shader);
     
+    // Draw one instance of the model per transform, one draw call per mesh.
+    // The shader must be built with the INSTANCED define.
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count);
+    void DrawInstanced(Shader &shader, const std::vector<glm::mat4> &transforms);
+
 private:
-    // Processes a node in assimp's node hierarchy
-    void processNode(void* node, void* scene);
+    MeshStorage meshStorage;
+    
+    // Per-instance attribute buffer shared by all meshes:
+    // instanceCapacity model matrices followed by as many normal matrices
+    unsigned int instanceVBO;
+    size_t instanceCapacity;
+    std::vector<glm::mat3> instanceNormalMatrices;
+    
+    // Textures created by LoadModel, owned by the model
+    std::vector<unsigned int> textures;
+    size_t textureBytes;
+    
+    GLTFLoadStats loadStats;
+    
+    static std::string meshCacheDirectory;
+    
+    // Cache file for a source description, or an empty string when caching is disabled
+    static std::string getMeshCachePath(const std::string &identity);
     
-    // Processes a mesh from assimp
-    Mesh processMesh(void* mesh, void* scene);
+    // Add a generated mesh from its cache; false if there is no valid cache for it
+    bool loadCachedMesh(const std::string &identity, const Material &material, VertexFormat format);
     
-    // Load textures from assimp material
-    std::vector<unsigned int> loadMaterialTextures(void* mat, int type, std::string typeName);
+    // Optimize and add a generated mesh, writing its cache when caching is enabled
+    void addGeneratedMesh(const std::string &identity, std::vector<Vertex> &&vertices,
+                          std::vector<unsigned int> &&indices, const Material &material, VertexFormat format);
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "MaterialRegistry.h"
+
+// State changes issued and avoided by the last RenderQueue::Flush
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned int programBinds = 0;
+    unsigned int programBindsSkipped = 0;
+    unsigned int materialBinds = 0;
+    unsigned int materialBindsSkipped = 0;
+    unsigned int textureBinds = 0;
+    unsigned int textureBindsSkipped = 0;
+    unsigned int vaoBinds = 0;
+    unsigned int vaoBindsSkipped = 0;
+};
+
+// Collects draws for a frame, sorts them by (program, material, VAO) and
+// submits them while skipping redundant state changes
+class RenderQueue {
+public:
+    // Unregistered materials are registered with the given registry on submission
+    RenderQueue(MaterialRegistry &registry);
+    
+    // Queue every mesh of a model with the given transform; meshes whose material the
+    // registry has no room for are left out
+    void Submit(Shader &shader, Model &model, const glm::mat4 &transform);
+    
+    // Sort and draw all queued commands, then clear the queue
+    void Flush();
+    
+    // Statistics of the last flush
+    const RenderStats& GetStats() const;
+    
+private:
+    struct DrawCommand {
+        uint64_t sortKey;
+        Shader *shader;
+        const Mesh *mesh;
+        uint32_t transformIndex;
+    };
+    
+    // Per-program uniform handles used while flushing
+    struct ProgramUniforms {
+        UniformHandle model;
+        UniformHandle normalMatrix;
+        UniformHandle materialIndex;
+    };
+    
+    MaterialRegistry &registry;
+    std::vector<DrawCommand> commands;
+    std::vector<uint32_t> order;
+    
+    // Object transforms, stored contiguously so normal matrices can be computed in one batch
+    std::vector<glm::mat4> transforms;
+    std::vector<glm::mat3> normalMatrices;
+    std::unordered_map<unsigned int, ProgramUniforms> programUniforms;
+    RenderStats stats;
+    
+    const ProgramUniforms& GetProgramUniforms(Shader &shader);
+};
@@ -4,21 +4,54 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// Pre-resolved uniform location. Resolve once with Shader::uniform() and
+// reuse it in hot paths so no name has to be hashed per draw.
+struct UniformHandle {
+    int location = -1;
+
+    bool isValid() const { return location >= 0; }
+};
+
+// Uniform lookup counters, accumulated across all shaders until reset
+struct UniformLookupStats {
+    unsigned int driverLookups = 0;  // glGetUniformLocation calls
+    unsigned int hashedLookups = 0;  // Name lookups in the reflected location table
+};
+
 class Shader {
 public:
     // Program ID
     unsigned int ID;
 
-    // Constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath);
+    // Constructor reads and builds the shader; each define is injected as
+    // "#define <define>" after the #version line of every stage to select a shader
+    // variant. Stages may pull in shared declarations with #include "file", resolved
+    // against the stage's own directory. geometryPath adds an optional geometry stage.
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines = {},
+           const char* geometryPath = nullptr);
     
+    // The program is owned and deleted with the shader
+    ~Shader();
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    Shader(Shader &&other) noexcept;
+    Shader& operator=(Shader &&other) noexcept;
+
     // Use/activate the shader
     void use();
+
+    // Bind a named uniform block to a buffer binding point (false if the program has no such block)
+    bool bindUniformBlock(const std::string &blockName, unsigned int bindingPoint) const;
     
+    // Resolve a uniform name to a handle (one hashed lookup, no driver call)
+    UniformHandle uniform(const std::string &name) const;
+
     // Utility uniform functions
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
@@ -33,7 +66,45 @@ public:
     void setMat3(const std::string &name, const glm::mat3 &mat) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
+    // Handle-based uniform functions for hot paths
+    void setBool(UniformHandle handle, bool value) const;
+    void setInt(UniformHandle handle, int value) const;
+    void setFloat(UniformHandle handle, float value) const;
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const;
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const;
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const;
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const;
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const;
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const;
+
+    // Lookup counters for the current frame
+    static const UniformLookupStats& GetLookupStats();
+    static void ResetLookupStats();
+
 private:
+    // Active uniform locations, reflected once after linking
+    std::unordered_map<std::string, int> uniformLocations;
+
+    static UniformLookupStats lookupStats;
+
     // Utility function for checking shader compilation/linking errors
     void checkCompileErrors(unsigned int shader, std::string type);
+    
+    // Read a source file and inject the variant defines (empty string if it cannot be read)
+    static std::string readSource(const char* path, const std::vector<std::string> &defines);
+    
+    // Replace each #include "file" line with that file, found next to path
+    static std::string resolveIncludes(const std::string &source, const char* path);
+    
+    // Compile one stage, logging errors under type
+    unsigned int compileStage(GLenum stage, const std::string &source, const std::string &type);
+
+    // Insert variant defines after the #version directive
+    static std::string injectDefines(const std::string &source, const std::vector<std::string> &defines);
+    
+    // Query all active uniforms and cache their locations
+    void reflectUniforms();
+
+    // Find a uniform location in the reflected table (-1 if inactive)
+    int findLocation(const std::string &name) const;
 };
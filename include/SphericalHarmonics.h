@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "ThreadPool.h"
+
+// Real SH basis functions in bands 0-2
+const unsigned int SH_COEFFICIENT_COUNT = 9;
+
+// Diffuse irradiance as L2 spherical harmonics (Ramamoorthi and Hanrahan, "An Efficient
+// Representation for Irradiance Environment Maps"). The coefficients already include the
+// cosine-lobe convolution, the 1/pi of a Lambertian surface and the basis normalization,
+// so evaluating them is a quadratic polynomial in the normal; the result matches what the
+// irradiance convolution cubemap stores.
+struct IrradianceSH {
+    glm::vec3 coefficients[SH_COEFFICIENT_COUNT];
+};
+
+// Project a cubemap onto IrradianceSH. faces holds six size x size RGB float images in
+// GL face order, rows as glGetTexImage returns them. Rows are reduced in parallel on pool
+// if one is given.
+IrradianceSH ProjectIrradianceSH(const float *faces, unsigned int size, ThreadPool *pool = nullptr);
+
+// Irradiance / pi around a unit normal; the same polynomial pbr.fs evaluates
+glm::vec3 EvaluateIrradianceSH(const IrradianceSH &sh, const glm::vec3 &normal);
+
+// Direction through the center of texel (x, y) of a cubemap face, normalized
+glm::vec3 CubemapTexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size);
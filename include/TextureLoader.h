@@ -2,13 +2,84 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <GL/glew.h>
+#include "AsyncTextureLoader.h"
+#include "ChannelPacking.h"
+#include "MipGenerator.h"
+
+// Counters of the shared texture cache since startup
+struct TextureCacheStats {
+    unsigned int requests = 0;
+    unsigned int pathHits = 0;          // The same file again
+    unsigned int contentHits = 0;       // An identical file under another path
+    unsigned int liveTextures = 0;
+    size_t liveBytes = 0;               // Estimated GPU memory of the cached textures, mips included
+    size_t bytesSaved = 0;              // Estimated GPU memory hits did not allocate again
+    
+    double GetHitRate() const;
+};
+
+// A texture in the shared cache, deleted with the last TextureRef to it
+struct TextureCacheEntry;
+
+// Shared, reference-counted handle to a cached texture; copies share the texture
+class TextureRef {
+public:
+    TextureRef() = default;
+    
+    // GL texture name, or 0 for an empty reference
+    unsigned int Get() const;
+    
+private:
+    friend class TextureLoader;
+    std::shared_ptr<TextureCacheEntry> entry;
+};
 
 class TextureLoader {
 public:
-    // Load a 2D texture from a file
+    // Load a 2D texture from a file, sRGB if gamma is set; .ktx2 files go to LoadCompressedTexture
     static unsigned int LoadTexture(const char* path, bool gamma = false);
     
+    // Load a block-compressed KTX2 texture with the mip chain it stores, uploading the blocks
+    // straight from the mapped file. The file's format decides the color space. BC1 is
+    // decoded on the CPU where S3TC is not supported.
+    static unsigned int LoadCompressedTexture(const char* path);
+    
+    // Load a 2D texture through the shared cache; filter decides the color space and how
+    // the mips are built. A file already loaded, under the same canonical path or any path
+    // with identical contents, returns the existing texture if filter matches. A new
+    // texture is streamed in by asyncLoader, showing placeholder, if one is given. GL
+    // thread only.
+    static TextureRef LoadSharedTexture(const char* path, MipFilter filter = MipFilter::Linear,
+                                        AsyncTextureLoader* asyncLoader = nullptr,
+                                        const unsigned char placeholder[4] = PLACEHOLDER_WHITE);
+    
+    // Decode separate occlusion, roughness and metallic maps and pack them into one RGB
+    // texture (see ChannelPacking.h) through the shared cache; a nullptr path fills its
+    // channel with the matching constant. Decoding is synchronous. GL thread only.
+    static TextureRef LoadSharedORMTexture(const char* occlusionPath, const char* roughnessPath,
+                                           const char* metallicPath, const unsigned char constants[ORM_CHANNEL_COUNT]);
+    
+    static const TextureCacheStats& GetCacheStats();
+    
+    // Create a mipmapped 2D texture from 8-bit pixels with 1-4 components, sRGB for 3 and 4
+    // components with MipFilter::SRGB. The mips are uploaded from mips if given, else
+    // generated on the CPU here (see MipGenerator.h) rather than by glGenerateMipmap.
+    static unsigned int CreateTexture(const unsigned char* pixels, int width, int height, int components,
+                                      MipFilter filter = MipFilter::Linear, const MipChain* mips = nullptr);
+    
+    // Sized internal format of 8-bit pixels with 1-4 components; 3 and 4 are sRGB if srgb is set
+    static GLenum GetInternalFormat(int components, bool srgb);
+    
+    // Client pixel format of 8-bit pixels with 1-4 components
+    static GLenum GetPixelFormat(int components);
+    
+    // Allocate levels of the texture bound to GL_TEXTURE_2D for 8-bit pixels with 1-4
+    // components: immutable storage where ARB_texture_storage (GL 4.2) is available, one
+    // glTexImage2D per level otherwise
+    static void AllocateStorage(int width, int height, int levels, int components, bool srgb);
+    
     // Load a cubemap texture from 6 individual files
     static unsigned int LoadCubemap(const std::vector<std::string>& faces);
     
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads running submitted tasks in FIFO order.
+// Tasks must not touch the GL context; only the thread that owns it may.
+// ParallelFor balances its iterations across the workers by work stealing.
+class ThreadPool {
+public:
+    // threadCount 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    // Queue a task for any worker
+    void Submit(std::function<void()> task);
+    
+    // Block until every submitted task has finished
+    void Wait();
+    
+    // Run body(i) for i in [0, count) across the workers and wait for all of them. Each
+    // worker starts on an equal slice of the range and, once it runs dry, steals the back
+    // half of the largest slice left, so iterations of uneven cost still keep every worker busy.
+    void ParallelFor(size_t count, const std::function<void(size_t)> &body);
+    
+    unsigned int GetThreadCount() const;
+    
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable tasksFinished;
+    size_t pendingTasks;
+    bool stopping;
+    
+    // Iterations of one ParallelFor slice still to run; [begin, end)
+    struct Slice {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+    
+    void workerLoop();
+    
+    // Run the iterations of one slice, then steal from the others until none are left
+    static void runSlices(std::vector<Slice> &slices, size_t own, const std::function<void(size_t)> &body);
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Normal matrix (transpose of the inverse of the upper 3x3) for one transform
+glm::mat3 ComputeNormalMatrix(const glm::mat4 &model);
+
+// Normal matrices for a batch of transforms, four at a time with SSE when available
+void ComputeNormalMatrices(const glm::mat4 *models, glm::mat3 *normalMatrices, size_t count);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Full-precision vertex (56 bytes)
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+// GPU vertex layout selectable per Mesh
+enum class VertexFormat {
+    Standard,   // Vertex as-is
+    Packed      // PackedVertex; needs the PACKED_VERTEX variant of pbr.vs
+};
+
+// Compact vertex (20 bytes). The tangent frame is one 2_10_10_10 word:
+// octahedral normal in x/y, tangent angle around the normal in z and
+// bitangent sign in w. The bitangent is rebuilt in the vertex shader.
+struct PackedVertex {
+    glm::vec3 Position;
+    uint32_t TangentFrame;
+    uint16_t TexCoords[2];  // Half floats
+};
+
+// Convert between the full and packed layouts
+PackedVertex PackVertex(const Vertex &vertex);
+Vertex UnpackVertex(const PackedVertex &vertex);
+
+// Size of one vertex in the given layout
+size_t GetVertexSize(VertexFormat format);
+
+// Axis-aligned bounds of the vertex positions (both zero for an empty set)
+void ComputeBounds(const Vertex *vertices, size_t count, glm::vec3 &boundsMin, glm::vec3 &boundsMax);
+
+// Storage savings and worst-case reconstruction error of packing a vertex set
+struct VertexPackingReport {
+    size_t vertexCount = 0;
+    size_t standardBytes = 0;
+    size_t packedBytes = 0;
+    float maxNormalErrorDegrees = 0.0f;
+    float maxTangentErrorDegrees = 0.0f;
+    float maxTexCoordError = 0.0f;
+    size_t bitangentFlips = 0;      // Bitangents that ended up on the wrong side
+};
+
+VertexPackingReport AnalyzeVertexPacking(const Vertex *vertices, size_t count);
@@ -12,11 +12,7 @@ uniform float metallic;
 uniform float roughness;
 uniform float ao;
 
-// Lights
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
-
-uniform vec3 camPos;
+#include "frame_uniforms.glsl"
 
 const float PI = 3.14159265359;
 
@@ -58,7 +54,7 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0) {
 
 void main() {
     vec3 N = normalize(Normal);
-    vec3 V = normalize(camPos - WorldPos);
+    vec3 V = normalize(camPos.xyz - WorldPos);
     
     // Calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
     // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)
@@ -69,13 +65,13 @@ void main() {
     vec3 Lo = vec3(0.0);
     
     // Calculate per-light radiance
-    for(int i = 0; i < 4; ++i) {
+    for(int i = 0; i < lightCount; ++i) {
         // Calculate per-light radiance
-        vec3 L = normalize(lightPositions[i] - WorldPos);
+        vec3 L = normalize(lights[i].position.xyz - WorldPos);
         vec3 H = normalize(V + L);
-        float distance = length(lightPositions[i] - WorldPos);
+        float distance = length(lights[i].position.xyz - WorldPos);
         float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = lightColors[i] * attenuation;
+        vec3 radiance = lights[i].color.rgb * attenuation;
         
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -110,6 +106,7 @@ void main() {
     vec3 color = ambient + Lo;
     
     // HDR tonemapping
+    color *= exposure;
     color = color / (color + vec3(1.0));
     // Gamma correction
     color = pow(color, vec3(1.0/2.2)); 
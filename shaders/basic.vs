@@ -11,8 +11,8 @@ out vec3 Normal;
 out mat3 TBN;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "frame_uniforms.glsl"
 
 void main() {
     TexCoords = aTexCoords;
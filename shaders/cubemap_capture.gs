@@ -0,0 +1,22 @@
+#version 330 core
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+out vec3 localPos;
+
+uniform mat4 captureViewProjections[6];
+uniform int captureFace;    // Single face to render, or -1 for all of them
+
+void main() {
+    // Emit the triangle once per cubemap face, in GL face order
+    for (int face = 0; face < 6; ++face) {
+        if (captureFace >= 0 && face != captureFace)
+            continue;
+        for (int i = 0; i < 3; ++i) {
+            localPos = gl_in[i].gl_Position.xyz;
+            gl_Layer = face;
+            gl_Position = captureViewProjections[face] * gl_in[i].gl_Position;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,27 @@
+#version 330 core
+#if defined(VERTEX_LAYER_ARB)
+#extension GL_ARB_shader_viewport_layer_array : require
+#elif defined(VERTEX_LAYER_AMD)
+#extension GL_AMD_vertex_shader_layer : require
+#endif
+layout (location = 0) in vec3 aPos;
+
+#if defined(VERTEX_LAYER_ARB) || defined(VERTEX_LAYER_AMD)
+// One instance per cubemap face, routed to its layer from here
+out vec3 localPos;
+
+uniform mat4 captureViewProjections[6];
+uniform int captureFace;    // Single face to render, or -1 for all of them
+
+void main() {
+    int face = captureFace >= 0 ? captureFace : gl_InstanceID;
+    localPos = aPos;
+    gl_Layer = face;
+    gl_Position = captureViewProjections[face] * vec4(aPos, 1.0);
+}
+#else
+// cubemap_capture.gs projects each triangle into every face
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+}
+#endif
@@ -0,0 +1,17 @@
+// Per-frame data shared by all programs, mirrored by FrameUniformData in FrameUniforms.h.
+// Pulled into a stage with #include "frame_uniforms.glsl" (see Shader::readSource).
+#define MAX_LIGHTS 32
+struct Light {
+    vec4 position;
+    vec4 color;
+};
+layout (std140) uniform FrameUniforms {
+    mat4 projection;
+    mat4 view;
+    vec4 camPos;
+    int lightCount;
+    float exposure;
+    float time;
+    vec4 irradianceSH[9];   // rgb = L2 SH of irradiance / PI (see SphericalHarmonics.h)
+    Light lights[MAX_LIGHTS];
+};
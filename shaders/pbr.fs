@@ -6,43 +6,48 @@ in vec3 WorldPos;
 in vec3 Normal;
 in mat3 TBN;
 
-// Material properties
-struct Material {
+// Material properties, one slot per registered material (see MaterialRegistry.h)
+#define MAX_MATERIALS 256
+#define MATERIAL_ALBEDO_MAP    1
+#define MATERIAL_NORMAL_MAP    2
+#define MATERIAL_METALLIC_MAP  4
+#define MATERIAL_ROUGHNESS_MAP 8
+#define MATERIAL_AO_MAP        16
+#define MATERIAL_ORM_MAP       32
+struct MaterialParams {
     vec3 albedo;
     float metallic;
     float roughness;
     float ao;
-    
-    sampler2D albedoMap;
-    sampler2D normalMap;
-    sampler2D metallicMap;
-    sampler2D roughnessMap;
-    sampler2D aoMap;
-    
-    bool useAlbedoMap;
-    bool useNormalMap;
-    bool useMetallicMap;
-    bool useRoughnessMap;
-    bool useAoMap;
+    int flags;
+    float padding;
 };
-uniform Material material;
-
-// Lights
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
+layout (std140) uniform MaterialBlock {
+    MaterialParams materials[MAX_MATERIALS];
+};
+uniform int materialIndex;
 
-// Camera
-uniform vec3 camPos;
+// Material texture maps
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+uniform sampler2D metallicMap;
+uniform sampler2D roughnessMap;
+uniform sampler2D aoMap;
+uniform sampler2D ormMap;   // r = occlusion, g = roughness, b = metallic
 
-// IBL
-uniform samplerCube irradianceMap;
+// IBL; diffuse irradiance comes from irradianceSH in FrameUniforms
 uniform samplerCube prefilterMap;
 uniform sampler2D brdfLUT;
 
+#include "frame_uniforms.glsl"
+
 const float PI = 3.14159265359;
 
 vec3 getNormalFromMap() {
-    vec3 tangentNormal = texture(material.normalMap, TexCoords).xyz * 2.0 - 1.0;
+    // z is rebuilt from x and y, so two-channel (BC5) normal maps work as well
+    vec3 tangentNormal;
+    tangentNormal.xy = texture(normalMap, TexCoords).xy * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
     return normalize(TBN * tangentNormal);
 }
 
@@ -78,6 +83,20 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
     return ggx1 * ggx2;
 }
 
+// Diffuse irradiance / PI around n; the coefficients already include the basis constants
+vec3 irradianceFromSH(vec3 n) {
+    vec3 irradiance = irradianceSH[0].rgb
+        + irradianceSH[1].rgb * n.y
+        + irradianceSH[2].rgb * n.z
+        + irradianceSH[3].rgb * n.x
+        + irradianceSH[4].rgb * (n.x * n.y)
+        + irradianceSH[5].rgb * (n.y * n.z)
+        + irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+        + irradianceSH[7].rgb * (n.x * n.z)
+        + irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+    return max(irradiance, vec3(0.0));
+}
+
 vec3 fresnelSchlick(float cosTheta, vec3 F0) {
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
@@ -87,15 +106,33 @@ vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness) {
 }
 
 void main() {
-    // Sample material textures
-    vec3 albedo = material.useAlbedoMap ? texture(material.albedoMap, TexCoords).rgb : material.albedo;
-    float metallic = material.useMetallicMap ? texture(material.metallicMap, TexCoords).r : material.metallic;
-    float roughness = material.useRoughnessMap ? texture(material.roughnessMap, TexCoords).r : material.roughness;
-    float ao = material.useAoMap ? texture(material.aoMap, TexCoords).r : material.ao;
+    MaterialParams material = materials[materialIndex];
+    
+    // Sample material textures; as glTF factors, the scalars scale whatever map is present
+    vec3 albedo = material.albedo;
+    if ((material.flags & MATERIAL_ALBEDO_MAP) != 0)
+        albedo *= texture(albedoMap, TexCoords).rgb;
+    float metallic = material.metallic;
+    float roughness = material.roughness;
+    float ao = material.ao;
+    if ((material.flags & MATERIAL_ORM_MAP) != 0) {
+        // One fetch of the packed map serves all three
+        vec3 orm = texture(ormMap, TexCoords).rgb;
+        ao *= orm.r;
+        roughness *= orm.g;
+        metallic *= orm.b;
+    } else {
+        if ((material.flags & MATERIAL_METALLIC_MAP) != 0)
+            metallic *= texture(metallicMap, TexCoords).r;
+        if ((material.flags & MATERIAL_ROUGHNESS_MAP) != 0)
+            roughness *= texture(roughnessMap, TexCoords).r;
+        if ((material.flags & MATERIAL_AO_MAP) != 0)
+            ao *= texture(aoMap, TexCoords).r;
+    }
     
     // Get normal from normal map if available
-    vec3 N = material.useNormalMap ? getNormalFromMap() : normalize(Normal);
-    vec3 V = normalize(camPos - WorldPos);
+    vec3 N = (material.flags & MATERIAL_NORMAL_MAP) != 0 ? getNormalFromMap() : normalize(Normal);
+    vec3 V = normalize(camPos.xyz - WorldPos);
     vec3 R = reflect(-V, N);
     
     // Calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
@@ -107,13 +144,13 @@ void main() {
     vec3 Lo = vec3(0.0);
     
     // Calculate per-light radiance
-    for(int i = 0; i < 4; ++i) {
+    for(int i = 0; i < lightCount; ++i) {
         // Calculate per-light radiance
-        vec3 L = normalize(lightPositions[i] - WorldPos);
+        vec3 L = normalize(lights[i].position.xyz - WorldPos);
         vec3 H = normalize(V + L);
-        float distance = length(lightPositions[i] - WorldPos);
+        float distance = length(lights[i].position.xyz - WorldPos);
         float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = lightColors[i] * attenuation;
+        vec3 radiance = lights[i].color.rgb * attenuation;
         
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -149,7 +186,7 @@ void main() {
     kD *= 1.0 - metallic;
     
     // Diffuse IBL
-    vec3 irradiance = texture(irradianceMap, N).rgb;
+    vec3 irradiance = irradianceFromSH(N);
     vec3 diffuse = irradiance * albedo;
     
     // Specular IBL
@@ -164,6 +201,7 @@ void main() {
     vec3 color = ambient + Lo;
     
     // HDR tonemapping
+    color *= exposure;
     color = color / (color + vec3(1.0));
     // Gamma correction
     color = pow(color, vec3(1.0/2.2)); 
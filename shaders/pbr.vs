@@ -1,24 +1,78 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+#ifdef PACKED_VERTEX
+// PackedVertex (see VertexFormat.h): octahedral normal in xy, tangent angle in z,
+// bitangent sign in w, all normalized to [0, 1]
+layout (location = 1) in vec4 aTangentFrame;
+layout (location = 2) in vec2 aTexCoords;
+#else
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+#endif
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
 out mat3 TBN;
 
+#ifdef INSTANCED
+// Per-instance transforms (see Model::DrawInstanced)
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in mat3 aInstanceNormalMatrix;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifndef SHADER_NORMAL_MATRIX
+// transpose(inverse(mat3(model))), precomputed once per object on the CPU
+uniform mat3 normalMatrix;
+#endif
+#endif
+
+#include "frame_uniforms.glsl"
+
+#ifdef PACKED_VERTEX
+vec3 octDecode(vec2 p) {
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+// Rebuild the object-space tangent frame; must match PackVertex()
+void unpackTangentFrame(vec4 packed, out vec3 normal, out vec3 tangent, out vec3 bitangent) {
+    normal = octDecode(packed.xy * 2.0 - 1.0);
+    
+    // Orthonormal basis around the normal (Duff et al. 2017)
+    float s = normal.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + normal.z);
+    float b = normal.x * normal.y * a;
+    vec3 b1 = vec3(1.0 + s * normal.x * normal.x * a, s * b, -s * normal.x);
+    vec3 b2 = vec3(b, s + normal.y * normal.y * a, -normal.y);
+    
+    float angle = (packed.z - 0.5) * 6.28318530718;
+    tangent = b1 * cos(angle) + b2 * sin(angle);
+    bitangent = cross(normal, tangent) * (packed.w > 0.5 ? 1.0 : -1.0);
+}
+#endif
 
 void main() {
+#ifdef PACKED_VERTEX
+    vec3 aNormal, aTangent, aBitangent;
+    unpackTangentFrame(aTangentFrame, aNormal, aTangent, aBitangent);
+#endif
+    
+#ifdef INSTANCED
+    mat4 model = aInstanceModel;
+    mat3 normalMatrix = aInstanceNormalMatrix;
+#elif defined(SHADER_NORMAL_MATRIX)
+    // Reference path: a 3x3 inverse for every vertex
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+#endif
+    
     TexCoords = aTexCoords;
     WorldPos = vec3(model * vec4(aPos, 1.0));
     
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
     Normal = normalMatrix * aNormal;
     
     // Calculate TBN matrix for normal mapping
@@ -6,7 +6,23 @@ uniform samplerCube environmentMap;
 uniform float roughness;
 
 const float PI = 3.14159265359;
-const uint SAMPLE_COUNT = 1024u;
+
+#ifdef FILTERED_IMPORTANCE_SAMPLING
+// Filtered importance sampling (GPU Gems 3, ch. 20): each sample reads the source mip
+// whose texels cover the solid angle the sample stands for, so far fewer samples give
+// a smooth result without the fireflies of point-sampling mip 0
+uniform int sampleCount;
+uniform float environmentResolution;    // Face size of the source's level 0
+
+float DistributionGGX(float NdotH, float roughness) {
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float denom = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * denom * denom);
+}
+#else
+const int sampleCount = 1024;
+#endif
 
 float RadicalInverse_VdC(uint bits) {
     bits = (bits << 16u) | (bits >> 16u);
@@ -51,15 +67,31 @@ void main() {
     float totalWeight = 0.0;
     vec3 prefilteredColor = vec3(0.0);
     
-    for(uint i = 0u; i < SAMPLE_COUNT; ++i) {
-        vec2 Xi = Hammersley(i, SAMPLE_COUNT);
+#ifdef FILTERED_IMPORTANCE_SAMPLING
+    // Solid angle of one source texel at level 0
+    float texelSolidAngle = 4.0 * PI / (6.0 * environmentResolution * environmentResolution);
+#endif
+    
+    for(uint i = 0u; i < uint(sampleCount); ++i) {
+        vec2 Xi = Hammersley(i, uint(sampleCount));
         vec3 H = ImportanceSampleGGX(Xi, N, roughness);
         vec3 L = normalize(2.0 * dot(V, H) * H - V);
         
         float NdotL = max(dot(N, L), 0.0);
         if(NdotL > 0.0) {
+#ifdef FILTERED_IMPORTANCE_SAMPLING
+            // With N = V the sampling pdf of L is D(h) / 4
+            float NdotH = max(dot(N, H), 0.0);
+            float pdf = DistributionGGX(NdotH, roughness) / 4.0 + 0.0001;
+            float sampleSolidAngle = 1.0 / (float(sampleCount) * pdf);
+            
+            // One level of bias trades a little blur for less aliasing between samples
+            float mipLevel = 0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0;
+            prefilteredColor += textureLod(environmentMap, L, max(mipLevel, 0.0)).rgb * NdotL;
+#else
             // Sample from the environment's mip level based on roughness/pdf
             prefilteredColor += texture(environmentMap, L).rgb * NdotL;
+#endif
             totalWeight += NdotL;
         }
     }
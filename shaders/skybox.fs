@@ -5,10 +5,13 @@ in vec3 WorldPos;
 
 uniform samplerCube environmentMap;
 
+#include "frame_uniforms.glsl"
+
 void main() {
     vec3 envColor = texture(environmentMap, WorldPos).rgb;
     
     // HDR tonemapping
+    envColor *= exposure;
     envColor = envColor / (envColor + vec3(1.0));
     // Gamma correction
     envColor = pow(envColor, vec3(1.0/2.2)); 
@@ -0,0 +1,315 @@
+#include "../include/AsyncTextureLoader.h"
+#include "../include/TextureLoader.h"
+#include <stb/stb_image.h>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+// One requested texture. The decode task fills in the image and its mips and then sets
+// decoded; every other field belongs to the render thread.
+struct AsyncTextureLoader::Request {
+    unsigned int texture = 0;
+    std::string path;
+    MipFilter filter = MipFilter::Linear;
+    unsigned char placeholder[4] = {};
+    
+    // Written by the decode task
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    MipChain mips;
+    double decodeMilliseconds = 0.0;
+    double mipMilliseconds = 0.0;
+    std::string error;
+    std::atomic<bool> decoded{false};
+    std::atomic<bool> cancelled{false};
+    
+    // Upload progress
+    bool counted = false;       // Decode added to the stats
+    bool allocated = false;     // Full-size chain allocated behind the placeholder
+    int uploadLevel = 0;
+    int uploadedRows = 0;       // Of uploadLevel
+    
+    ~Request() {
+        if (pixels)
+            stbi_image_free(pixels);
+    }
+    
+    int GetLevelCount() const {
+        return static_cast<int>(mips.levels.size()) + 1;
+    }
+    
+    // Pixels and size of a mip level
+    const unsigned char* GetLevel(int level, int &levelWidth, int &levelHeight) const {
+        if (level == 0) {
+            levelWidth = width;
+            levelHeight = height;
+            return pixels;
+        }
+        const MipChain::Level &mip = mips.levels[level - 1];
+        levelWidth = mip.width;
+        levelHeight = mip.height;
+        return mips.GetLevelData(level - 1);
+    }
+};
+
+double AsyncTextureStats::GetDecodeThroughput() const {
+    if (decodeMilliseconds <= 0.0)
+        return 0.0;
+    return decodedBytes / (1024.0 * 1024.0) / (decodeMilliseconds / 1000.0);
+}
+
+AsyncTextureLoader::AsyncTextureLoader(unsigned int threadCount, size_t stagingBufferSize, unsigned int stagingBufferCount)
+    : handle(std::make_shared<char>(), this), stagingBufferSize(stagingBufferSize), nextStagingBuffer(0) {
+    if (threadCount == 0)
+        threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    pool = std::make_unique<ThreadPool>(threadCount);
+    
+    // Buffers are written through unsynchronized maps, guarded by a fence per buffer
+    staging.resize(std::max(1u, stagingBufferCount));
+    for (StagingBuffer &buffer : staging) {
+        glGenBuffers(1, &buffer.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, stagingBufferSize, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+AsyncTextureLoader::~AsyncTextureLoader() {
+    // Textures released from here on no longer reach the loader
+    handle.reset();
+    
+    // Skip decodes that have not started; the pool drains its queue before it stops
+    for (const std::shared_ptr<Request> &request : requests)
+        request->cancelled.store(true);
+    pool.reset();
+    
+    for (StagingBuffer &buffer : staging) {
+        if (buffer.fence)
+            glDeleteSync(buffer.fence);
+        glDeleteBuffers(1, &buffer.buffer);
+    }
+}
+
+unsigned int AsyncTextureLoader::LoadTexture(const char* path, MipFilter filter, const unsigned char placeholder[4]) {
+    auto request = std::make_shared<Request>();
+    request->path = path;
+    request->filter = filter;
+    std::memcpy(request->placeholder, placeholder, sizeof(request->placeholder));
+    
+    // A complete single-level texture, so it can be sampled until the image arrives
+    glGenTextures(1, &request->texture);
+    glBindTexture(GL_TEXTURE_2D, request->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, TextureLoader::GetInternalFormat(4, filter == MipFilter::SRGB), 1, 1, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, request->placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
+    pool->Submit([request]() {
+        if (request->cancelled.load())
+            return;
+        auto start = std::chrono::high_resolution_clock::now();
+        request->pixels = stbi_load(request->path.c_str(), &request->width, &request->height, &request->components, 0);
+        if (!request->pixels)
+            request->error = stbi_failure_reason();
+        auto decodeEnd = std::chrono::high_resolution_clock::now();
+        request->decodeMilliseconds = std::chrono::duration<double, std::milli>(decodeEnd - start).count();
+        
+        // The chain is built here rather than by glGenerateMipmap on the render thread
+        if (request->pixels && !request->cancelled.load()) {
+            request->mips = GenerateMipChain(request->pixels, request->width, request->height, request->components,
+                                             request->filter);
+            request->mipMilliseconds = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - decodeEnd).count();
+        }
+        request->decoded.store(true, std::memory_order_release);
+    });
+    
+    requests.push_back(request);
+    stats.queueDepth = static_cast<unsigned int>(requests.size());
+    return request->texture;
+}
+
+unsigned int AsyncTextureLoader::Update(size_t budgetBytes) {
+    stats.uploadedBytes = 0;
+    stats.decoding = 0;
+    unsigned int completed = 0;
+    bool ringFull = false;
+    
+    GLint unpackAlignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < requests.size();) {
+        Request &request = *requests[i];
+        if (!request.decoded.load(std::memory_order_acquire)) {
+            stats.decoding++;
+            i++;
+            continue;
+        }
+        
+        if (!request.counted) {
+            request.counted = true;
+            stats.decodeMilliseconds += request.decodeMilliseconds;
+            stats.mipMilliseconds += request.mipMilliseconds;
+            if (request.pixels)
+                stats.decodedBytes += static_cast<size_t>(request.width) * request.height * request.components;
+        }
+        
+        // A texture that failed to load keeps showing its placeholder
+        if (!request.pixels) {
+            std::cout << "Texture failed to load at path: " << request.path << " (" << request.error << ")" << std::endl;
+            stats.failedTextures++;
+            requests.erase(requests.begin() + i);
+            continue;
+        }
+        
+        // Textures are uploaded one after another, so the first in line finishes first
+        while (!ringFull && request.uploadLevel < request.GetLevelCount() && stats.uploadedBytes < budgetBytes) {
+            if (!request.allocated)
+                beginUpload(request);
+            size_t sent = uploadRows(request, budgetBytes - stats.uploadedBytes);
+            if (sent == 0)
+                ringFull = true;
+            stats.uploadedBytes += sent;
+        }
+        
+        if (request.uploadLevel == request.GetLevelCount()) {
+            completeUpload(request);
+            stats.completedTextures++;
+            completed++;
+            requests.erase(requests.begin() + i);
+            continue;
+        }
+        i++;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    
+    stats.queueDepth = static_cast<unsigned int>(requests.size());
+    return completed;
+}
+
+bool AsyncTextureLoader::Cancel(unsigned int texture) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (requests[i]->texture == texture) {
+            // Uploads already issued are ordered before the caller's glDeleteTextures
+            requests[i]->cancelled.store(true);
+            requests.erase(requests.begin() + i);
+            stats.queueDepth = static_cast<unsigned int>(requests.size());
+            return true;
+        }
+    }
+    return false;
+}
+
+void AsyncTextureLoader::Finish() {
+    pool->Wait();
+    while (!requests.empty()) {
+        Update(std::numeric_limits<size_t>::max());
+        // Every staging buffer in flight; let the GPU catch up
+        if (!requests.empty())
+            glFinish();
+    }
+}
+
+unsigned int AsyncTextureLoader::GetQueueDepth() const {
+    return static_cast<unsigned int>(requests.size());
+}
+
+const AsyncTextureStats& AsyncTextureLoader::GetStats() const {
+    return stats;
+}
+
+std::weak_ptr<AsyncTextureLoader> AsyncTextureLoader::GetHandle() const {
+    return handle;
+}
+
+size_t AsyncTextureLoader::uploadRows(Request &request, size_t budgetBytes) {
+    int level = request.uploadLevel;
+    int width, height;
+    const unsigned char* levelPixels = request.GetLevel(level, width, height);
+    size_t rowBytes = static_cast<size_t>(width) * request.components;
+    size_t rows = std::min(static_cast<size_t>(height - request.uploadedRows), std::max<size_t>(1, budgetBytes / rowBytes));
+    const unsigned char* source = levelPixels + request.uploadedRows * rowBytes;
+    GLenum format = TextureLoader::GetPixelFormat(request.components);
+    glBindTexture(GL_TEXTURE_2D, request.texture);
+    
+    auto advance = [&](size_t uploaded) {
+        request.uploadedRows += static_cast<int>(uploaded);
+        if (request.uploadedRows == height) {
+            request.uploadLevel++;
+            request.uploadedRows = 0;
+        }
+    };
+    
+    // Small levels, and rows wider than a staging buffer, go straight from memory
+    if (request.uploadedRows == 0 && rowBytes * height <= ASYNC_TEXTURE_DIRECT_UPLOAD_BYTES) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, GL_UNSIGNED_BYTE, levelPixels);
+        advance(height);
+        return rowBytes * height;
+    }
+    if (rowBytes > stagingBufferSize) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, request.uploadedRows, width, 1, format, GL_UNSIGNED_BYTE, source);
+        advance(1);
+        return rowBytes;
+    }
+    
+    StagingBuffer &buffer = staging[nextStagingBuffer];
+    if (buffer.fence) {
+        if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return 0;
+        glDeleteSync(buffer.fence);
+        buffer.fence = nullptr;
+    }
+    
+    // The fence guarantees the GPU is done with the buffer, so the map need not wait
+    rows = std::min(rows, stagingBufferSize / rowBytes);
+    size_t bytes = rows * rowBytes;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return 0;
+    }
+    std::memcpy(mapped, source, bytes);
+    if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+        // The buffer's contents were lost; send the same rows again next frame
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return 0;
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, request.uploadedRows, width, static_cast<GLsizei>(rows),
+                    format, GL_UNSIGNED_BYTE, nullptr);
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    
+    nextStagingBuffer = (nextStagingBuffer + 1) % staging.size();
+    advance(rows);
+    return bytes;
+}
+
+void AsyncTextureLoader::beginUpload(Request &request) {
+    int levels = request.GetLevelCount();
+    glBindTexture(GL_TEXTURE_2D, request.texture);
+    TextureLoader::AllocateStorage(request.width, request.height, levels, request.components,
+                                   request.filter == MipFilter::SRGB);
+    
+    // Only the 1x1 last level holds anything until the upload reaches it, and it holds the
+    // placeholder, so sampling is restricted to it meanwhile
+    glTexSubImage2D(GL_TEXTURE_2D, levels - 1, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, request.placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    request.allocated = true;
+}
+
+void AsyncTextureLoader::completeUpload(Request &request) {
+    glBindTexture(GL_TEXTURE_2D, request.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, request.GetLevelCount() - 1);
+}
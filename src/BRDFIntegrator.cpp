@@ -0,0 +1,96 @@
+#include "../include/BRDFIntegrator.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+const float PI = 3.14159265359f;
+
+// Van der Corpus sequence in base 2
+float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+// Half vector around +Z; the tangent frame of the shader is the identity for N = +Z
+glm::vec3 ImportanceSampleGGX(float u, float v, float roughness) {
+    float a = roughness * roughness;
+    float phi = 2.0f * PI * u;
+    float cosTheta = std::sqrt((1.0f - v) / (1.0f + (a * a - 1.0f) * v));
+    float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+    return glm::normalize(glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta));
+}
+
+float GeometrySchlickGGX(float NdotX, float roughness) {
+    float k = (roughness * roughness) / 2.0f;
+    return NdotX / (NdotX * (1.0f - k) + k);
+}
+
+}
+
+glm::vec2 IntegrateBRDF(float NdotV, float roughness, unsigned int sampleCount) {
+    glm::vec3 V(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+    
+    float A = 0.0f;
+    float B = 0.0f;
+    for (unsigned int i = 0; i < sampleCount; ++i) {
+        glm::vec3 H = ImportanceSampleGGX(static_cast<float>(i) / sampleCount, RadicalInverse(i), roughness);
+        glm::vec3 L = glm::normalize(2.0f * glm::dot(V, H) * H - V);
+        
+        float NdotL = std::max(L.z, 0.0f);
+        float NdotH = std::max(H.z, 0.0f);
+        float VdotH = std::max(glm::dot(V, H), 0.0f);
+        if (NdotL > 0.0f) {
+            float G = GeometrySchlickGGX(std::max(NdotV, 0.0f), roughness) * GeometrySchlickGGX(NdotL, roughness);
+            float visibility = (G * VdotH) / (NdotH * NdotV);
+            float Fc = std::pow(1.0f - VdotH, 5.0f);
+            A += (1.0f - Fc) * visibility;
+            B += Fc * visibility;
+        }
+    }
+    return glm::vec2(A, B) / static_cast<float>(sampleCount);
+}
+
+std::vector<float> GenerateBRDFLUT(unsigned int size, ThreadPool *pool) {
+    std::vector<float> lut(static_cast<size_t>(size) * size * 2);
+    auto integrateRow = [&](size_t y) {
+        float roughness = (y + 0.5f) / size;
+        float* texel = &lut[y * size * 2];
+        for (unsigned int x = 0; x < size; ++x, texel += 2) {
+            glm::vec2 scaleBias = IntegrateBRDF((x + 0.5f) / size, roughness);
+            texel[0] = scaleBias.x;
+            texel[1] = scaleBias.y;
+        }
+    };
+    if (pool)
+        pool->ParallelFor(size, integrateRow);
+    else
+        for (size_t y = 0; y < size; ++y)
+            integrateRow(y);
+    return lut;
+}
+
+glm::vec2 SampleBRDFLUT(const float *lut, unsigned int size, float NdotV, float roughness) {
+    // Texel centers sit at (i + 0.5) / size
+    float x = glm::clamp(NdotV * size - 0.5f, 0.0f, size - 1.0f);
+    float y = glm::clamp(roughness * size - 0.5f, 0.0f, size - 1.0f);
+    unsigned int x0 = static_cast<unsigned int>(x);
+    unsigned int y0 = static_cast<unsigned int>(y);
+    unsigned int x1 = std::min(x0 + 1, size - 1);
+    unsigned int y1 = std::min(y0 + 1, size - 1);
+    float fx = x - x0;
+    float fy = y - y0;
+    
+    auto texel = [&](unsigned int tx, unsigned int ty) {
+        const float* rg = &lut[(static_cast<size_t>(ty) * size + tx) * 2];
+        return glm::vec2(rg[0], rg[1]);
+    };
+    glm::vec2 top = glm::mix(texel(x0, y0), texel(x1, y0), fx);
+    glm::vec2 bottom = glm::mix(texel(x0, y1), texel(x1, y1), fx);
+    return glm::mix(top, bottom, fy);
+}
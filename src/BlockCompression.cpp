@@ -0,0 +1,326 @@
+#include "../include/BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// Texels of one block, row by row
+struct BlockTexels {
+    unsigned char rgba[16][4];
+};
+
+void GatherBlock(const unsigned char* rgba, unsigned int width, unsigned int height,
+                 unsigned int blockX, unsigned int blockY, BlockTexels &block) {
+    for (unsigned int y = 0; y < 4; ++y) {
+        unsigned int sourceY = std::min(blockY * 4 + y, height - 1);
+        for (unsigned int x = 0; x < 4; ++x) {
+            unsigned int sourceX = std::min(blockX * 4 + x, width - 1);
+            std::memcpy(block.rgba[y * 4 + x], rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+        }
+    }
+}
+
+uint16_t PackRGB565(const float rgb[3]) {
+    int r = static_cast<int>(std::lround(std::min(std::max(rgb[0], 0.0f), 255.0f) * 31.0f / 255.0f));
+    int g = static_cast<int>(std::lround(std::min(std::max(rgb[1], 0.0f), 255.0f) * 63.0f / 255.0f));
+    int b = static_cast<int>(std::lround(std::min(std::max(rgb[2], 0.0f), 255.0f) * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void UnpackRGB565(uint16_t color, int rgb[3]) {
+    int r = (color >> 11) & 31;
+    int g = (color >> 5) & 63;
+    int b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors a BC1 block's indices select from
+void GetBC1Palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+    UnpackRGB565(color0, palette[0]);
+    UnpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+// Pick the nearest palette entry for every texel; returns the summed squared error
+int SelectBC1Indices(const BlockTexels &block, uint16_t color0, uint16_t color1, uint32_t &indices) {
+    int palette[4][3];
+    GetBC1Palette(color0, color1, palette);
+    indices = 0;
+    int totalError = 0;
+    for (int i = 0; i < 16; ++i) {
+        int bestError = 0x7FFFFFFF;
+        uint32_t bestIndex = 0;
+        for (uint32_t index = 0; index < 4; ++index) {
+            int error = 0;
+            for (int c = 0; c < 3; ++c) {
+                int difference = block.rgba[i][c] - palette[index][c];
+                error += difference * difference;
+            }
+            if (error < bestError) {
+                bestError = error;
+                bestIndex = index;
+            }
+        }
+        indices |= bestIndex << (2 * i);
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// Endpoints along the block's principal axis, then one least-squares refit to the chosen
+// indices; the better of the two encodings is kept
+void EncodeBC1Block(const BlockTexels &block, unsigned char* out) {
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += block.rgba[i][c] / 16.0f;
+    
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i) {
+        float d[3] = {block.rgba[i][0] - mean[0], block.rgba[i][1] - mean[1], block.rgba[i][2] - mean[2]};
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+    
+    // Power iteration for the dominant eigenvector
+    float axis[3] = {0.577f, 0.577f, 0.577f};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c)
+            axis[c] = next[c] / length;
+    }
+    
+    float minProjection = 0.0f, maxProjection = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float projection = 0.0f;
+        for (int c = 0; c < 3; ++c)
+            projection += (block.rgba[i][c] - mean[c]) * axis[c];
+        minProjection = std::min(minProjection, projection);
+        maxProjection = std::max(maxProjection, projection);
+    }
+    
+    // Inset the endpoints so the interpolated colors straddle the extremes
+    float inset = (maxProjection - minProjection) / 16.0f;
+    float endpoint0[3], endpoint1[3];
+    for (int c = 0; c < 3; ++c) {
+        endpoint0[c] = mean[c] + axis[c] * (maxProjection - inset);
+        endpoint1[c] = mean[c] + axis[c] * (minProjection + inset);
+    }
+    
+    uint16_t bestColors[2] = {0, 0};
+    uint32_t bestIndices = 0;
+    int bestError = 0x7FFFFFFF;
+    for (int pass = 0; pass < 2; ++pass) {
+        uint16_t color0 = PackRGB565(endpoint0);
+        uint16_t color1 = PackRGB565(endpoint1);
+        // Four-color mode needs color0 > color1; equal colors fall back to index 0 everywhere
+        if (color0 < color1)
+            std::swap(color0, color1);
+        
+        uint32_t indices;
+        int error = SelectBC1Indices(block, color0, color1, indices);
+        if (error < bestError) {
+            bestError = error;
+            bestColors[0] = color0;
+            bestColors[1] = color1;
+            bestIndices = indices;
+        }
+        if (color0 == color1 || pass == 1)
+            break;
+        
+        // Weight of color0 for each index in four-color mode
+        const float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; ++i) {
+            float a = WEIGHTS[(indices >> (2 * i)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; ++c) {
+                ax[c] += a * block.rgba[i][c];
+                bx[c] += b * block.rgba[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c) {
+            endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+    }
+    
+    out[0] = static_cast<unsigned char>(bestColors[0] & 0xFF);
+    out[1] = static_cast<unsigned char>(bestColors[0] >> 8);
+    out[2] = static_cast<unsigned char>(bestColors[1] & 0xFF);
+    out[3] = static_cast<unsigned char>(bestColors[1] >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = static_cast<unsigned char>(bestIndices >> (8 * i));
+}
+
+// The eight values a BC4 block's indices select from
+void GetBC4Palette(int value0, int value1, int palette[8]) {
+    palette[0] = value0;
+    palette[1] = value1;
+    if (value0 > value1) {
+        for (int i = 2; i < 8; ++i)
+            palette[i] = ((8 - i) * value0 + (i - 1) * value1 + 3) / 7;
+    } else {
+        for (int i = 2; i < 6; ++i)
+            palette[i] = ((6 - i) * value0 + (i - 1) * value1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// One channel of a block between its minimum and maximum in eight-value mode
+void EncodeBC4Block(const BlockTexels &block, int channel, unsigned char* out) {
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; ++i) {
+        minValue = std::min(minValue, static_cast<int>(block.rgba[i][channel]));
+        maxValue = std::max(maxValue, static_cast<int>(block.rgba[i][channel]));
+    }
+    
+    int palette[8];
+    GetBC4Palette(maxValue, minValue, palette);
+    uint64_t indices = 0;
+    if (maxValue > minValue) {
+        for (int i = 0; i < 16; ++i) {
+            int value = block.rgba[i][channel];
+            uint64_t bestIndex = 0;
+            int bestError = 256;
+            for (int index = 0; index < 8; ++index) {
+                int error = std::abs(value - palette[index]);
+                if (error < bestError) {
+                    bestError = error;
+                    bestIndex = static_cast<uint64_t>(index);
+                }
+            }
+            indices |= bestIndex << (3 * i);
+        }
+    }
+    
+    out[0] = static_cast<unsigned char>(maxValue);
+    out[1] = static_cast<unsigned char>(minValue);
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+void DecodeBC1Block(const unsigned char* in, unsigned char rgba[16][4]) {
+    uint16_t color0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+    uint16_t color1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+    int palette[4][3];
+    GetBC1Palette(color0, color1, palette);
+    for (int i = 0; i < 16; ++i) {
+        int index = (in[4 + i / 4] >> (2 * (i % 4))) & 3;
+        for (int c = 0; c < 3; ++c)
+            rgba[i][c] = static_cast<unsigned char>(palette[index][c]);
+        rgba[i][3] = 255;
+    }
+}
+
+void DecodeBC4Block(const unsigned char* in, unsigned char rgba[16][4], int channel) {
+    int palette[8];
+    GetBC4Palette(in[0], in[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        rgba[i][channel] = static_cast<unsigned char>(palette[(indices >> (3 * i)) & 7]);
+}
+
+}
+
+size_t GetBlockBytes(BlockFormat format) {
+    return format == BlockFormat::BC5 ? 16 : 8;
+}
+
+size_t GetCompressedSize(BlockFormat format, unsigned int width, unsigned int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+}
+
+std::vector<unsigned char> CompressImage(const unsigned char* rgba, unsigned int width, unsigned int height,
+                                         BlockFormat format, ThreadPool* pool) {
+    unsigned int blocksWide = (width + 3) / 4;
+    unsigned int blocksHigh = (height + 3) / 4;
+    size_t blockBytes = GetBlockBytes(format);
+    std::vector<unsigned char> blocks(GetCompressedSize(format, width, height));
+    
+    auto compressRow = [&](size_t blockY) {
+        BlockTexels block;
+        for (unsigned int blockX = 0; blockX < blocksWide; ++blockX) {
+            GatherBlock(rgba, width, height, blockX, static_cast<unsigned int>(blockY), block);
+            unsigned char* out = blocks.data() + (blockY * blocksWide + blockX) * blockBytes;
+            if (format == BlockFormat::BC1) {
+                EncodeBC1Block(block, out);
+            } else {
+                EncodeBC4Block(block, 0, out);
+                if (format == BlockFormat::BC5)
+                    EncodeBC4Block(block, 1, out + 8);
+            }
+        }
+    };
+    
+    if (pool) {
+        pool->ParallelFor(blocksHigh, compressRow);
+    } else {
+        for (size_t blockY = 0; blockY < blocksHigh; ++blockY)
+            compressRow(blockY);
+    }
+    return blocks;
+}
+
+std::vector<unsigned char> DecompressImage(const unsigned char* blocks, unsigned int width, unsigned int height,
+                                           BlockFormat format) {
+    unsigned int blocksWide = (width + 3) / 4;
+    unsigned int blocksHigh = (height + 3) / 4;
+    size_t blockBytes = GetBlockBytes(format);
+    std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+    
+    for (unsigned int blockY = 0; blockY < blocksHigh; ++blockY) {
+        for (unsigned int blockX = 0; blockX < blocksWide; ++blockX) {
+            const unsigned char* in = blocks + (static_cast<size_t>(blockY) * blocksWide + blockX) * blockBytes;
+            unsigned char texels[16][4] = {};
+            for (int i = 0; i < 16; ++i)
+                texels[i][3] = 255;
+            if (format == BlockFormat::BC1) {
+                DecodeBC1Block(in, texels);
+            } else {
+                DecodeBC4Block(in, texels, 0);
+                if (format == BlockFormat::BC5)
+                    DecodeBC4Block(in + 8, texels, 1);
+            }
+            
+            // Partial edge blocks only write the texels inside the image
+            for (unsigned int y = 0; y < 4 && blockY * 4 + y < height; ++y)
+                for (unsigned int x = 0; x < 4 && blockX * 4 + x < width; ++x)
+                    std::memcpy(rgba.data() + ((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4 + x) * 4,
+                                texels[y * 4 + x], 4);
+        }
+    }
+    return rgba;
+}
@@ -0,0 +1,37 @@
+#include "../include/ChannelPacking.h"
+#include <algorithm>
+
+std::vector<unsigned char> PackChannels(const ChannelSource* sources, int count, int &width, int &height) {
+    width = 1;
+    height = 1;
+    for (int i = 0; i < count; ++i) {
+        if (sources[i].pixels) {
+            width = std::max(width, sources[i].width);
+            height = std::max(height, sources[i].height);
+        }
+    }
+    
+    std::vector<unsigned char> packed(static_cast<size_t>(width) * height * count);
+    for (int i = 0; i < count; ++i) {
+        const ChannelSource &source = sources[i];
+        if (!source.pixels) {
+            for (size_t texel = 0; texel < packed.size(); texel += count)
+                packed[texel + i] = source.constant;
+            continue;
+        }
+        
+        // Same-size sources, the common case, copy straight across
+        int channel = std::min(source.channel, source.components - 1);
+        bool sameSize = source.width == width && source.height == height;
+        for (int y = 0; y < height; ++y) {
+            int sourceY = sameSize ? y : static_cast<int>(static_cast<long long>(y) * source.height / height);
+            const unsigned char* row = source.pixels + static_cast<size_t>(sourceY) * source.width * source.components;
+            unsigned char* out = packed.data() + static_cast<size_t>(y) * width * count + i;
+            for (int x = 0; x < width; ++x) {
+                int sourceX = sameSize ? x : static_cast<int>(static_cast<long long>(x) * source.width / width);
+                out[static_cast<size_t>(x) * count] = row[static_cast<size_t>(sourceX) * source.components + channel];
+            }
+        }
+    }
+    return packed;
+}
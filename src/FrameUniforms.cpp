@@ -0,0 +1,75 @@
+#include "../include/FrameUniforms.h"
+#include <iostream>
+#include <cstddef>
+#include <algorithm>
+
+FrameUniforms::FrameUniforms() : UBO(0) {
+    data.projection = glm::mat4(1.0f);
+    data.view = glm::mat4(1.0f);
+    data.camPos = glm::vec4(0.0f);
+    data.lightCount = 0;
+    data.exposure = 1.0f;
+    data.time = 0.0f;
+    data.padding = 0.0f;
+    for (glm::vec4 &coefficient : data.irradianceSH)
+        coefficient = glm::vec4(0.0f);
+    
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, UBO);
+}
+
+FrameUniforms::~FrameUniforms() {
+    glDeleteBuffers(1, &UBO);
+}
+
+void FrameUniforms::Attach(Shader &shader) const {
+    shader.bindUniformBlock("FrameUniforms", BINDING_POINT);
+}
+
+void FrameUniforms::SetCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position) {
+    data.projection = projection;
+    data.view = view;
+    data.camPos = glm::vec4(position, 1.0f);
+}
+
+void FrameUniforms::SetLights(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &colors) {
+    size_t count = std::min(positions.size(), colors.size());
+    if (count > MAX_FRAME_LIGHTS) {
+        std::cout << "FrameUniforms: " << count << " lights requested, only " << MAX_FRAME_LIGHTS << " are supported." << std::endl;
+        count = MAX_FRAME_LIGHTS;
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        data.lights[i].position = glm::vec4(positions[i], 1.0f);
+        data.lights[i].color = glm::vec4(colors[i], 1.0f);
+    }
+    data.lightCount = static_cast<int>(count);
+}
+
+void FrameUniforms::SetExposure(float value) {
+    data.exposure = value;
+}
+
+void FrameUniforms::SetTime(float value) {
+    data.time = value;
+}
+
+void FrameUniforms::SetIrradianceSH(const IrradianceSH &sh) {
+    for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+        data.irradianceSH[i] = glm::vec4(sh.coefficients[i], 0.0f);
+}
+
+void FrameUniforms::Upload() {
+    // Only the lights in use are transferred
+    size_t size = offsetof(FrameUniformData, lights) + data.lightCount * sizeof(FrameLight);
+    
+    // Orphan last frame's storage so the write never waits on in-flight draws
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,834 @@
+#include "../include/GLTFLoader.h"
+#include "../include/Json.h"
+#include "../include/MappedFile.h"
+#include "../include/Transforms.h"
+#include "../include/ChannelPacking.h"
+#include <stb/stb_image.h>
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <tuple>
+#include <algorithm>
+
+namespace {
+
+// glTF constants
+const uint32_t GLB_MAGIC = 0x46546C67;       // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;  // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;   // "BIN\0"
+const int COMPONENT_BYTE = 5120;
+const int COMPONENT_UNSIGNED_BYTE = 5121;
+const int COMPONENT_SHORT = 5122;
+const int COMPONENT_UNSIGNED_SHORT = 5123;
+const int COMPONENT_UNSIGNED_INT = 5125;
+const int COMPONENT_FLOAT = 5126;
+const int MODE_TRIANGLES = 4;
+
+// Node hierarchies deeper than this are treated as malformed (cycles)
+const int MAX_NODE_DEPTH = 128;
+
+// Raw bytes of a buffer; points into a mapped file or into decoded data URI storage
+struct BufferData {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Everything the decode jobs read; immutable once parsing is done
+struct Document {
+    JsonValue json;
+    std::string directory;
+    MappedFile file;
+    std::vector<std::unique_ptr<MappedFile>> externalFiles;
+    std::vector<std::vector<unsigned char>> ownedBuffers;
+    std::vector<BufferData> buffers;
+};
+
+// A mesh referenced by a node, with the node's world transform
+struct MeshInstance {
+    int mesh;
+    glm::mat4 transform;
+};
+
+// One decoded variant of a source image: all channels, or a single channel
+// extracted for the metallic, roughness or occlusion unit (packed into an ORM
+// image once decoding is done)
+struct ImageRequest {
+    int channel;  // -1 for all channels
+    MipFilter filter;
+    size_t output;
+};
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+uint32_t ReadU32(const unsigned char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+std::string DecodeUri(const std::string &uri) {
+    std::string result;
+    for (size_t i = 0; i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(uri[i + 1]) && std::isxdigit(uri[i + 2])) {
+            result += static_cast<char>(std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            result += uri[i];
+        }
+    }
+    return result;
+}
+
+bool DecodeBase64(const char* text, size_t length, std::vector<unsigned char> &out) {
+    auto value = [](char c) -> int {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    };
+    
+    out.reserve(length / 4 * 3);
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (size_t i = 0; i < length && text[i] != '='; ++i) {
+        int v = value(text[i]);
+        if (v < 0)
+            return false;
+        accumulator = (accumulator << 6) | static_cast<uint32_t>(v);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<unsigned char>((accumulator >> bits) & 0xFF));
+        }
+    }
+    return true;
+}
+
+// Resolve a buffer or image URI: embedded base64 data or a file next to the asset
+bool ResolveUri(Document &doc, const std::string &uri, BufferData &result) {
+    if (uri.compare(0, 5, "data:") == 0) {
+        size_t comma = uri.find(',');
+        if (comma == std::string::npos || uri.find(";base64") > comma)
+            return false;
+        doc.ownedBuffers.emplace_back();
+        if (!DecodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, doc.ownedBuffers.back()))
+            return false;
+        result.data = doc.ownedBuffers.back().data();
+        result.size = doc.ownedBuffers.back().size();
+        return true;
+    }
+    
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->Open(doc.directory + DecodeUri(uri)))
+        return false;
+    result.data = file->GetData();
+    result.size = file->GetSize();
+    doc.externalFiles.push_back(std::move(file));
+    return true;
+}
+
+bool ParseContainer(Document &doc, const std::string &path, std::string &error) {
+    if (!doc.file.Open(path)) {
+        error = "cannot open file";
+        return false;
+    }
+    
+    size_t slash = path.find_last_of("/\\");
+    doc.directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    
+    const unsigned char* data = doc.file.GetData();
+    size_t size = doc.file.GetSize();
+    const char* jsonText = reinterpret_cast<const char*>(data);
+    size_t jsonLength = size;
+    BufferData binaryChunk;
+    
+    // Binary container: 12-byte header, JSON chunk, optional BIN chunk
+    if (size >= 12 && ReadU32(data) == GLB_MAGIC) {
+        if (ReadU32(data + 4) != 2) {
+            error = "unsupported glb version";
+            return false;
+        }
+        size_t length = std::min<size_t>(ReadU32(data + 8), size);
+        size_t offset = 12;
+        jsonText = nullptr;
+        while (offset + 8 <= length) {
+            uint32_t chunkLength = ReadU32(data + offset);
+            uint32_t chunkType = ReadU32(data + offset + 4);
+            offset += 8;
+            if (chunkLength > length - offset) {
+                error = "truncated glb chunk";
+                return false;
+            }
+            if (chunkType == GLB_CHUNK_JSON && jsonText == nullptr) {
+                jsonText = reinterpret_cast<const char*>(data + offset);
+                jsonLength = chunkLength;
+            } else if (chunkType == GLB_CHUNK_BIN && binaryChunk.data == nullptr) {
+                // Accessors read straight out of the mapped file
+                binaryChunk.data = data + offset;
+                binaryChunk.size = chunkLength;
+            }
+            offset += (chunkLength + 3) & ~3u;
+        }
+        if (jsonText == nullptr) {
+            error = "glb has no JSON chunk";
+            return false;
+        }
+    }
+    
+    std::string jsonError;
+    if (!JsonValue::Parse(jsonText, jsonLength, doc.json, jsonError)) {
+        error = "invalid JSON: " + jsonError;
+        return false;
+    }
+    if (doc.json["asset"]["version"].AsString().compare(0, 1, "2") != 0) {
+        error = "only glTF 2.0 is supported";
+        return false;
+    }
+    
+    const JsonValue &buffers = doc.json["buffers"];
+    doc.buffers.resize(buffers.Size());
+    for (size_t i = 0; i < buffers.Size(); ++i) {
+        const JsonValue &buffer = buffers[i];
+        if (!buffer.Has("uri")) {
+            doc.buffers[i] = binaryChunk;
+        } else if (!ResolveUri(doc, buffer["uri"].AsString(), doc.buffers[i])) {
+            error = "cannot load buffer " + buffer["uri"].AsString();
+            return false;
+        }
+        if (doc.buffers[i].size < static_cast<size_t>(buffer["byteLength"].AsNumber())) {
+            error = "buffer " + std::to_string(i) + " is shorter than its byteLength";
+            return false;
+        }
+    }
+    return true;
+}
+
+glm::mat4 NodeTransform(const JsonValue &node) {
+    glm::mat4 transform(1.0f);
+    const JsonValue &matrix = node["matrix"];
+    if (matrix.Size() == 16) {
+        for (int column = 0; column < 4; ++column)
+            for (int row = 0; row < 4; ++row)
+                transform[column][row] = static_cast<float>(matrix[column * 4 + row].AsNumber());
+        return transform;
+    }
+    
+    const JsonValue &t = node["translation"];
+    const JsonValue &r = node["rotation"];
+    const JsonValue &s = node["scale"];
+    glm::vec3 translation(t[0].AsNumber(0.0), t[1].AsNumber(0.0), t[2].AsNumber(0.0));
+    float qx = static_cast<float>(r[0].AsNumber(0.0));
+    float qy = static_cast<float>(r[1].AsNumber(0.0));
+    float qz = static_cast<float>(r[2].AsNumber(0.0));
+    float qw = static_cast<float>(r[3].AsNumber(1.0));
+    glm::vec3 scale(s[0].AsNumber(1.0), s[1].AsNumber(1.0), s[2].AsNumber(1.0));
+    
+    // T * R * S with R from the unit quaternion
+    glm::mat3 rotation;
+    rotation[0] = glm::vec3(1.0f - 2.0f * (qy * qy + qz * qz), 2.0f * (qx * qy + qz * qw), 2.0f * (qx * qz - qy * qw));
+    rotation[1] = glm::vec3(2.0f * (qx * qy - qz * qw), 1.0f - 2.0f * (qx * qx + qz * qz), 2.0f * (qy * qz + qx * qw));
+    rotation[2] = glm::vec3(2.0f * (qx * qz + qy * qw), 2.0f * (qy * qz - qx * qw), 1.0f - 2.0f * (qx * qx + qy * qy));
+    for (int column = 0; column < 3; ++column) {
+        glm::vec3 axis = rotation[column] * scale[column];
+        transform[column] = glm::vec4(axis.x, axis.y, axis.z, 0.0f);
+    }
+    transform[3] = glm::vec4(translation.x, translation.y, translation.z, 1.0f);
+    return transform;
+}
+
+void CollectInstances(const JsonValue &nodes, int nodeIndex, const glm::mat4 &parent, int depth,
+                      std::vector<MeshInstance> &instances) {
+    const JsonValue &node = nodes[nodeIndex];
+    if (!node.IsObject() || depth > MAX_NODE_DEPTH)
+        return;
+    
+    glm::mat4 transform = parent * NodeTransform(node);
+    if (node.Has("mesh"))
+        instances.push_back({node["mesh"].AsInt(), transform});
+    
+    const JsonValue &children = node["children"];
+    for (size_t i = 0; i < children.Size(); ++i)
+        CollectInstances(nodes, children[i].AsInt(), transform, depth + 1, instances);
+}
+
+std::vector<MeshInstance> CollectSceneInstances(const JsonValue &json) {
+    std::vector<MeshInstance> instances;
+    const JsonValue &nodes = json["nodes"];
+    const JsonValue &scene = json["scenes"][json["scene"].AsInt(0)];
+    
+    if (scene.IsObject()) {
+        const JsonValue &roots = scene["nodes"];
+        for (size_t i = 0; i < roots.Size(); ++i)
+            CollectInstances(nodes, roots[i].AsInt(), glm::mat4(1.0f), 0, instances);
+        return instances;
+    }
+    
+    // No scene: every node that is nobody's child is a root
+    std::vector<bool> isChild(nodes.Size(), false);
+    for (size_t i = 0; i < nodes.Size(); ++i) {
+        const JsonValue &children = nodes[i]["children"];
+        for (size_t c = 0; c < children.Size(); ++c) {
+            size_t child = static_cast<size_t>(children[c].AsInt());
+            if (child < isChild.size())
+                isChild[child] = true;
+        }
+    }
+    for (size_t i = 0; i < nodes.Size(); ++i) {
+        if (!isChild[i])
+            CollectInstances(nodes, static_cast<int>(i), glm::mat4(1.0f), 0, instances);
+    }
+    return instances;
+}
+
+size_t ComponentSize(int componentType) {
+    switch (componentType) {
+        case COMPONENT_BYTE:
+        case COMPONENT_UNSIGNED_BYTE: return 1;
+        case COMPONENT_SHORT:
+        case COMPONENT_UNSIGNED_SHORT: return 2;
+        case COMPONENT_UNSIGNED_INT:
+        case COMPONENT_FLOAT: return 4;
+        default: return 0;
+    }
+}
+
+int ComponentCount(const std::string &type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+// Byte view of an accessor's elements inside its buffer
+struct AccessorView {
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+};
+
+bool GetAccessorView(const Document &doc, int accessorIndex, AccessorView &view, std::string &error) {
+    const JsonValue &accessor = doc.json["accessors"][accessorIndex];
+    if (!accessor.IsObject()) {
+        error = "missing accessor " + std::to_string(accessorIndex);
+        return false;
+    }
+    if (accessor.Has("sparse") || !accessor.Has("bufferView")) {
+        error = "sparse and buffer-less accessors are not supported";
+        return false;
+    }
+    
+    const JsonValue &bufferView = doc.json["bufferViews"][accessor["bufferView"].AsInt()];
+    size_t bufferIndex = static_cast<size_t>(bufferView["buffer"].AsInt(-1));
+    if (bufferIndex >= doc.buffers.size()) {
+        error = "accessor references a missing buffer";
+        return false;
+    }
+    const BufferData &buffer = doc.buffers[bufferIndex];
+    
+    view.componentType = accessor["componentType"].AsInt();
+    view.components = ComponentCount(accessor["type"].AsString());
+    view.count = static_cast<size_t>(accessor["count"].AsNumber());
+    view.normalized = accessor["normalized"].AsBool();
+    size_t elementSize = ComponentSize(view.componentType) * view.components;
+    view.stride = static_cast<size_t>(bufferView["byteStride"].AsNumber(0.0));
+    if (view.stride == 0)
+        view.stride = elementSize;
+    if (elementSize == 0) {
+        error = "unsupported accessor format";
+        return false;
+    }
+    
+    size_t viewOffset = static_cast<size_t>(bufferView["byteOffset"].AsNumber(0.0));
+    size_t viewLength = static_cast<size_t>(bufferView["byteLength"].AsNumber());
+    size_t offset = static_cast<size_t>(accessor["byteOffset"].AsNumber(0.0));
+    if (viewOffset + viewLength > buffer.size ||
+        (view.count > 0 && offset + (view.count - 1) * view.stride + elementSize > viewLength)) {
+        error = "accessor exceeds its buffer";
+        return false;
+    }
+    
+    view.data = buffer.data + viewOffset + offset;
+    return true;
+}
+
+float ReadComponent(const unsigned char* data, int componentType, bool normalized) {
+    switch (componentType) {
+        case COMPONENT_FLOAT: {
+            float value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+        case COMPONENT_BYTE: {
+            float value = static_cast<float>(static_cast<int8_t>(*data));
+            return normalized ? std::max(value / 127.0f, -1.0f) : value;
+        }
+        case COMPONENT_UNSIGNED_BYTE:
+            return normalized ? *data / 255.0f : static_cast<float>(*data);
+        case COMPONENT_SHORT: {
+            int16_t raw;
+            std::memcpy(&raw, data, sizeof(raw));
+            return normalized ? std::max(raw / 32767.0f, -1.0f) : static_cast<float>(raw);
+        }
+        case COMPONENT_UNSIGNED_SHORT: {
+            uint16_t raw;
+            std::memcpy(&raw, data, sizeof(raw));
+            return normalized ? raw / 65535.0f : static_cast<float>(raw);
+        }
+        case COMPONENT_UNSIGNED_INT: {
+            uint32_t raw;
+            std::memcpy(&raw, data, sizeof(raw));
+            return static_cast<float>(raw);
+        }
+    }
+    return 0.0f;
+}
+
+// Read an accessor as floats, components values per element
+bool ReadFloats(const Document &doc, int accessorIndex, int components, std::vector<float> &out, std::string &error) {
+    AccessorView view;
+    if (!GetAccessorView(doc, accessorIndex, view, error))
+        return false;
+    if (view.components != components) {
+        error = "unexpected accessor type";
+        return false;
+    }
+    
+    size_t componentSize = ComponentSize(view.componentType);
+    out.resize(view.count * components);
+    for (size_t i = 0; i < view.count; ++i) {
+        const unsigned char* element = view.data + i * view.stride;
+        for (int c = 0; c < components; ++c)
+            out[i * components + c] = ReadComponent(element + c * componentSize, view.componentType, view.normalized);
+    }
+    return true;
+}
+
+bool ReadIndices(const Document &doc, int accessorIndex, size_t vertexCount, std::vector<unsigned int> &out, std::string &error) {
+    AccessorView view;
+    if (!GetAccessorView(doc, accessorIndex, view, error))
+        return false;
+    if (view.components != 1 || view.componentType == COMPONENT_FLOAT) {
+        error = "unexpected index accessor type";
+        return false;
+    }
+    
+    out.resize(view.count);
+    for (size_t i = 0; i < view.count; ++i) {
+        const unsigned char* element = view.data + i * view.stride;
+        uint32_t index = 0;
+        if (view.componentType == COMPONENT_UNSIGNED_BYTE) {
+            index = *element;
+        } else if (view.componentType == COMPONENT_UNSIGNED_SHORT) {
+            uint16_t raw;
+            std::memcpy(&raw, element, sizeof(raw));
+            index = raw;
+        } else {
+            std::memcpy(&index, element, sizeof(index));
+        }
+        if (index >= vertexCount) {
+            error = "index out of range";
+            return false;
+        }
+        out[i] = index;
+    }
+    return true;
+}
+
+// Area-weighted vertex normals for primitives that do not provide them
+void GenerateNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) {
+    for (Vertex &vertex : vertices)
+        vertex.Normal = glm::vec3(0.0f);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Vertex &v0 = vertices[indices[i]];
+        Vertex &v1 = vertices[indices[i + 1]];
+        Vertex &v2 = vertices[indices[i + 2]];
+        glm::vec3 faceNormal = glm::cross(v1.Position - v0.Position, v2.Position - v0.Position);
+        v0.Normal = v0.Normal + faceNormal;
+        v1.Normal = v1.Normal + faceNormal;
+        v2.Normal = v2.Normal + faceNormal;
+    }
+    for (Vertex &vertex : vertices) {
+        float length = glm::length(vertex.Normal);
+        vertex.Normal = length > 0.0f ? vertex.Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+// Per-vertex tangent frames from UV gradients; tangent.w style handedness goes into the bitangent
+void GenerateTangents(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices) {
+    std::vector<glm::vec3> bitangents(vertices.size(), glm::vec3(0.0f));
+    for (Vertex &vertex : vertices)
+        vertex.Tangent = glm::vec3(0.0f);
+    
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Vertex &v0 = vertices[indices[i]];
+        Vertex &v1 = vertices[indices[i + 1]];
+        Vertex &v2 = vertices[indices[i + 2]];
+        glm::vec3 edge1 = v1.Position - v0.Position;
+        glm::vec3 edge2 = v2.Position - v0.Position;
+        glm::vec2 deltaUV1 = v1.TexCoords - v0.TexCoords;
+        glm::vec2 deltaUV2 = v2.TexCoords - v0.TexCoords;
+        float determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+        if (std::fabs(determinant) < 1e-12f)
+            continue;
+        
+        float r = 1.0f / determinant;
+        glm::vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * r;
+        glm::vec3 bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * r;
+        for (size_t k = 0; k < 3; ++k) {
+            vertices[indices[i + k]].Tangent = vertices[indices[i + k]].Tangent + tangent;
+            bitangents[indices[i + k]] = bitangents[indices[i + k]] + bitangent;
+        }
+    }
+    
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        Vertex &vertex = vertices[i];
+        glm::vec3 tangent = vertex.Tangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Tangent);
+        if (glm::length(tangent) < 1e-6f) {
+            // Degenerate UVs: any direction perpendicular to the normal
+            glm::vec3 axis = std::fabs(vertex.Normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            tangent = glm::cross(axis, vertex.Normal);
+        }
+        vertex.Tangent = glm::normalize(tangent);
+        float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+        vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * handedness;
+    }
+}
+
+// Decode one primitive into model-space vertices and optimize it
+bool DecodePrimitive(const Document &doc, const JsonValue &primitive, const glm::mat4 &transform,
+                     GLTFPrimitive &result, std::string &error) {
+    const JsonValue &attributes = primitive["attributes"];
+    std::vector<float> positions, normals, texCoords, tangents;
+    
+    if (!attributes.Has("POSITION")) {
+        error = "primitive has no positions";
+        return false;
+    }
+    if (!ReadFloats(doc, attributes["POSITION"].AsInt(), 3, positions, error))
+        return false;
+    size_t vertexCount = positions.size() / 3;
+    
+    if (attributes.Has("NORMAL") && !ReadFloats(doc, attributes["NORMAL"].AsInt(), 3, normals, error))
+        return false;
+    if (attributes.Has("TEXCOORD_0") && !ReadFloats(doc, attributes["TEXCOORD_0"].AsInt(), 2, texCoords, error))
+        return false;
+    if (attributes.Has("TANGENT") && !ReadFloats(doc, attributes["TANGENT"].AsInt(), 4, tangents, error))
+        return false;
+    if ((!normals.empty() && normals.size() != vertexCount * 3) ||
+        (!texCoords.empty() && texCoords.size() != vertexCount * 2) ||
+        (!tangents.empty() && tangents.size() != vertexCount * 4)) {
+        error = "attribute counts differ";
+        return false;
+    }
+    
+    if (primitive.Has("indices")) {
+        if (!ReadIndices(doc, primitive["indices"].AsInt(), vertexCount, result.indices, error))
+            return false;
+    } else {
+        result.indices.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+            result.indices[i] = static_cast<unsigned int>(i);
+    }
+    result.indices.resize(result.indices.size() / 3 * 3);
+    
+    std::vector<Vertex> &vertices = result.vertices;
+    vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        Vertex &vertex = vertices[i];
+        vertex.Position = glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+        if (!normals.empty())
+            vertex.Normal = glm::normalize(glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]));
+        vertex.TexCoords = texCoords.empty() ? glm::vec2(0.0f) : glm::vec2(texCoords[i * 2], texCoords[i * 2 + 1]);
+    }
+    if (normals.empty())
+        GenerateNormals(vertices, result.indices);
+    
+    if (tangents.empty()) {
+        GenerateTangents(vertices, result.indices);
+    } else {
+        for (size_t i = 0; i < vertexCount; ++i) {
+            Vertex &vertex = vertices[i];
+            vertex.Tangent = glm::vec3(tangents[i * 4], tangents[i * 4 + 1], tangents[i * 4 + 2]);
+            vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * (tangents[i * 4 + 3] < 0.0f ? -1.0f : 1.0f);
+        }
+    }
+    
+    // Bake the node transform; Model has no per-mesh transform
+    glm::mat3 linear(transform);
+    glm::mat3 normalMatrix = ComputeNormalMatrix(transform);
+    for (Vertex &vertex : vertices) {
+        glm::vec4 position = transform * glm::vec4(vertex.Position.x, vertex.Position.y, vertex.Position.z, 1.0f);
+        vertex.Position = glm::vec3(position.x, position.y, position.z);
+        vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+        vertex.Tangent = glm::normalize(linear * vertex.Tangent);
+        vertex.Bitangent = glm::normalize(linear * vertex.Bitangent);
+    }
+    
+    result.optimizationStats = OptimizeMesh(vertices, result.indices);
+    return true;
+}
+
+// Encoded bytes of an image: a buffer view (zero-copy into the glb) or a URI
+bool GetImageBytes(Document &doc, const JsonValue &image, BufferData &bytes) {
+    if (image.Has("bufferView")) {
+        const JsonValue &view = doc.json["bufferViews"][image["bufferView"].AsInt()];
+        size_t bufferIndex = static_cast<size_t>(view["buffer"].AsInt(-1));
+        if (bufferIndex >= doc.buffers.size())
+            return false;
+        size_t offset = static_cast<size_t>(view["byteOffset"].AsNumber(0.0));
+        size_t length = static_cast<size_t>(view["byteLength"].AsNumber());
+        if (offset + length > doc.buffers[bufferIndex].size)
+            return false;
+        bytes.data = doc.buffers[bufferIndex].data + offset;
+        bytes.size = length;
+        return true;
+    }
+    return ResolveUri(doc, image["uri"].AsString(), bytes);
+}
+
+// Decode an image once and produce every variant requested from it
+bool DecodeImage(const BufferData &bytes, const std::vector<ImageRequest> &requests,
+                 std::vector<GLTFImage> &images, std::string &error) {
+    int width, height, components;
+    unsigned char* pixels = stbi_load_from_memory(bytes.data, static_cast<int>(bytes.size), &width, &height, &components, 0);
+    if (pixels == nullptr) {
+        error = stbi_failure_reason();
+        return false;
+    }
+    
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    for (const ImageRequest &request : requests) {
+        GLTFImage &image = images[request.output];
+        image.width = width;
+        image.height = height;
+        image.filter = request.filter;
+        if (request.channel < 0 || components == 1) {
+            image.components = components;
+            image.pixels.assign(pixels, pixels + pixelCount * components);
+        } else {
+            // Split packed channels out; PackMaterialORMImages regroups them per material
+            int channel = std::min(request.channel, components - 1);
+            image.components = 1;
+            image.pixels.resize(pixelCount);
+            for (size_t i = 0; i < pixelCount; ++i)
+                image.pixels[i] = pixels[i * components + channel];
+        }
+    }
+    stbi_image_free(pixels);
+    return true;
+}
+
+// Replace each material's occlusion, roughness and metallic images with one packed ORM
+// image, so it binds and samples a single texture for all three. A missing map becomes a
+// white channel, which the shader scales by the factor alone. Materials with the same maps
+// share the packed image; the channel images are released.
+void PackMaterialORMImages(GLTFScene &scene, ThreadPool &pool) {
+    const MaterialTextureUnit units[ORM_CHANNEL_COUNT] = {AO_TEXTURE_UNIT, ROUGHNESS_TEXTURE_UNIT, METALLIC_TEXTURE_UNIT};
+    struct PackJob {
+        int sources[ORM_CHANNEL_COUNT];
+        unsigned char constants[ORM_CHANNEL_COUNT];
+        size_t output;
+    };
+    std::vector<PackJob> jobs;
+    std::map<std::tuple<int, int, int, int, int, int>, size_t> packedSlots;
+    size_t imageCount = scene.images.size();
+    for (GLTFMaterial &material : scene.materials) {
+        PackJob job;
+        bool mapped = false;
+        for (int channel = 0; channel < ORM_CHANNEL_COUNT; ++channel) {
+            // Images that failed to decode fall back to the factor, as a separate map would
+            int source = material.images[units[channel]];
+            if (source >= 0 && scene.images[source].pixels.empty())
+                source = -1;
+            job.sources[channel] = source;
+            job.constants[channel] = source < 0 ? 255 : 0;
+            mapped = mapped || source >= 0;
+            material.images[units[channel]] = -1;
+        }
+        if (!mapped)
+            continue;
+        
+        auto key = std::make_tuple(job.sources[0], job.sources[1], job.sources[2],
+                                   job.constants[0], job.constants[1], job.constants[2]);
+        auto found = packedSlots.find(key);
+        if (found == packedSlots.end()) {
+            job.output = imageCount + jobs.size();
+            found = packedSlots.emplace(key, job.output).first;
+            jobs.push_back(job);
+        }
+        material.images[ORM_TEXTURE_UNIT] = static_cast<int>(found->second);
+    }
+    
+    scene.images.resize(imageCount + jobs.size());
+    pool.ParallelFor(jobs.size(), [&](size_t i) {
+        const PackJob &job = jobs[i];
+        ChannelSource sources[ORM_CHANNEL_COUNT];
+        for (int channel = 0; channel < ORM_CHANNEL_COUNT; ++channel) {
+            sources[channel].constant = job.constants[channel];
+            if (job.sources[channel] < 0)
+                continue;
+            const GLTFImage &image = scene.images[job.sources[channel]];
+            sources[channel].pixels = image.pixels.data();
+            sources[channel].width = image.width;
+            sources[channel].height = image.height;
+            sources[channel].components = image.components;
+        }
+        GLTFImage &packed = scene.images[job.output];
+        packed.pixels = PackChannels(sources, ORM_CHANNEL_COUNT, packed.width, packed.height);
+        packed.components = ORM_CHANNEL_COUNT;
+    });
+    
+    std::vector<bool> used(scene.images.size(), false);
+    for (const GLTFMaterial &material : scene.materials) {
+        for (int image : material.images) {
+            if (image >= 0)
+                used[image] = true;
+        }
+    }
+    for (size_t i = 0; i < imageCount; ++i) {
+        if (!used[i])
+            std::vector<unsigned char>().swap(scene.images[i].pixels);
+    }
+}
+
+}
+
+bool GLTFLoader::Load(const std::string &path, ThreadPool &pool, GLTFScene &scene, GLTFLoadStats &stats,
+                      bool decodePrimitives) {
+    auto parseStart = std::chrono::high_resolution_clock::now();
+    stats.threadCount = pool.GetThreadCount();
+    
+    Document doc;
+    std::string error;
+    if (!ParseContainer(doc, path, error)) {
+        std::cout << "Failed to load glTF " << path << ": " << error << std::endl;
+        return false;
+    }
+    stats.fileBytes = doc.file.GetSize();
+    const JsonValue &json = doc.json;
+    
+    // Materials, and the image variants they need: (image, channel, filter) -> GLTFScene::images slot
+    std::map<std::tuple<int, int, int>, size_t> imageSlots;
+    std::vector<std::vector<ImageRequest>> imageRequests(json["images"].Size());
+    auto requestImage = [&](const JsonValue &textureInfo, int channel, MipFilter filter) -> int {
+        if (!textureInfo.IsObject())
+            return -1;
+        int source = json["textures"][textureInfo["index"].AsInt(-1)]["source"].AsInt(-1);
+        if (source < 0 || static_cast<size_t>(source) >= imageRequests.size())
+            return -1;
+        auto key = std::make_tuple(source, channel, static_cast<int>(filter));
+        auto found = imageSlots.find(key);
+        if (found != imageSlots.end())
+            return static_cast<int>(found->second);
+        size_t slot = imageSlots.size();
+        imageSlots[key] = slot;
+        imageRequests[source].push_back({channel, filter, slot});
+        return static_cast<int>(slot);
+    };
+    
+    const JsonValue &materials = json["materials"];
+    scene.materials.resize(materials.Size());
+    for (size_t i = 0; i < materials.Size(); ++i) {
+        const JsonValue &source = materials[i];
+        const JsonValue &pbr = source["pbrMetallicRoughness"];
+        GLTFMaterial &material = scene.materials[i];
+        // Factors scale their textures in pbr.fs and stand alone where there is none
+        const JsonValue &baseColor = pbr["baseColorFactor"];
+        material.albedo = glm::vec3(baseColor[0].AsNumber(1.0), baseColor[1].AsNumber(1.0), baseColor[2].AsNumber(1.0));
+        material.metallic = static_cast<float>(pbr["metallicFactor"].AsNumber(1.0));
+        material.roughness = static_cast<float>(pbr["roughnessFactor"].AsNumber(1.0));
+        
+        // glTF packs roughness in G and metallic in B of one texture, occlusion in R
+        material.images[ALBEDO_TEXTURE_UNIT] = requestImage(pbr["baseColorTexture"], -1, MipFilter::SRGB);
+        material.images[NORMAL_TEXTURE_UNIT] = requestImage(source["normalTexture"], -1, MipFilter::Normal);
+        material.images[METALLIC_TEXTURE_UNIT] = requestImage(pbr["metallicRoughnessTexture"], 2, MipFilter::Linear);
+        material.images[ROUGHNESS_TEXTURE_UNIT] = requestImage(pbr["metallicRoughnessTexture"], 1, MipFilter::Linear);
+        material.images[AO_TEXTURE_UNIT] = requestImage(source["occlusionTexture"], 0, MipFilter::Linear);
+    }
+    scene.images.resize(imageSlots.size());
+    
+    // Resolve every primitive to decode; meshes used by several nodes are decoded per node
+    std::vector<MeshInstance> instances;
+    if (decodePrimitives)
+        instances = CollectSceneInstances(json);
+    std::vector<std::pair<const JsonValue*, const glm::mat4*>> primitiveJobs;
+    size_t skippedPrimitives = 0;
+    for (const MeshInstance &instance : instances) {
+        const JsonValue &primitives = json["meshes"][instance.mesh]["primitives"];
+        for (size_t p = 0; p < primitives.Size(); ++p) {
+            if (primitives[p]["mode"].AsInt(MODE_TRIANGLES) != MODE_TRIANGLES) {
+                skippedPrimitives++;
+                continue;
+            }
+            primitiveJobs.push_back({&primitives[p], &instance.transform});
+        }
+    }
+    if (skippedPrimitives > 0)
+        std::cout << "glTF " << path << ": skipped " << skippedPrimitives << " non-triangle primitives" << std::endl;
+    
+    // Image sources are resolved here so data URIs and external files are mapped on this thread
+    std::vector<BufferData> imageBytes(imageRequests.size());
+    for (size_t i = 0; i < imageRequests.size(); ++i) {
+        if (!imageRequests[i].empty() && !GetImageBytes(doc, json["images"][i], imageBytes[i]))
+            std::cout << "glTF " << path << ": cannot read image " << i << std::endl;
+    }
+    stats.parseMilliseconds = MillisecondsSince(parseStart);
+    
+    // Decode primitives and images in parallel
+    auto decodeStart = std::chrono::high_resolution_clock::now();
+    scene.primitives.resize(primitiveJobs.size());
+    std::vector<std::string> errors(primitiveJobs.size() + imageRequests.size());
+    for (size_t i = 0; i < primitiveJobs.size(); ++i) {
+        pool.Submit([&, i] {
+            GLTFPrimitive &primitive = scene.primitives[i];
+            primitive.material = (*primitiveJobs[i].first)["material"].AsInt(-1);
+            if (primitive.material >= static_cast<int>(scene.materials.size()))
+                primitive.material = -1;
+            if (!DecodePrimitive(doc, *primitiveJobs[i].first, *primitiveJobs[i].second, primitive, errors[i])) {
+                primitive.vertices.clear();
+                primitive.indices.clear();
+            }
+        });
+    }
+    for (size_t i = 0; i < imageRequests.size(); ++i) {
+        if (imageRequests[i].empty() || imageBytes[i].data == nullptr)
+            continue;
+        pool.Submit([&, i] {
+            DecodeImage(imageBytes[i], imageRequests[i], scene.images, errors[primitiveJobs.size() + i]);
+        });
+    }
+    pool.Wait();
+    PackMaterialORMImages(scene, pool);
+    
+    // Mip chains are built here so the upload does not wait on glGenerateMipmap
+    pool.ParallelFor(scene.images.size(), [&](size_t i) {
+        GLTFImage &image = scene.images[i];
+        if (!image.pixels.empty())
+            image.mips = GenerateMipChain(image.pixels.data(), image.width, image.height, image.components, image.filter);
+    });
+    stats.decodeMilliseconds = MillisecondsSince(decodeStart);
+    
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (errors[i].empty())
+            continue;
+        if (i < primitiveJobs.size())
+            std::cout << "glTF " << path << ": skipped primitive " << i << ": " << errors[i] << std::endl;
+        else
+            std::cout << "glTF " << path << ": image " << i - primitiveJobs.size() << ": " << errors[i] << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,274 @@
+#include "../include/HDRLoader.h"
+#include "../include/MappedFile.h"
+#include "../include/HalfFloat.h"
+#include <stb/stb_image.h>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+// Scanlines decoded per pool iteration, so short rows still amortize the dispatch
+const size_t SCANLINES_PER_TASK = 16;
+
+// Scanlines narrower or wider than this are never run-length encoded
+const int RLE_MIN_WIDTH = 8;
+const int RLE_MAX_WIDTH = 0x7FFF;
+
+// Value of a unit mantissa under each RGBE exponent byte, as stb_image decodes it, and the
+// half float of every mantissa under every exponent, rounded as FloatToHalf rounds
+struct RGBETables {
+    float scale[256];
+    uint16_t half[256 * 256];       // [exponent * 256 + mantissa]
+    
+    RGBETables() {
+        scale[0] = 0.0f;
+        for (int exponent = 1; exponent < 256; ++exponent)
+            scale[exponent] = std::ldexp(1.0f, exponent - 136);
+        for (int exponent = 0; exponent < 256; ++exponent) {
+            for (int mantissa = 0; mantissa < 256; ++mantissa)
+                half[exponent * 256 + mantissa] = FloatToHalf(mantissa * scale[exponent]);
+        }
+    }
+};
+
+const RGBETables& GetRGBETables() {
+    static const RGBETables tables;
+    return tables;
+}
+
+bool IsRadianceFile(const unsigned char* data, size_t size) {
+    for (const char* signature : {"#?RADIANCE\n", "#?RGBE\n"}) {
+        size_t length = std::strlen(signature);
+        if (size >= length && std::memcmp(data, signature, length) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Image size and the offset of the first scanline; false, setting error, for headers of
+// a format or orientation stb_image would not read either
+bool ParseRadianceHeader(const unsigned char* data, size_t size, int &width, int &height, size_t &offset,
+                         std::string &error) {
+    offset = 0;
+    auto readLine = [&](std::string &line) {
+        const void* end = std::memchr(data + offset, '\n', size - offset);
+        if (!end)
+            return false;
+        size_t length = static_cast<const unsigned char*>(end) - (data + offset);
+        line.assign(reinterpret_cast<const char*>(data + offset), length);
+        offset += length + 1;
+        return true;
+    };
+    
+    // Variables up to an empty line, then the resolution
+    std::string line;
+    readLine(line);
+    while (true) {
+        if (!readLine(line)) {
+            error = "truncated header";
+            return false;
+        }
+        if (line.empty())
+            break;
+        if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            error = "unsupported format " + line.substr(7);
+            return false;
+        }
+    }
+    if (!readLine(line) || std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2) {
+        error = "unsupported orientation " + line;
+        return false;
+    }
+    if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24)) {
+        error = "invalid size " + line;
+        return false;
+    }
+    return true;
+}
+
+bool IsRunLengthEncoded(const unsigned char* scanline, int width) {
+    return width >= RLE_MIN_WIDTH && width <= RLE_MAX_WIDTH && scanline[0] == 2 && scanline[1] == 2 &&
+           (scanline[2] & 0x80) == 0;
+}
+
+// Offset of every scanline. Flat scanlines have a fixed size but encoded ones have to be
+// walked, which reads only their run headers; every run is checked here, so decoding
+// trusts the data.
+bool FindScanlines(const unsigned char* data, size_t size, int width, int height, size_t offset,
+                   std::vector<size_t> &scanlines, std::string &error) {
+    scanlines.resize(height);
+    size_t flatBytes = static_cast<size_t>(width) * 4;
+    for (int y = 0; y < height; ++y) {
+        scanlines[y] = offset;
+        if (size - offset < 4) {
+            error = "truncated at scanline " + std::to_string(y);
+            return false;
+        }
+        if (!IsRunLengthEncoded(data + offset, width)) {
+            if (size - offset < flatBytes) {
+                error = "truncated at scanline " + std::to_string(y);
+                return false;
+            }
+            offset += flatBytes;
+            continue;
+        }
+        
+        if (((data[offset + 2] << 8) | data[offset + 3]) != width) {
+            error = "scanline " + std::to_string(y) + " has the wrong width";
+            return false;
+        }
+        offset += 4;
+        for (int channel = 0; channel < 4; ++channel) {
+            for (int x = 0; x < width;) {
+                if (offset >= size) {
+                    error = "truncated at scanline " + std::to_string(y);
+                    return false;
+                }
+                int count = data[offset];
+                bool run = count > 128;
+                if (run)
+                    count -= 128;
+                size_t runBytes = run ? 2 : 1 + static_cast<size_t>(count);
+                if (count == 0 || count > width - x || size - offset < runBytes) {
+                    error = "bad run-length data in scanline " + std::to_string(y);
+                    return false;
+                }
+                offset += runBytes;
+                x += count;
+            }
+        }
+    }
+    return true;
+}
+
+// Expand an encoded scanline, past its 4-byte header, into four planes of width bytes
+void DecodeRunLengthScanline(const unsigned char* scanline, int width, unsigned char* planes) {
+    for (int channel = 0; channel < 4; ++channel) {
+        unsigned char* plane = planes + static_cast<size_t>(channel) * width;
+        for (int x = 0; x < width;) {
+            int count = *scanline++;
+            if (count > 128) {
+                count -= 128;
+                std::memset(plane + x, *scanline++, count);
+            } else {
+                std::memcpy(plane + x, scanline, count);
+                scanline += count;
+            }
+            x += count;
+        }
+    }
+}
+
+// RGBE texels, with channel c of texel x at channels[c][x * stride], to RGB
+void ConvertScanline(const unsigned char* const channels[4], size_t stride, int width, float* out) {
+    const float* scale = GetRGBETables().scale;
+    for (int x = 0; x < width; ++x) {
+        float unit = scale[channels[3][x * stride]];
+        for (int c = 0; c < 3; ++c)
+            out[x * 3 + c] = channels[c][x * stride] * unit;
+    }
+}
+
+// An RGBE channel has only 256 x 256 values, so halves are looked up rather than converted
+void ConvertScanline(const unsigned char* const channels[4], size_t stride, int width, uint16_t* out) {
+    const RGBETables &tables = GetRGBETables();
+    for (int x = 0; x < width; ++x) {
+        const uint16_t* halves = tables.half + channels[3][x * stride] * 256;
+        for (int c = 0; c < 3; ++c)
+            out[x * 3 + c] = halves[channels[c][x * stride]];
+    }
+}
+
+void StoreTexels(const float* source, size_t count, float* out) {
+    std::memcpy(out, source, count * sizeof(float));
+}
+
+void StoreTexels(const float* source, size_t count, uint16_t* out) {
+    for (size_t i = 0; i < count; ++i)
+        out[i] = FloatToHalf(source[i]);
+}
+
+// Formats other than Radiance, through stb_image
+template <typename Texel>
+bool LoadWithSTB(const char* path, int &width, int &height, std::vector<Texel> &pixels) {
+    // The flip flag is per thread and cleared straight away, so later loads on this thread,
+    // such as the skybox faces, are unaffected
+    stbi_set_flip_vertically_on_load_thread(true);
+    float* data = stbi_loadf(path, &width, &height, nullptr, 3);
+    stbi_set_flip_vertically_on_load_thread(false);
+    if (!data) {
+        std::cout << "Failed to load HDR image: " << path << ". Error: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    pixels.resize(static_cast<size_t>(width) * height * 3);
+    StoreTexels(data, pixels.size(), pixels.data());
+    stbi_image_free(data);
+    return true;
+}
+
+template <typename Texel>
+bool LoadImage(const char* path, int &width, int &height, std::vector<Texel> &pixels, ThreadPool* pool) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        std::cout << "Failed to load HDR image: " << path << ". Error: cannot open file" << std::endl;
+        return false;
+    }
+    const unsigned char* data = file.GetData();
+    if (!IsRadianceFile(data, file.GetSize())) {
+        file.Close();
+        return LoadWithSTB(path, width, height, pixels);
+    }
+    
+    std::string error;
+    size_t offset = 0;
+    std::vector<size_t> scanlines;
+    if (!ParseRadianceHeader(data, file.GetSize(), width, height, offset, error) ||
+        !FindScanlines(data, file.GetSize(), width, height, offset, scanlines, error)) {
+        std::cout << "Failed to load HDR image: " << path << ". Error: " << error << std::endl;
+        return false;
+    }
+    
+    // File rows run top to bottom, the texture's bottom to top
+    pixels.resize(static_cast<size_t>(width) * height * 3);
+    size_t tasks = (static_cast<size_t>(height) + SCANLINES_PER_TASK - 1) / SCANLINES_PER_TASK;
+    auto decodeScanlines = [&](size_t task) {
+        thread_local std::vector<unsigned char> planes;
+        planes.resize(static_cast<size_t>(width) * 4);
+        size_t end = std::min(static_cast<size_t>(height), (task + 1) * SCANLINES_PER_TASK);
+        for (size_t y = task * SCANLINES_PER_TASK; y < end; ++y) {
+            const unsigned char* scanline = data + scanlines[y];
+            const unsigned char* channels[4];
+            size_t stride = 4;
+            if (IsRunLengthEncoded(scanline, width)) {
+                DecodeRunLengthScanline(scanline + 4, width, planes.data());
+                for (int c = 0; c < 4; ++c)
+                    channels[c] = planes.data() + static_cast<size_t>(c) * width;
+                stride = 1;
+            } else {
+                for (int c = 0; c < 4; ++c)
+                    channels[c] = scanline + c;
+            }
+            ConvertScanline(channels, stride, width, pixels.data() + (height - 1 - y) * static_cast<size_t>(width) * 3);
+        }
+    };
+    if (pool && tasks > 1)
+        pool->ParallelFor(tasks, decodeScanlines);
+    else
+        for (size_t task = 0; task < tasks; ++task)
+            decodeScanlines(task);
+    return true;
+}
+
+}
+
+bool LoadHDRImage(const char* path, int &width, int &height, std::vector<float> &pixels, ThreadPool* pool) {
+    return LoadImage(path, width, height, pixels, pool);
+}
+
+bool LoadHDRImage(const char* path, int &width, int &height, std::vector<uint16_t> &pixels, ThreadPool* pool) {
+    return LoadImage(path, width, height, pixels, pool);
+}
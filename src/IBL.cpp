@@ -1,80 +1,944 @@
 #include "../include/IBL.h"
 #include "../include/TextureLoader.h"
+#include "../include/MappedFile.h"
+#include "../include/Hash.h"
+#include "../include/HalfFloat.h"
+#include "../include/BRDFIntegrator.h"
+#include "../include/IBLCPUBaker.h"
+#include "../include/HDRLoader.h"
+#include "BRDFLUTData.h"
 #include <iostream>
-#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <array>
+#include <thread>
 #include <stb/stb_image.h>
 
+namespace {
+
+// Map resolutions; the cached map sizes are shared with the CPU baker through IBLCache.h
+const unsigned int ENVIRONMENT_SIZE = IBL_ENVIRONMENT_SIZE;
+const unsigned int IRRADIANCE_SIZE = 32;
+const unsigned int SH_SOURCE_SIZE = 64;     // Largest environment mip projected onto SH
+const unsigned int PREFILTER_SIZE = IBL_PREFILTER_SIZE;
+const unsigned int PREFILTER_MIP_LEVELS = IBL_PREFILTER_MIP_LEVELS;
+const unsigned int BRDF_LUT_SIZE = 512;     // Shader reference; the embedded size is set at build time
+
+// Levels of a full mip chain
+unsigned int MipLevelCount(unsigned int size) {
+    unsigned int levels = 1;
+    while (size > 1) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+// Bytes of one level of one face
+size_t ImageSize(const IBLCacheTexture &texture, unsigned int level) {
+    size_t pixelSize = (texture.format == GL_RG ? 2 : 3) * sizeof(uint16_t);
+    return static_cast<size_t>(std::max(1u, texture.width >> level)) * std::max(1u, texture.height >> level) * pixelSize;
+}
+
+// First level of the bound cubemap no wider than maxSize, or its smallest level if none is;
+// size receives that level's width (0 if the texture has no storage)
+GLint FindCubemapLevel(GLint maxSize, GLint &size) {
+    GLint level = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &size);
+    while (size > maxSize) {
+        GLint mipSize = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, level + 1, GL_TEXTURE_WIDTH, &mipSize);
+        if (mipSize == 0)
+            break;
+        size = mipSize;
+        level++;
+    }
+    return level;
+}
+
+// Relative luminance difference of two RGB float images, accumulated into a sum and a maximum
+void AccumulateRelativeError(const std::vector<float> &actual, const std::vector<float> &expected,
+                             double &errorSum, float &maxError) {
+    const glm::vec3 luminance(0.2126f, 0.7152f, 0.0722f);
+    for (size_t i = 0; i + 2 < expected.size(); i += 3) {
+        float a = glm::dot(glm::vec3(actual[i], actual[i + 1], actual[i + 2]), luminance);
+        float e = glm::dot(glm::vec3(expected[i], expected[i + 1], expected[i + 2]), luminance);
+        float error = std::fabs(a - e) / std::max(e, 1e-4f);
+        errorSum += error;
+        maxError = std::max(maxError, error);
+    }
+}
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Whether cached maps start with the layout readTexture writes: environment, then prefilter.
+// Caches from tools/ibl_bake add an irradiance cubemap and a BRDF LUT, which go unused here.
+bool HasCachedMapLayout(const std::vector<IBLCacheTexture> &cached) {
+    if (cached.size() < 2)
+        return false;
+    for (const IBLCacheTexture &texture : cached) {
+        size_t expected = 0;
+        for (unsigned int level = 0; level < texture.levelCount; ++level)
+            expected += ImageSize(texture, level) * texture.faceCount;
+        if (texture.type != GL_HALF_FLOAT || texture.levelCount == 0 || texture.data.size() != expected)
+            return false;
+    }
+    return true;
+}
+
+// Same sampling state the bake passes set up, for the bound texture
+void SetCachedSampling(const IBLCacheTexture &cached) {
+    glTexParameteri(cached.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(cached.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (cached.target == GL_TEXTURE_CUBE_MAP)
+        glTexParameteri(cached.target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(cached.target, GL_TEXTURE_MIN_FILTER, cached.levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(cached.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(cached.target, GL_TEXTURE_MAX_LEVEL, cached.levelCount - 1);
+}
+
+// Rows of decoded HDR uploaded per streamed step, about 1 MB of half floats
+const size_t STREAM_UPLOAD_BYTES = 1 << 20;
+
+// What the background thread of a requested environment produces
+struct DecodedEnvironment {
+    std::vector<IBLCacheTexture> cached;    // Environment and prefilter maps on a cache hit
+    std::vector<uint16_t> pixels;           // Otherwise the equirectangular image as RGB half floats
+    int width = 0;
+    int height = 0;
+};
+
+// Read a requested environment's cached maps, or decode its HDR file if there are none.
+// Runs on a background thread, so it touches no GL state.
+DecodedEnvironment DecodeEnvironment(const std::string &hdrPath, const std::string &cachePath, uint64_t cacheKey) {
+    DecodedEnvironment decoded;
+    double bakeMilliseconds = 0.0;
+    if (!cachePath.empty() && IBLCache::Read(cachePath, cacheKey, decoded.cached, bakeMilliseconds)) {
+        if (HasCachedMapLayout(decoded.cached))
+            return decoded;
+        std::cout << "IBL cache " << cachePath << " has unexpected contents, rebaking" << std::endl;
+        decoded.cached.clear();
+    }
+    
+    // Scanlines are decoded on all but one hardware thread, leaving one to the renderer
+    ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    if (!LoadHDRImage(hdrPath.c_str(), decoded.width, decoded.height, decoded.pixels, &pool))
+        decoded.pixels.clear();
+    return decoded;
+}
+
+// GL state the streamed bake steps change, restored so the frame around them is unaffected
+struct SavedBakeState {
+    GLint viewport[4];
+    GLint program;
+    GLint drawFramebuffer;
+    GLint readFramebuffer;
+    GLint vertexArray;
+    GLint activeTexture;
+    GLint texture2D;            // Unit 0 bindings, the only unit the steps use
+    GLint textureCubeMap;
+    GLint unpackAlignment;
+    
+    void Save() {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture2D);
+        glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &textureCubeMap);
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+    }
+    
+    void Restore() const {
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glUseProgram(program);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glBindVertexArray(vertexArray);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture2D);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureCubeMap);
+        glActiveTexture(activeTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    }
+};
+
+// One piece of a streamed bake, small enough to fit in a frame's budget
+struct StreamStep {
+    // Kinds of work whose cost per unit is measured separately
+    enum Kind {
+        Setup,      // Allocation; never shares a frame
+        Upload,     // Texel uploads, timed on the CPU per byte
+        Capture,    // Equirectangular capture, mip generation and copies, GPU-timed per texel
+        Prefilter,  // Prefilter draws, GPU-timed per texel and sample
+        KindCount
+    };
+    
+    Kind kind;
+    double workUnits;
+    std::function<void()> run;
+};
+
+// A requested environment, from its background decode to the handles that replace the current maps
+struct PendingEnvironment {
+    std::string hdrPath;
+    std::future<DecodedEnvironment> decode;
+    DecodedEnvironment decoded;
+    bool isDecoded = false;
+    
+    std::vector<StreamStep> steps;
+    size_t nextStep = 0;
+    unsigned int hdrTexture = 0;
+    unsigned int envCubemap = 0;
+    unsigned int prefilterMap = 0;
+    GLsync fence = nullptr;         // Signals once every step's GPU work has completed
+    
+    std::chrono::high_resolution_clock::time_point requestTime;
+    unsigned int frameCount = 0;
+    
+    ~PendingEnvironment() {
+        if (hdrTexture != 0)
+            glDeleteTextures(1, &hdrTexture);
+        if (envCubemap != 0)
+            glDeleteTextures(1, &envCubemap);
+        if (prefilterMap != 0)
+            glDeleteTextures(1, &prefilterMap);
+        if (fence)
+            glDeleteSync(fence);
+    }
+};
+
+}
+
+struct IBL::EnvironmentStream {
+    std::unique_ptr<PendingEnvironment> request;
+    
+    // Replaced requests whose decode is still running; dropped once it finishes so
+    // replacing a request never blocks on the thread
+    std::vector<std::unique_ptr<PendingEnvironment>> abandoned;
+    
+    // Capture context and programs, compiled before the first request and kept for every later one
+    std::unique_ptr<IBLBakeContext> context;
+    std::unique_ptr<Shader> equirectangularShader;
+    std::unique_ptr<Shader> prefilterShader;
+    
+    // Milliseconds per work unit of each step kind, 0 until measured
+    std::array<double, StreamStep::KindCount> millisecondsPerUnit = {};
+    
+    // GPU timer queries of recent steps, read back once available so they never stall
+    struct TimedStep {
+        unsigned int query;
+        StreamStep::Kind kind;
+        double workUnits;
+    };
+    std::vector<TimedStep> timedSteps;
+    std::vector<unsigned int> freeQueries;
+    
+    ~EnvironmentStream() {
+        for (const TimedStep &timed : timedSteps)
+            glDeleteQueries(1, &timed.query);
+        if (!freeQueries.empty())
+            glDeleteQueries(static_cast<GLsizei>(freeQueries.size()), freeQueries.data());
+    }
+    
+    void Measure(StreamStep::Kind kind, double workUnits, double milliseconds) {
+        if (workUnits <= 0.0)
+            return;
+        // Smooth out noise but follow the real cost within a few steps
+        double sample = milliseconds / workUnits;
+        double &estimate = millisecondsPerUnit[kind];
+        estimate = estimate > 0.0 ? 0.75 * estimate + 0.25 * sample : sample;
+    }
+    
+    // Predicted cost of a step; unmeasured kinds are assumed to take the whole budget
+    double Estimate(const StreamStep &step, double budgetMilliseconds) const {
+        if (step.kind == StreamStep::Setup || millisecondsPerUnit[step.kind] <= 0.0)
+            return budgetMilliseconds;
+        return step.workUnits * millisecondsPerUnit[step.kind];
+    }
+    
+    void CollectTimings() {
+        size_t kept = 0;
+        for (const TimedStep &timed : timedSteps) {
+            GLint available = 0;
+            glGetQueryObjectiv(timed.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                timedSteps[kept++] = timed;
+                continue;
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(timed.query, GL_QUERY_RESULT, &nanoseconds);
+            Measure(timed.kind, timed.workUnits, nanoseconds / 1.0e6);
+            freeQueries.push_back(timed.query);
+        }
+        timedSteps.resize(kept);
+    }
+    
+    void Run(const StreamStep &step) {
+        // Uploads cost CPU time in the driver; draws only cost GPU time, measured with a query
+        if (step.kind == StreamStep::Capture || step.kind == StreamStep::Prefilter) {
+            unsigned int query = 0;
+            if (freeQueries.empty()) {
+                glGenQueries(1, &query);
+            } else {
+                query = freeQueries.back();
+                freeQueries.pop_back();
+            }
+            glBeginQuery(GL_TIME_ELAPSED, query);
+            step.run();
+            glEndQuery(GL_TIME_ELAPSED);
+            timedSteps.push_back({query, step.kind, step.workUnits});
+        } else {
+            auto start = std::chrono::high_resolution_clock::now();
+            step.run();
+            Measure(step.kind, step.workUnits, MillisecondsSince(start));
+        }
+    }
+};
+
+std::string IBL::cacheDirectory;
+
 IBL::IBL() 
     : envCubemap(0), 
       irradianceMap(0), 
       prefilterMap(0), 
-      brdfLUTTexture(0) {
+      brdfLUTTexture(0),
+      irradianceSH() {
+}
+
+IBL::~IBL() {
+    // Pending requests release their textures and wait for their decode here
+    stream.reset();
+    
+    unsigned int textures[] = {envCubemap, irradianceMap, prefilterMap, brdfLUTTexture};
+    for (unsigned int texture : textures)
+        if (texture != 0)
+            glDeleteTextures(1, &texture);
 }
 
 void IBL::LoadEnvironmentMap(const char* hdrPath) {
-    // Generate environment cubemap
-    envCubemap = EquirectangularToCubemap(hdrPath);
+    // Only real HDR sources are cached; the skybox and dummy fallbacks are cheap
+    std::string cachePath;
+    uint64_t cacheKey = 0;
+    if (!cacheDirectory.empty() && stbi_is_hdr(hdrPath) && IBLCache::ComputeKey(hdrPath, cacheKey))
+        cachePath = IBLCache::GetFilePath(cacheDirectory, hdrPath);
     
-    // Generate irradiance map
-    irradianceMap = GenerateIrradianceMap(envCubemap);
+    if (cachePath.empty() || !loadFromCache(cachePath, cacheKey)) {
+        auto bakeStart = std::chrono::high_resolution_clock::now();
+        IBLBakeContext context;
+        
+        // Generate environment cubemap
+        envCubemap = EquirectangularToCubemap(context, hdrPath);
+        
+        // Generate prefilter map
+        prefilterMap = GeneratePrefilterMap(context, envCubemap);
+        std::cout << "IBL bake issued " << context.GetDrawCount() << " layered draw calls ("
+                  << (context.UsesVertexLayer() ? "vertex shader layer" : "geometry shader") << ")." << std::endl;
+        
+        if (!cachePath.empty()) {
+            // Wait for the bake so the time a cache hit saves is measured in full
+            glFinish();
+            saveToCache(cachePath, cacheKey, MillisecondsSince(bakeStart));
+        }
+    }
+    
+    // The BRDF LUT depends on nothing but the BRDF model, so it ships with the executable
+    if (brdfLUTTexture == 0)
+        brdfLUTTexture = LoadBRDFLookUpTexture();
+    
+    // Diffuse irradiance comes from SH, which is cheap enough to recompute on every load
+    irradianceSH = GenerateIrradianceSH(envCubemap);
+}
+
+void IBL::RequestEnvironmentMap(const char* hdrPath) {
+    PrepareEnvironmentStreaming();
+    
+    // A replaced request frees its GL objects now; its decode may still be running
+    if (stream->request) {
+        stream->request->steps.clear();
+        if (stream->request->isDecoded)
+            stream->request.reset();
+        else
+            stream->abandoned.push_back(std::move(stream->request));
+    }
+    
+    std::unique_ptr<PendingEnvironment> request(new PendingEnvironment());
+    request->hdrPath = hdrPath;
+    request->requestTime = std::chrono::high_resolution_clock::now();
+    
+    // Hashing the file for the cache key reads all of it, so it happens on the decode thread too
+    std::string directory = cacheDirectory;
+    request->decode = std::async(std::launch::async, [directory, path = request->hdrPath]() {
+        std::string cachePath;
+        uint64_t cacheKey = 0;
+        if (!directory.empty() && IBLCache::ComputeKey(path.c_str(), cacheKey))
+            cachePath = IBLCache::GetFilePath(directory, path.c_str());
+        return DecodeEnvironment(path, cachePath, cacheKey);
+    });
+    stream->request = std::move(request);
+    std::cout << "Requested environment map " << hdrPath << std::endl;
+}
+
+void IBL::PrepareEnvironmentStreaming() {
+    if (!stream)
+        stream.reset(new EnvironmentStream());
+    if (stream->context)
+        return;
+    
+    SavedBakeState saved;
+    saved.Save();
+    stream->context.reset(new IBLBakeContext());
+    stream->equirectangularShader.reset(new Shader(stream->context->CreateShader("shaders/equirectangular_to_cubemap.fs")));
+    stream->equirectangularShader->setInt("equirectangularMap", 0);
+    stream->prefilterShader.reset(new Shader(stream->context->CreateShader("shaders/prefilter.fs",
+                                                                           {"FILTERED_IMPORTANCE_SAMPLING"})));
+    stream->prefilterShader->setInt("environmentMap", 0);
+    stream->prefilterShader->setFloat("environmentResolution", static_cast<float>(ENVIRONMENT_SIZE));
+    saved.Restore();
+}
+
+bool IBL::UpdateEnvironmentBake(double budgetMilliseconds) {
+    if (!stream)
+        return false;
+    stream->CollectTimings();
+    
+    auto &abandoned = stream->abandoned;
+    abandoned.erase(std::remove_if(abandoned.begin(), abandoned.end(), [](const std::unique_ptr<PendingEnvironment> &request) {
+        return request->decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), abandoned.end());
+    
+    PendingEnvironment* request = stream->request.get();
+    if (!request)
+        return false;
+    request->frameCount++;
     
-    // Generate prefilter map
-    prefilterMap = GeneratePrefilterMap(envCubemap);
+    if (!request->isDecoded) {
+        if (request->decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+        request->decoded = request->decode.get();
+        request->isDecoded = true;
+        if (request->decoded.cached.empty() && request->decoded.pixels.empty()) {
+            std::cout << "Keeping the current environment." << std::endl;
+            stream->request.reset();
+            return false;
+        }
+        queueStreamedBake();
+    }
     
-    // Generate BRDF LUT
-    brdfLUTTexture = GenerateBRDFLookUpTexture();
+    if (request->nextStep < request->steps.size()) {
+        // Run steps until the next one is predicted to overrun the budget; the first
+        // always runs so every request makes progress
+        SavedBakeState saved;
+        saved.Save();
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        double predicted = 0.0;
+        unsigned int stepsRun = 0;
+        while (request->nextStep < request->steps.size()) {
+            const StreamStep &step = request->steps[request->nextStep];
+            double cost = stream->Estimate(step, budgetMilliseconds);
+            if (stepsRun > 0 && (predicted + cost > budgetMilliseconds || MillisecondsSince(frameStart) > budgetMilliseconds))
+                break;
+            stream->Run(step);
+            predicted += cost;
+            stepsRun++;
+            request->nextStep++;
+        }
+        saved.Restore();
+        
+        if (request->nextStep < request->steps.size())
+            return false;
+        request->steps.clear();
+        request->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+    
+    // Swap only once the GPU is done, so reading the new maps back never waits
+    GLenum status = glClientWaitSync(request->fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+    finishStreamedBake();
+    return true;
+}
+
+bool IBL::IsEnvironmentBakePending() const {
+    return stream && stream->request;
+}
+
+void IBL::queueStreamedBake() {
+    PendingEnvironment &request = *stream->request;
+    EnvironmentStream &bake = *stream;
+    std::vector<StreamStep> &steps = request.steps;
+    
+    if (!request.decoded.cached.empty()) {
+        // A cache hit only needs its levels uploaded, one face per step
+        const std::vector<IBLCacheTexture> &cached = request.decoded.cached;
+        steps.push_back({StreamStep::Setup, 0.0, [&request]() {
+            glGenTextures(1, &request.envCubemap);
+            glGenTextures(1, &request.prefilterMap);
+        }});
+        for (size_t i = 0; i < 2; ++i) {
+            const IBLCacheTexture &texture = cached[i];
+            unsigned int* handle = i == 0 ? &request.envCubemap : &request.prefilterMap;
+            size_t offset = 0;
+            for (unsigned int level = 0; level < texture.levelCount; ++level) {
+                for (unsigned int face = 0; face < texture.faceCount; ++face) {
+                    size_t bytes = ImageSize(texture, level);
+                    steps.push_back({StreamStep::Upload, static_cast<double>(bytes), [&texture, handle, level, face, offset]() {
+                        glBindTexture(texture.target, *handle);
+                        if (level == 0 && face == 0)
+                            SetCachedSampling(texture);
+                        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                        GLenum faceTarget = texture.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : texture.target;
+                        glTexImage2D(faceTarget, level, texture.internalFormat,
+                                     std::max(1u, texture.width >> level), std::max(1u, texture.height >> level), 0,
+                                     texture.format, texture.type, texture.data.data() + offset);
+                    }});
+                    offset += bytes;
+                }
+            }
+        }
+        return;
+    }
+    
+    // Allocate the maps
+    steps.push_back({StreamStep::Setup, 0.0, [&request]() {
+        glGenTextures(1, &request.hdrTexture);
+        glBindTexture(GL_TEXTURE_2D, request.hdrTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, request.decoded.width, request.decoded.height, 0, GL_RGB, GL_HALF_FLOAT,
+                     nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        
+        request.envCubemap = TextureLoader::CreateCubemap(ENVIRONMENT_SIZE, ENVIRONMENT_SIZE);
+        request.prefilterMap = TextureLoader::CreateCubemap(PREFILTER_SIZE, PREFILTER_SIZE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PREFILTER_MIP_LEVELS - 1);
+    }});
+    // Upload the decoded image in bands of rows; the host copy is freed with the last one
+    size_t rowBytes = static_cast<size_t>(request.decoded.width) * 3 * sizeof(uint16_t);
+    int bandRows = static_cast<int>(std::max<size_t>(1, STREAM_UPLOAD_BYTES / rowBytes));
+    for (int row = 0; row < request.decoded.height; row += bandRows) {
+        int rows = std::min(bandRows, request.decoded.height - row);
+        bool last = row + rows >= request.decoded.height;
+        steps.push_back({StreamStep::Upload, static_cast<double>(rowBytes * rows), [&request, row, rows, last]() {
+            glBindTexture(GL_TEXTURE_2D, request.hdrTexture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, request.decoded.width, rows, GL_RGB, GL_HALF_FLOAT,
+                            request.decoded.pixels.data() + static_cast<size_t>(row) * request.decoded.width * 3);
+            if (last)
+                std::vector<uint16_t>().swap(request.decoded.pixels);
+        }});
+    }
+    
+    // Capture the environment one face at a time, then build its mip chain
+    double faceTexels = static_cast<double>(ENVIRONMENT_SIZE) * ENVIRONMENT_SIZE;
+    for (unsigned int face = 0; face < 6; ++face) {
+        steps.push_back({StreamStep::Capture, faceTexels, [&request, &bake, face]() {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, request.hdrTexture);
+            bake.context->RenderFace(*bake.equirectangularShader, request.envCubemap, 0, ENVIRONMENT_SIZE, face);
+        }});
+    }
+    steps.push_back({StreamStep::Capture, 6.0 * faceTexels / 3.0, [&request]() {
+        glDeleteTextures(1, &request.hdrTexture);
+        request.hdrTexture = 0;
+        glBindTexture(GL_TEXTURE_CUBE_MAP, request.envCubemap);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    }});
+    
+    // Filtered prefiltering as GeneratePrefilterMap does it: mip 0 copied, then face by face
+    steps.push_back({StreamStep::Capture, 6.0 * PREFILTER_SIZE * PREFILTER_SIZE, [&request, &bake]() {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, request.envCubemap);
+        GLint sourceSize = 0;
+        GLint sourceLevel = FindCubemapLevel(PREFILTER_SIZE, sourceSize);
+        bake.context->Copy(request.envCubemap, sourceLevel, sourceSize, request.prefilterMap, 0, PREFILTER_SIZE);
+    }});
+    for (unsigned int mip = 1; mip < PREFILTER_MIP_LEVELS; ++mip) {
+        float roughness = static_cast<float>(mip) / (PREFILTER_MIP_LEVELS - 1);
+        unsigned int size = std::max(1u, PREFILTER_SIZE >> mip);
+        unsigned int sampleCount = FilteredSampleCount(roughness);
+        for (unsigned int face = 0; face < 6; ++face) {
+            steps.push_back({StreamStep::Prefilter, static_cast<double>(size) * size * sampleCount,
+                             [&request, &bake, roughness, size, sampleCount, mip, face]() {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, request.envCubemap);
+                bake.prefilterShader->use();
+                bake.prefilterShader->setFloat("roughness", roughness);
+                bake.prefilterShader->setInt("sampleCount", static_cast<int>(sampleCount));
+                bake.context->RenderFace(*bake.prefilterShader, request.prefilterMap, mip, size, face);
+            }});
+        }
+    }
+}
+
+void IBL::finishStreamedBake() {
+    std::unique_ptr<PendingEnvironment> request = std::move(stream->request);
+    
+    // The readback is small and the GPU is already done with the map, so this stays within a frame
+    SavedBakeState saved;
+    saved.Save();
+    irradianceSH = GenerateIrradianceSH(request->envCubemap, false);
+    saved.Restore();
+    
+    // The old maps are only referenced by commands already submitted, which GL keeps alive
+    glDeleteTextures(1, &envCubemap);
+    glDeleteTextures(1, &prefilterMap);
+    if (irradianceMap != 0) {
+        glDeleteTextures(1, &irradianceMap);
+        irradianceMap = 0;
+    }
+    envCubemap = request->envCubemap;
+    prefilterMap = request->prefilterMap;
+    request->envCubemap = 0;
+    request->prefilterMap = 0;
+    
+    std::cout << "Switched to environment map " << request->hdrPath << " after "
+              << MillisecondsSince(request->requestTime) << " ms over " << request->frameCount << " frames"
+              << (request->decoded.cached.empty() ? "" : " (from cache)") << std::endl;
+}
+
+void IBL::SetCacheDirectory(const std::string &directory) {
+    cacheDirectory = directory;
+}
+
+bool IBL::loadFromCache(const std::string &path, uint64_t key) {
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    std::vector<IBLCacheTexture> cached;
+    double bakeMilliseconds = 0.0;
+    if (!IBLCache::Read(path, key, cached, bakeMilliseconds))
+        return false;
+    
+    // Only the layout readTexture writes is accepted
+    if (!HasCachedMapLayout(cached)) {
+        std::cout << "IBL cache " << path << " has unexpected contents, rebaking" << std::endl;
+        return false;
+    }
+    
+    envCubemap = createTexture(cached[0]);
+    prefilterMap = createTexture(cached[1]);
+    
+    double loadMilliseconds = MillisecondsSince(loadStart);
+    std::cout << "Loaded IBL maps from " << path << " in " << loadMilliseconds << " ms (baking took "
+              << bakeMilliseconds << " ms, saved " << bakeMilliseconds - loadMilliseconds << " ms)" << std::endl;
+    return true;
+}
+
+void IBL::saveToCache(const std::string &path, uint64_t key, double bakeMilliseconds) {
+    std::vector<IBLCacheTexture> cached;
+    cached.push_back(readTexture(envCubemap, GL_TEXTURE_CUBE_MAP, GL_RGB16F, GL_RGB, MipLevelCount(ENVIRONMENT_SIZE)));
+    cached.push_back(readTexture(prefilterMap, GL_TEXTURE_CUBE_MAP, GL_RGB16F, GL_RGB, PREFILTER_MIP_LEVELS));
+    
+    if (IBLCache::Write(path, key, cached, bakeMilliseconds))
+        std::cout << "Wrote IBL cache " << path << " (bake took " << bakeMilliseconds << " ms)" << std::endl;
+}
+
+IBLCacheTexture IBL::readTexture(unsigned int texture, GLenum target, GLenum internalFormat, GLenum format,
+                                 unsigned int levelCount) {
+    IBLCacheTexture cached;
+    cached.target = target;
+    cached.internalFormat = internalFormat;
+    cached.format = format;
+    cached.type = GL_HALF_FLOAT;
+    cached.levelCount = levelCount;
+    cached.faceCount = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    
+    // Rows of 3-component half floats are not 4-byte multiples, so read them unpadded
+    GLint packAlignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(target, texture);
+    for (unsigned int level = 0; level < levelCount; ++level) {
+        GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+        GLint width = 0, height = 0;
+        glGetTexLevelParameteriv(faceTarget, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(faceTarget, level, GL_TEXTURE_HEIGHT, &height);
+        if (level == 0) {
+            cached.width = width;
+            cached.height = height;
+        }
+        
+        size_t faceBytes = ImageSize(cached, level);
+        for (unsigned int face = 0; face < cached.faceCount; ++face) {
+            size_t offset = cached.data.size();
+            cached.data.resize(offset + faceBytes);
+            glGetTexImage(faceTarget + face, level, format, GL_HALF_FLOAT, cached.data.data() + offset);
+        }
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    return cached;
+}
+
+unsigned int IBL::createTexture(const IBLCacheTexture &cached) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(cached.target, texture);
+    
+    GLint unpackAlignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t offset = 0;
+    for (unsigned int level = 0; level < cached.levelCount; ++level) {
+        unsigned int width = std::max(1u, cached.width >> level);
+        unsigned int height = std::max(1u, cached.height >> level);
+        for (unsigned int face = 0; face < cached.faceCount; ++face) {
+            GLenum faceTarget = cached.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : cached.target;
+            glTexImage2D(faceTarget, level, cached.internalFormat, width, height, 0, cached.format, cached.type,
+                         cached.data.data() + offset);
+            offset += ImageSize(cached, level);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    
+    SetCachedSampling(cached);
+    return texture;
 }
 
 void IBL::Apply(Shader &shader) {
-    // Apply IBL maps to shader
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-    shader.setInt("irradianceMap", 5);
+    // Sampler units are fixed, so they only need to be assigned once per program.
+    // Diffuse irradiance reaches the shader as SH through FrameUniforms instead.
+    if (configuredPrograms.insert(shader.ID).second) {
+        shader.setInt("prefilterMap", 6);
+        shader.setInt("brdfLUT", 7);
+    }
     
+    // Apply IBL maps to shader
     glActiveTexture(GL_TEXTURE6);
     glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
-    shader.setInt("prefilterMap", 6);
     
     glActiveTexture(GL_TEXTURE7);
     glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
-    shader.setInt("brdfLUT", 7);
+}
+
+const IrradianceSH& IBL::GetIrradianceSH() const {
+    return irradianceSH;
+}
+
+IBL::IrradianceComparison IBL::CompareIrradianceSH() {
+    IrradianceComparison comparison;
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    irradianceSH = GenerateIrradianceSH(envCubemap);
+    comparison.shMilliseconds = MillisecondsSince(start);
+    
+    if (irradianceMap != 0)
+        glDeleteTextures(1, &irradianceMap);
+    start = std::chrono::high_resolution_clock::now();
+    {
+        IBLBakeContext context;
+        irradianceMap = GenerateIrradianceMap(context, envCubemap);
+    }
+    glFinish();
+    comparison.convolutionMilliseconds = MillisecondsSince(start);
+    
+    // Compare luminance texel by texel against the convolution result
+    std::vector<float> reference(IRRADIANCE_SIZE * IRRADIANCE_SIZE * 3);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
+    const glm::vec3 luminance(0.2126f, 0.7152f, 0.0722f);
+    double errorSum = 0.0;
+    for (unsigned int face = 0; face < 6; ++face) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, GL_FLOAT, reference.data());
+        for (unsigned int y = 0; y < IRRADIANCE_SIZE; ++y) {
+            for (unsigned int x = 0; x < IRRADIANCE_SIZE; ++x) {
+                const float* texel = &reference[(y * IRRADIANCE_SIZE + x) * 3];
+                float expected = glm::dot(glm::vec3(texel[0], texel[1], texel[2]), luminance);
+                glm::vec3 direction = CubemapTexelDirection(face, x, y, IRRADIANCE_SIZE);
+                float actual = glm::dot(EvaluateIrradianceSH(irradianceSH, direction), luminance);
+                float error = std::fabs(actual - expected) / std::max(expected, 1e-4f);
+                errorSum += error;
+                comparison.maxRelativeError = std::max(comparison.maxRelativeError, error);
+            }
+        }
+    }
+    comparison.meanRelativeError = static_cast<float>(errorSum / (6 * IRRADIANCE_SIZE * IRRADIANCE_SIZE));
+    return comparison;
+}
+
+IBL::PrefilterComparison IBL::ComparePrefilterModes() {
+    PrefilterComparison comparison;
+    
+    IBLBakeContext context;
+    auto start = std::chrono::high_resolution_clock::now();
+    unsigned int bruteForce = GeneratePrefilterMap(context, envCubemap, PrefilterMode::BruteForce);
+    glFinish();
+    comparison.bruteForceMilliseconds = MillisecondsSince(start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    unsigned int filtered = GeneratePrefilterMap(context, envCubemap, PrefilterMode::Filtered);
+    glFinish();
+    comparison.filteredMilliseconds = MillisecondsSince(start);
+    
+    for (unsigned int mip = 0; mip < PREFILTER_MIP_LEVELS; ++mip) {
+        unsigned int size = std::max(1u, PREFILTER_SIZE >> mip);
+        std::vector<float> expected(static_cast<size_t>(size) * size * 3);
+        std::vector<float> actual(expected.size());
+        double errorSum = 0.0;
+        float maxError = 0.0f;
+        for (unsigned int face = 0; face < 6; ++face) {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, bruteForce);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_FLOAT, expected.data());
+            glBindTexture(GL_TEXTURE_CUBE_MAP, filtered);
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_FLOAT, actual.data());
+            AccumulateRelativeError(actual, expected, errorSum, maxError);
+        }
+        comparison.sampleCounts.push_back(FilteredSampleCount(static_cast<float>(mip) / (PREFILTER_MIP_LEVELS - 1)));
+        comparison.meanRelativeError.push_back(static_cast<float>(errorSum / (6.0 * size * size)));
+        comparison.maxRelativeError.push_back(maxError);
+    }
+    
+    glDeleteTextures(1, &bruteForce);
+    glDeleteTextures(1, &filtered);
+    return comparison;
+}
+
+IBL::BRDFLookUpComparison IBL::CompareBRDFLookUpTexture() {
+    BRDFLookUpComparison comparison;
+    comparison.embeddedSize = EMBEDDED_BRDF_LUT_SIZE;
+    comparison.shaderSize = BRDF_LUT_SIZE;
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    unsigned int embedded = LoadBRDFLookUpTexture();
+    glFinish();
+    comparison.uploadMilliseconds = MillisecondsSince(start);
+    glDeleteTextures(1, &embedded);
+    
+    start = std::chrono::high_resolution_clock::now();
+    unsigned int reference = GenerateBRDFLookUpTexture();
+    glFinish();
+    comparison.shaderMilliseconds = MillisecondsSince(start);
+    
+    std::vector<float> shaderLUT(static_cast<size_t>(BRDF_LUT_SIZE) * BRDF_LUT_SIZE * 2);
+    GLint packAlignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, reference);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, shaderLUT.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    glDeleteTextures(1, &reference);
+    
+    // Sample the embedded table where the shader LUT has its texel centers, as GL_LINEAR would
+    std::vector<float> embeddedLUT(sizeof(EMBEDDED_BRDF_LUT) / sizeof(EMBEDDED_BRDF_LUT[0]));
+    for (size_t i = 0; i < embeddedLUT.size(); ++i)
+        embeddedLUT[i] = HalfToFloat(EMBEDDED_BRDF_LUT[i]);
+    
+    double errorSum = 0.0;
+    for (unsigned int y = 0; y < BRDF_LUT_SIZE; ++y) {
+        for (unsigned int x = 0; x < BRDF_LUT_SIZE; ++x) {
+            const float* expected = &shaderLUT[(static_cast<size_t>(y) * BRDF_LUT_SIZE + x) * 2];
+            glm::vec2 actual = SampleBRDFLUT(embeddedLUT.data(), EMBEDDED_BRDF_LUT_SIZE,
+                                             (x + 0.5f) / BRDF_LUT_SIZE, (y + 0.5f) / BRDF_LUT_SIZE);
+            float error = std::max(std::fabs(actual.x - expected[0]), std::fabs(actual.y - expected[1]));
+            errorSum += error;
+            comparison.maxError = std::max(comparison.maxError, error);
+        }
+    }
+    comparison.meanError = static_cast<float>(errorSum / (static_cast<double>(BRDF_LUT_SIZE) * BRDF_LUT_SIZE));
+    return comparison;
+}
+
+IBL::CPUBakeComparison IBL::CompareCPUBake(const char* hdrPath) {
+    CPUBakeComparison comparison;
+    ThreadPool pool;
+    EquirectangularImage image;
+    if (!LoadEquirectangularImage(hdrPath, image, &pool))
+        return comparison;
+    
+    comparison.threadCount = pool.GetThreadCount();
+    auto start = std::chrono::high_resolution_clock::now();
+    HostCubemap environment = BakeEnvironmentCubemap(image, ENVIRONMENT_SIZE, &pool);
+    HostCubemap prefilter = BakePrefilterCubemap(environment, PREFILTER_SIZE, PREFILTER_MIP_LEVELS, &pool);
+    comparison.cpuMilliseconds = MillisecondsSince(start);
+    
+    // Read back a level of the GPU map in the CPU map's layout and compare luminance
+    auto compareLevel = [](unsigned int texture, const HostCubemap &reference, unsigned int level,
+                           float &meanError, float &maxError) {
+        unsigned int size = reference.GetLevelSize(level);
+        size_t faceFloats = static_cast<size_t>(size) * size * 3;
+        std::vector<float> actual(6 * faceFloats);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (unsigned int face = 0; face < 6; ++face)
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, &actual[face * faceFloats]);
+        double errorSum = 0.0;
+        AccumulateRelativeError(actual, reference.levels[level], errorSum, maxError);
+        meanError = static_cast<float>(errorSum / (6.0 * size * size));
+    };
+    compareLevel(envCubemap, environment, 0, comparison.environmentMeanError, comparison.environmentMaxError);
+    for (unsigned int mip = 0; mip < PREFILTER_MIP_LEVELS; ++mip) {
+        float meanError = 0.0f, maxError = 0.0f;
+        compareLevel(prefilterMap, prefilter, mip, meanError, maxError);
+        comparison.prefilterMeanError.push_back(meanError);
+        comparison.prefilterMaxError.push_back(maxError);
+    }
+    
+    unsigned int shLevel = 0;
+    while (environment.GetLevelSize(shLevel) > SH_SOURCE_SIZE)
+        shLevel++;
+    IrradianceSH reference = ProjectIrradianceSH(environment.levels[shLevel].data(), environment.GetLevelSize(shLevel), &pool);
+    float dc = std::max(glm::dot(reference.coefficients[0], glm::vec3(0.2126f, 0.7152f, 0.0722f)), 1e-4f);
+    for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+        for (int c = 0; c < 3; ++c)
+            comparison.shMaxError = std::max(comparison.shMaxError,
+                                             std::fabs(irradianceSH.coefficients[i][c] - reference.coefficients[i][c]) / dc);
+    return comparison;
 }
 
 void IBL::DrawSkybox(Shader &skyboxShader, unsigned int cubeVAO) {
     // Draw skybox
     skyboxShader.use();
+    if (configuredPrograms.insert(skyboxShader.ID).second)
+        skyboxShader.setInt("environmentMap", 0);
+    
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-    skyboxShader.setInt("environmentMap", 0);
     
+    // The skybox is written at maximum depth, so it must pass where nothing was drawn
+    glDepthFunc(GL_LEQUAL);
     glBindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
+    glDepthFunc(GL_LESS);
 }
 
-unsigned int IBL::EquirectangularToCubemap(const char* hdrPath) {
-    // Load HDR environment map
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, nrComponents;
-    float *data = stbi_loadf(hdrPath, &width, &height, &nrComponents, 0);
+unsigned int IBL::EquirectangularToCubemap(IBLBakeContext &context, const char* hdrPath) {
+    // Load HDR environment map, decoded straight to the half floats the texture holds
+    int width, height;
+    std::vector<uint16_t> pixels;
+    bool loaded;
+    {
+        ThreadPool pool;
+        loaded = LoadHDRImage(hdrPath, width, height, pixels, &pool);
+    }
     unsigned int hdrTexture = 0;
     
-    if (data) {
+    if (loaded) {
         glGenTextures(1, &hdrTexture);
         glBindTexture(GL_TEXTURE_2D, hdrTexture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
-
+        // Rows of an odd number of RGB half texels are not 4-byte aligned
+        GLint unpackAlignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_HALF_FLOAT, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+        
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        
         std::cout << "Loaded HDR environment map: " << hdrPath << " (" << width << "x" << height << ")" << std::endl;
     } else {
-        std::cout << "Failed to load HDR environment map: " << hdrPath << ". Error: " << stbi_failure_reason() << std::endl;
         std::cout << "Falling back to skybox textures." << std::endl;
-        stbi_image_free(data);
         
         // Fallback to regular skybox textures
         std::vector<std::string> faces = {
@@ -101,60 +965,14 @@ unsigned int IBL::EquirectangularToCubemap(const char* hdrPath) {
     }
     
     // Create a cubemap to hold the processed HDR data
-    unsigned int envCubemap = TextureLoader::CreateCubemap(512, 512);
-    
-    // Create and setup framebuffer
-    unsigned int captureFBO, captureRBO;
-    glGenFramebuffers(1, &captureFBO);
-    glGenRenderbuffers(1, &captureRBO);
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
-    
-    // Load and compile equirectangular to cubemap shader
-    Shader equirectToCubemapShader("shaders/equirectangular_to_cubemap.vs", "shaders/equirectangular_to_cubemap.fs");
-    equirectToCubemapShader.use();
-    equirectToCubemapShader.setInt("equirectangularMap", 0);
-    
-    // Set up projection and view matrices for capturing from 6 directions
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] = {
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
+    unsigned int envCubemap = TextureLoader::CreateCubemap(ENVIRONMENT_SIZE, ENVIRONMENT_SIZE);
     
     // Convert HDR equirectangular environment map to cubemap
-    equirectToCubemapShader.setMat4("projection", captureProjection);
+    Shader equirectToCubemapShader = context.CreateShader("shaders/equirectangular_to_cubemap.fs");
+    equirectToCubemapShader.setInt("equirectangularMap", 0);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, hdrTexture);
-    
-    // Setup viewport for cubemap face rendering
-    glViewport(0, 0, 512, 512);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    
-    // Create a cube for rendering to the cubemap faces
-    unsigned int cubeVAO = setupCubeVAO();
-    
-    // Render cubemap faces
-    for (unsigned int i = 0; i < 6; ++i) {
-        equirectToCubemapShader.setMat4("view", captureViews[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, envCubemap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        // Render cube
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-    }
-    
-    // Cleanup
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    context.Render(envCubemap, 0, ENVIRONMENT_SIZE);
     glDeleteTextures(1, &hdrTexture);
     
     // Generate mipmaps for the cubemap
@@ -165,146 +983,96 @@ unsigned int IBL::EquirectangularToCubemap(const char* hdrPath) {
     return envCubemap;
 }
 
-unsigned int IBL::GenerateIrradianceMap(unsigned int envMap) {
+unsigned int IBL::GenerateIrradianceMap(IBLBakeContext &context, unsigned int envMap) {
     // Create irradiance cubemap
-    unsigned int irradianceMap = TextureLoader::CreateCubemap(32, 32); // Lower resolution is sufficient for irradiance
-    
-    // Create framebuffer for rendering to cubemap faces
-    unsigned int captureFBO, captureRBO;
-    glGenFramebuffers(1, &captureFBO);
-    glGenRenderbuffers(1, &captureRBO);
+    unsigned int irradianceMap = TextureLoader::CreateCubemap(IRRADIANCE_SIZE, IRRADIANCE_SIZE); // Lower resolution is sufficient for irradiance
     
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
-    
-    // Load and use irradiance convolution shader
-    Shader irradianceShader("shaders/irradiance_convolution.vs", "shaders/irradiance_convolution.fs");
-    irradianceShader.use();
+    // Convolve the environment into every face
+    Shader irradianceShader = context.CreateShader("shaders/irradiance_convolution.fs");
     irradianceShader.setInt("environmentMap", 0);
-    
-    // Set up projection and view matrices for capturing from 6 directions
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] = {
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
-    
-    // Bind environment cubemap as input
-    irradianceShader.setMat4("projection", captureProjection);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, envMap);
+    context.Render(irradianceMap, 0, IRRADIANCE_SIZE);
     
-    // Set viewport to match irradiance map resolution
-    glViewport(0, 0, 32, 32);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+    std::cout << "Created irradiance cubemap." << std::endl;
+    return irradianceMap;
+}
+
+IrradianceSH IBL::GenerateIrradianceSH(unsigned int envMap, bool parallel) {
+    // L2 SH cannot hold more than a few texels' worth of detail, so a small mip is enough
+    glBindTexture(GL_TEXTURE_CUBE_MAP, envMap);
+    GLint size = 0;
+    GLint level = FindCubemapLevel(SH_SOURCE_SIZE, size);
     
-    // Get cube VAO for rendering
-    unsigned int cubeVAO = setupCubeVAO();
+    IrradianceSH sh = {};
+    if (size <= 0)
+        return sh;
     
-    // Render to each face of the irradiance cubemap
-    for (unsigned int i = 0; i < 6; ++i) {
-        irradianceShader.setMat4("view", captureViews[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        // Render cube
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-    }
+    size_t faceFloats = static_cast<size_t>(size) * size * 3;
+    std::vector<float> faces(6 * faceFloats);
+    for (unsigned int face = 0; face < 6; ++face)
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, &faces[face * faceFloats]);
     
-    // Cleanup
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteRenderbuffers(1, &captureRBO);
-    glDeleteFramebuffers(1, &captureFBO);
-    
-    std::cout << "Created irradiance cubemap." << std::endl;
-    return irradianceMap;
+    if (parallel) {
+        ThreadPool pool;
+        sh = ProjectIrradianceSH(faces.data(), static_cast<unsigned int>(size), &pool);
+    } else {
+        sh = ProjectIrradianceSH(faces.data(), static_cast<unsigned int>(size));
+    }
+    std::cout << "Projected environment onto L2 spherical harmonics (" << size << "x" << size << " faces)." << std::endl;
+    return sh;
 }
 
-unsigned int IBL::GeneratePrefilterMap(unsigned int envMap) {
+unsigned int IBL::GeneratePrefilterMap(IBLBakeContext &context, unsigned int envMap, PrefilterMode mode) {
     // Create prefilter cubemap with mipmaps
-    unsigned int prefilterMap = TextureLoader::CreateCubemap(128, 128);
+    unsigned int prefilterMap = TextureLoader::CreateCubemap(PREFILTER_SIZE, PREFILTER_SIZE);
     
-    // Ensure proper filtering for mipmaps
+    // Ensure proper filtering for mipmaps; only the rendered levels are sampled
     glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PREFILTER_MIP_LEVELS - 1);
     
-    // Create framebuffer for rendering to cubemap faces
-    unsigned int captureFBO, captureRBO;
-    glGenFramebuffers(1, &captureFBO);
-    glGenRenderbuffers(1, &captureRBO);
+    bool filtered = mode == PrefilterMode::Filtered;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, envMap);
+    GLint environmentSize = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &environmentSize);
+    
+    unsigned int firstMip = 0;
+    if (filtered) {
+        // At roughness 0 the GGX lobe is the mirror direction, so mip 0 is the environment
+        // itself, copied from its level closest to the prefilter size
+        GLint sourceSize = 0;
+        GLint sourceLevel = FindCubemapLevel(PREFILTER_SIZE, sourceSize);
+        context.Copy(envMap, sourceLevel, sourceSize, prefilterMap, 0, PREFILTER_SIZE);
+        firstMip = 1;
+    }
     
     // Load and use prefilter shader
-    Shader prefilterShader("shaders/prefilter.vs", "shaders/prefilter.fs");
-    prefilterShader.use();
+    Shader prefilterShader = context.CreateShader("shaders/prefilter.fs",
+        filtered ? std::vector<std::string>{"FILTERED_IMPORTANCE_SAMPLING"} : std::vector<std::string>{});
     prefilterShader.setInt("environmentMap", 0);
-    
-    // Set up projection and view matrices for capturing from 6 directions
-    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-    glm::mat4 captureViews[] = {
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-    };
+    if (filtered)
+        prefilterShader.setFloat("environmentResolution", static_cast<float>(environmentSize));
     
     // Bind environment cubemap as input
-    prefilterShader.setMat4("projection", captureProjection);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, envMap);
     
-    // Get cube VAO for rendering
-    unsigned int cubeVAO = setupCubeVAO();
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    
     // Process each mipmap level for different roughness values
-    const unsigned int maxMipLevels = 5;
-    for (unsigned int mip = 0; mip < maxMipLevels; ++mip) {
-        // Resize framebuffer according to mip-level size
-        unsigned int mipWidth = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        unsigned int mipHeight = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-        
-        glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-        glViewport(0, 0, mipWidth, mipHeight);
-        
+    const unsigned int maxMipLevels = PREFILTER_MIP_LEVELS;
+    for (unsigned int mip = firstMip; mip < maxMipLevels; ++mip) {
         // Set roughness value for this mip level
         float roughness = (float)mip / (float)(maxMipLevels - 1);
         prefilterShader.setFloat("roughness", roughness);
+        if (filtered)
+            prefilterShader.setInt("sampleCount", static_cast<int>(FilteredSampleCount(roughness)));
         
-        // Render to each face of the prefilter cubemap at this mip level
-        for (unsigned int i = 0; i < 6; ++i) {
-            prefilterShader.setMat4("view", captureViews[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMap, mip);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            
-            // Render cube
-            glBindVertexArray(cubeVAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
-            glBindVertexArray(0);
-        }
+        // Render all six faces of this mip level
+        context.Render(prefilterMap, mip, std::max(1u, PREFILTER_SIZE >> mip));
     }
     
-    // Generate mipmaps for the prefiltered environment map
-    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-    
-    // Cleanup
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteRenderbuffers(1, &captureRBO);
-    glDeleteFramebuffers(1, &captureFBO);
-    
-    std::cout << "Created prefiltered environment cubemap." << std::endl;
+    std::cout << "Created prefiltered environment cubemap ("
+              << (filtered ? "filtered importance sampling" : "brute force") << ")." << std::endl;
     return prefilterMap;
 }
 
@@ -314,8 +1082,8 @@ unsigned int IBL::GenerateBRDFLookUpTexture() {
     glGenTextures(1, &brdfLUTTexture);
     glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
     
-    // Create a blank 512x512 texture for the BRDF LUT
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, nullptr);
+    // Create a blank texture for the BRDF LUT
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, BRDF_LUT_SIZE, BRDF_LUT_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
     
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -329,7 +1097,7 @@ unsigned int IBL::GenerateBRDFLookUpTexture() {
     
     glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
     glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTexture, 0);
     
@@ -338,7 +1106,7 @@ unsigned int IBL::GenerateBRDFLookUpTexture() {
     brdfShader.use();
     
     // Set viewport to match BRDF LUT resolution
-    glViewport(0, 0, 512, 512);
+    glViewport(0, 0, BRDF_LUT_SIZE, BRDF_LUT_SIZE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
     // Render quad with BRDF shader
@@ -379,69 +1147,18 @@ unsigned int IBL::GenerateBRDFLookUpTexture() {
     return brdfLUTTexture;
 }
 
-unsigned int IBL::setupCubeVAO() {
-    // Vertex data for a unit cube
-    float vertices[] = {
-        // positions          
-        -1.0f,  1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        -1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f
-    };
-
-    unsigned int cubeVAO, cubeVBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    
-    // Fill buffer
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+unsigned int IBL::LoadBRDFLookUpTexture() {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
     
-    // Link vertex attributes
-    glBindVertexArray(cubeVAO);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    
-    // Unbind
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // Rows of RG half floats are 4-byte multiples, so the default unpack alignment holds
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, EMBEDDED_BRDF_LUT_SIZE, EMBEDDED_BRDF_LUT_SIZE, 0, GL_RG, GL_HALF_FLOAT,
+                 EMBEDDED_BRDF_LUT);
     
-    return cubeVAO;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
 }
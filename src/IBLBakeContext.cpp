@@ -0,0 +1,165 @@
+#include "../include/IBLBakeContext.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+IBLBakeContext::IBLBakeContext() : captureFBO(0), copyFBO(0), cubeVAO(0), cubeVBO(0), drawCount(0) {
+    glGenFramebuffers(1, &captureFBO);
+    glGenFramebuffers(1, &copyFBO);
+    
+    // Set up projection and view matrices for capturing from 6 directions, in GL face order
+    glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+    glm::mat4 captureViews[] = {
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+    };
+    for (unsigned int i = 0; i < 6; ++i)
+        viewProjections[i] = captureProjection * captureViews[i];
+    
+    // Writing gl_Layer from the vertex shader lets one instanced draw skip the geometry stage
+    if (glewIsSupported("GL_ARB_shader_viewport_layer_array"))
+        layerDefines.push_back("VERTEX_LAYER_ARB");
+    else if (glewIsSupported("GL_AMD_vertex_shader_layer"))
+        layerDefines.push_back("VERTEX_LAYER_AMD");
+    
+    // Vertex data for a unit cube
+    float vertices[] = {
+        // positions          
+        -1.0f,  1.0f, -1.0f,
+        -1.0f, -1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,
+        
+        -1.0f, -1.0f,  1.0f,
+        -1.0f, -1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,
+        -1.0f,  1.0f,  1.0f,
+        -1.0f, -1.0f,  1.0f,
+        
+         1.0f, -1.0f, -1.0f,
+         1.0f, -1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+        
+        -1.0f, -1.0f,  1.0f,
+        -1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f,
+         1.0f, -1.0f,  1.0f,
+        -1.0f, -1.0f,  1.0f,
+        
+        -1.0f,  1.0f, -1.0f,
+         1.0f,  1.0f, -1.0f,
+         1.0f,  1.0f,  1.0f,
+         1.0f,  1.0f,  1.0f,
+        -1.0f,  1.0f,  1.0f,
+        -1.0f,  1.0f, -1.0f,
+        
+        -1.0f, -1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,
+         1.0f, -1.0f, -1.0f,
+         1.0f, -1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,
+         1.0f, -1.0f,  1.0f
+    };
+    
+    glGenVertexArrays(1, &cubeVAO);
+    glGenBuffers(1, &cubeVBO);
+    
+    // Fill buffer
+    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    
+    // Link vertex attributes
+    glBindVertexArray(cubeVAO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    
+    // Unbind
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+IBLBakeContext::~IBLBakeContext() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &captureFBO);
+    glDeleteFramebuffers(1, &copyFBO);
+    glDeleteVertexArrays(1, &cubeVAO);
+    glDeleteBuffers(1, &cubeVBO);
+}
+
+Shader IBLBakeContext::CreateShader(const char* fragmentPath, std::vector<std::string> defines) const {
+    defines.insert(defines.end(), layerDefines.begin(), layerDefines.end());
+    Shader shader(VERTEX_SHADER, fragmentPath, defines, layerDefines.empty() ? GEOMETRY_SHADER : nullptr);
+    shader.use();
+    for (unsigned int i = 0; i < 6; ++i)
+        shader.setMat4("captureViewProjections[" + std::to_string(i) + "]", viewProjections[i]);
+    shader.setInt("captureFace", -1);
+    return shader;
+}
+
+void IBLBakeContext::Render(unsigned int cubemap, unsigned int level, unsigned int size) {
+    // Attaching the whole cubemap level makes the framebuffer layered, one layer per face
+    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cubemap, level);
+    glViewport(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    glBindVertexArray(cubeVAO);
+    if (layerDefines.empty())
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, 6);
+    glBindVertexArray(0);
+    drawCount++;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void IBLBakeContext::RenderFace(Shader &shader, unsigned int cubemap, unsigned int level, unsigned int size,
+                                unsigned int face) {
+    // A single-face attachment is not layered, so the shaders only emit the selected face
+    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubemap, level);
+    glViewport(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    shader.use();
+    shader.setInt("captureFace", static_cast<int>(face));
+    glBindVertexArray(cubeVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glBindVertexArray(0);
+    shader.setInt("captureFace", -1);
+    drawCount++;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void IBLBakeContext::Copy(unsigned int source, unsigned int sourceLevel, unsigned int sourceSize,
+                          unsigned int destination, unsigned int destinationLevel, unsigned int destinationSize) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, captureFBO);
+    for (unsigned int i = 0; i < 6; ++i) {
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, source, sourceLevel);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+                               destination, destinationLevel);
+        glBlitFramebuffer(0, 0, sourceSize, sourceSize, 0, 0, destinationSize, destinationSize, GL_COLOR_BUFFER_BIT,
+                          sourceSize == destinationSize ? GL_NEAREST : GL_LINEAR);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+unsigned int IBLBakeContext::GetDrawCount() const {
+    return drawCount;
+}
+
+bool IBLBakeContext::UsesVertexLayer() const {
+    return !layerDefines.empty();
+}
@@ -0,0 +1,420 @@
+#include "../include/IBLCPUBaker.h"
+#include "../include/SphericalHarmonics.h"
+#include "../include/HalfFloat.h"
+#include "../include/HDRLoader.h"
+#include <GL/glew.h>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define IBL_CPU_BAKER_USE_SSE 1
+#endif
+
+namespace {
+
+const float PI = 3.14159265359f;
+
+// Run body(row) for every row of six size x size faces
+void ForEachFaceRow(unsigned int size, ThreadPool *pool, const std::function<void(size_t)> &body) {
+    size_t rows = 6 * static_cast<size_t>(size);
+    if (pool)
+        pool->ParallelFor(rows, body);
+    else
+        for (size_t row = 0; row < rows; ++row)
+            body(row);
+}
+
+// Face and [0, 1] face coordinates of a direction, per the GL cube map face selection table
+void DirectionToFace(const glm::vec3 &d, unsigned int &face, float &s, float &t) {
+    glm::vec3 a = glm::abs(d);
+    float sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = d.x >= 0.0f ? 0 : 1;
+        ma = a.x;
+        sc = d.x >= 0.0f ? -d.z : d.z;
+        tc = -d.y;
+    } else if (a.y >= a.z) {
+        face = d.y >= 0.0f ? 2 : 3;
+        ma = a.y;
+        sc = d.x;
+        tc = d.y >= 0.0f ? d.z : -d.z;
+    } else {
+        face = d.z >= 0.0f ? 4 : 5;
+        ma = a.z;
+        sc = d.z >= 0.0f ? d.x : -d.x;
+        tc = -d.y;
+    }
+    s = 0.5f * (sc / ma + 1.0f);
+    t = 0.5f * (tc / ma + 1.0f);
+}
+
+// GL_LINEAR lookup of a width x height RGB image with clamp-to-edge addressing
+glm::vec3 SampleBilinear(const float *image, unsigned int width, unsigned int height, float u, float v) {
+    float x = glm::clamp(u * width - 0.5f, 0.0f, width - 1.0f);
+    float y = glm::clamp(v * height - 0.5f, 0.0f, height - 1.0f);
+    unsigned int x0 = static_cast<unsigned int>(x);
+    unsigned int y0 = static_cast<unsigned int>(y);
+    unsigned int x1 = std::min(x0 + 1, width - 1);
+    unsigned int y1 = std::min(y0 + 1, height - 1);
+    float fx = x - x0;
+    float fy = y - y0;
+    
+    auto texel = [&](unsigned int tx, unsigned int ty) {
+        const float* p = image + (static_cast<size_t>(ty) * width + tx) * 3;
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+    glm::vec3 bottom = glm::mix(texel(x0, y0), texel(x1, y0), fx);
+    glm::vec3 top = glm::mix(texel(x0, y1), texel(x1, y1), fx);
+    return glm::mix(bottom, top, fy);
+}
+
+// Van der Corpus sequence in base 2, as prefilter.fs computes it
+float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+// Prefilter samples of one mip in the tangent frame of N = V = +Z, as structure-of-arrays
+// padded to a multiple of four with zero weights. With N = V the light direction, its
+// weight and its source level do not depend on the texel, so they are computed once.
+struct PrefilterSamples {
+    std::vector<float> x, y, z;
+    std::vector<float> weight;      // NdotL over the sum of all weights
+    std::vector<float> level;
+};
+
+PrefilterSamples MakePrefilterSamples(float roughness, unsigned int sampleCount, unsigned int environmentSize) {
+    PrefilterSamples samples;
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float texelSolidAngle = 4.0f * PI / (6.0f * environmentSize * environmentSize);
+    float totalWeight = 0.0f;
+    for (unsigned int i = 0; i < sampleCount; ++i) {
+        float phi = 2.0f * PI * static_cast<float>(i) / sampleCount;
+        float v = RadicalInverse(i);
+        float cosTheta = std::sqrt((1.0f - v) / (1.0f + (a2 - 1.0f) * v));
+        float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        glm::vec3 H(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+        glm::vec3 L = glm::normalize(2.0f * H.z * H - glm::vec3(0.0f, 0.0f, 1.0f));
+        if (L.z <= 0.0f)
+            continue;
+        
+        // Source level whose texels cover the solid angle the sample stands for
+        float denom = H.z * H.z * (a2 - 1.0f) + 1.0f;
+        float pdf = a2 / (PI * denom * denom) / 4.0f + 0.0001f;
+        float sampleSolidAngle = 1.0f / (sampleCount * pdf);
+        float level = 0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f;
+        
+        samples.x.push_back(L.x);
+        samples.y.push_back(L.y);
+        samples.z.push_back(L.z);
+        samples.weight.push_back(L.z);
+        samples.level.push_back(std::max(level, 0.0f));
+        totalWeight += L.z;
+    }
+    for (float &weight : samples.weight)
+        weight /= totalWeight;
+    while (samples.x.size() % 4 != 0) {
+        samples.x.push_back(0.0f);
+        samples.y.push_back(0.0f);
+        samples.z.push_back(1.0f);
+        samples.weight.push_back(0.0f);
+        samples.level.push_back(0.0f);
+    }
+    return samples;
+}
+
+// Copy one level of a cubemap, or resample it if no level has the requested size
+std::vector<float> ResampleLevel(const HostCubemap &cubemap, unsigned int size, ThreadPool *pool) {
+    for (unsigned int level = 0; level < cubemap.levels.size(); ++level)
+        if (cubemap.GetLevelSize(level) == size)
+            return cubemap.levels[level];
+    
+    float level = std::log2(static_cast<float>(cubemap.size) / size);
+    std::vector<float> faces(6 * static_cast<size_t>(size) * size * 3);
+    ForEachFaceRow(size, pool, [&](size_t row) {
+        unsigned int face = static_cast<unsigned int>(row / size);
+        unsigned int y = static_cast<unsigned int>(row % size);
+        float* texel = &faces[row * size * 3];
+        for (unsigned int x = 0; x < size; ++x, texel += 3) {
+            glm::vec3 color = cubemap.Sample(CubemapTexelDirection(face, x, y, size), level);
+            texel[0] = color.x;
+            texel[1] = color.y;
+            texel[2] = color.z;
+        }
+    });
+    return faces;
+}
+
+}
+
+unsigned int HostCubemap::GetLevelSize(unsigned int level) const {
+    return std::max(1u, size >> level);
+}
+
+glm::vec3 HostCubemap::Sample(const glm::vec3 &direction, float level) const {
+    unsigned int face;
+    float s, t;
+    DirectionToFace(direction, face, s, t);
+    
+    float maxLevel = static_cast<float>(levels.size() - 1);
+    level = glm::clamp(level, 0.0f, maxLevel);
+    unsigned int level0 = static_cast<unsigned int>(level);
+    float fraction = level - level0;
+    
+    auto sampleLevel = [&](unsigned int l) {
+        unsigned int levelSize = GetLevelSize(l);
+        const float* faceData = levels[l].data() + static_cast<size_t>(face) * levelSize * levelSize * 3;
+        return SampleBilinear(faceData, levelSize, levelSize, s, t);
+    };
+    glm::vec3 color = sampleLevel(level0);
+    if (fraction > 0.0f)
+        color = glm::mix(color, sampleLevel(level0 + 1), fraction);
+    return color;
+}
+
+bool LoadEquirectangularImage(const char* path, EquirectangularImage &image, ThreadPool *pool) {
+    return LoadHDRImage(path, image.width, image.height, image.pixels, pool);
+}
+
+HostCubemap BakeEnvironmentCubemap(const EquirectangularImage &image, unsigned int size, ThreadPool *pool) {
+    HostCubemap cubemap;
+    cubemap.size = size;
+    cubemap.levels.emplace_back(6 * static_cast<size_t>(size) * size * 3);
+    
+    // The same spherical mapping as equirectangular_to_cubemap.fs, including its constants
+    const glm::vec2 invAtan(0.1591f, 0.3183f);
+    ForEachFaceRow(size, pool, [&](size_t row) {
+        unsigned int face = static_cast<unsigned int>(row / size);
+        unsigned int y = static_cast<unsigned int>(row % size);
+        float* texel = &cubemap.levels[0][row * size * 3];
+        for (unsigned int x = 0; x < size; ++x, texel += 3) {
+            glm::vec3 d = CubemapTexelDirection(face, x, y, size);
+            glm::vec2 uv = glm::vec2(std::atan2(d.z, d.x), std::asin(d.y)) * invAtan + glm::vec2(0.5f);
+            glm::vec3 color = SampleBilinear(image.pixels.data(), image.width, image.height, uv.x, uv.y);
+            texel[0] = color.x;
+            texel[1] = color.y;
+            texel[2] = color.z;
+        }
+    });
+    
+    // Box-filtered mips down to 1x1
+    for (unsigned int level = 1; cubemap.GetLevelSize(level - 1) > 1; ++level) {
+        unsigned int sourceSize = cubemap.GetLevelSize(level - 1);
+        unsigned int levelSize = cubemap.GetLevelSize(level);
+        cubemap.levels.emplace_back(6 * static_cast<size_t>(levelSize) * levelSize * 3);
+        const float* source = cubemap.levels[level - 1].data();
+        float* destination = cubemap.levels[level].data();
+        ForEachFaceRow(levelSize, pool, [&](size_t row) {
+            unsigned int face = static_cast<unsigned int>(row / levelSize);
+            unsigned int y = static_cast<unsigned int>(row % levelSize);
+            const float* face0 = source + static_cast<size_t>(face) * sourceSize * sourceSize * 3;
+            const float* row0 = face0 + static_cast<size_t>(2 * y) * sourceSize * 3;
+            const float* row1 = row0 + sourceSize * 3;
+            float* texel = destination + row * levelSize * 3;
+            for (unsigned int x = 0; x < levelSize; ++x, texel += 3)
+                for (unsigned int c = 0; c < 3; ++c)
+                    texel[c] = 0.25f * (row0[6 * x + c] + row0[6 * x + 3 + c] + row1[6 * x + c] + row1[6 * x + 3 + c]);
+        });
+    }
+    return cubemap;
+}
+
+HostCubemap BakeIrradianceCubemap(const HostCubemap &environment, unsigned int size, unsigned int sourceSize,
+                                  ThreadPool *pool) {
+    unsigned int sourceLevel = 0;
+    while (sourceLevel + 1 < environment.levels.size() && environment.GetLevelSize(sourceLevel) > sourceSize)
+        sourceLevel++;
+    sourceSize = environment.GetLevelSize(sourceLevel);
+    
+    // Every source texel as a direction and its radiance times solid angle / pi, padded with
+    // zero radiance to a multiple of four. The solid angles are rescaled to sum to exactly 4 pi.
+    size_t count = 6 * static_cast<size_t>(sourceSize) * sourceSize;
+    size_t padded = (count + 3) & ~static_cast<size_t>(3);
+    std::vector<float> dx(padded, 0.0f), dy(padded, 0.0f), dz(padded, 0.0f);
+    std::vector<float> r(padded, 0.0f), g(padded, 0.0f), b(padded, 0.0f);
+    const float* radiance = environment.levels[sourceLevel].data();
+    double totalSolidAngle = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned int face = static_cast<unsigned int>(i / (static_cast<size_t>(sourceSize) * sourceSize));
+        unsigned int y = static_cast<unsigned int>(i / sourceSize % sourceSize);
+        unsigned int x = static_cast<unsigned int>(i % sourceSize);
+        float s = 2.0f * (x + 0.5f) / sourceSize - 1.0f;
+        float t = 2.0f * (y + 0.5f) / sourceSize - 1.0f;
+        float lengthSquared = 1.0f + s * s + t * t;
+        float solidAngle = 4.0f / (sourceSize * sourceSize * lengthSquared * std::sqrt(lengthSquared));
+        totalSolidAngle += solidAngle;
+        
+        glm::vec3 d = CubemapTexelDirection(face, x, y, sourceSize);
+        dx[i] = d.x;
+        dy[i] = d.y;
+        dz[i] = d.z;
+        r[i] = radiance[i * 3 + 0] * solidAngle;
+        g[i] = radiance[i * 3 + 1] * solidAngle;
+        b[i] = radiance[i * 3 + 2] * solidAngle;
+    }
+    float scale = static_cast<float>(4.0 / totalSolidAngle);
+    for (size_t i = 0; i < count; ++i) {
+        r[i] *= scale;
+        g[i] *= scale;
+        b[i] *= scale;
+    }
+    
+    HostCubemap irradiance;
+    irradiance.size = size;
+    irradiance.levels.emplace_back(6 * static_cast<size_t>(size) * size * 3);
+    ForEachFaceRow(size, pool, [&](size_t row) {
+        unsigned int face = static_cast<unsigned int>(row / size);
+        unsigned int y = static_cast<unsigned int>(row % size);
+        float* texel = &irradiance.levels[0][row * size * 3];
+        for (unsigned int x = 0; x < size; ++x, texel += 3) {
+            glm::vec3 n = CubemapTexelDirection(face, x, y, size);
+            size_t i = 0;
+            float sum[3] = {0.0f, 0.0f, 0.0f};
+#ifdef IBL_CPU_BAKER_USE_SSE
+            // Four source texels per iteration: clamped cosine times weighted radiance
+            __m128 nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y), nz = _mm_set1_ps(n.z);
+            __m128 zero = _mm_setzero_ps();
+            __m128 sumR = zero, sumG = zero, sumB = zero;
+            for (; i < padded; i += 4) {
+                __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&dx[i])),
+                                                      _mm_mul_ps(ny, _mm_loadu_ps(&dy[i]))),
+                                           _mm_mul_ps(nz, _mm_loadu_ps(&dz[i])));
+                cosine = _mm_max_ps(cosine, zero);
+                sumR = _mm_add_ps(sumR, _mm_mul_ps(cosine, _mm_loadu_ps(&r[i])));
+                sumG = _mm_add_ps(sumG, _mm_mul_ps(cosine, _mm_loadu_ps(&g[i])));
+                sumB = _mm_add_ps(sumB, _mm_mul_ps(cosine, _mm_loadu_ps(&b[i])));
+            }
+            alignas(16) float lanes[3][4];
+            _mm_store_ps(lanes[0], sumR);
+            _mm_store_ps(lanes[1], sumG);
+            _mm_store_ps(lanes[2], sumB);
+            for (int c = 0; c < 3; ++c)
+                sum[c] = (lanes[c][0] + lanes[c][1]) + (lanes[c][2] + lanes[c][3]);
+#endif
+            for (; i < padded; ++i) {
+                float cosine = std::max(n.x * dx[i] + n.y * dy[i] + n.z * dz[i], 0.0f);
+                sum[0] += cosine * r[i];
+                sum[1] += cosine * g[i];
+                sum[2] += cosine * b[i];
+            }
+            texel[0] = sum[0];
+            texel[1] = sum[1];
+            texel[2] = sum[2];
+        }
+    });
+    return irradiance;
+}
+
+HostCubemap BakePrefilterCubemap(const HostCubemap &environment, unsigned int size, unsigned int levelCount,
+                                 ThreadPool *pool) {
+    HostCubemap prefilter;
+    prefilter.size = size;
+    
+    // At roughness 0 the GGX lobe is the mirror direction, so mip 0 is the environment itself
+    prefilter.levels.push_back(ResampleLevel(environment, size, pool));
+    
+    for (unsigned int mip = 1; mip < levelCount; ++mip) {
+        float roughness = static_cast<float>(mip) / (levelCount - 1);
+        unsigned int mipSize = prefilter.GetLevelSize(mip);
+        PrefilterSamples samples = MakePrefilterSamples(roughness, FilteredSampleCount(roughness), environment.size);
+        size_t sampleCount = samples.x.size();
+        
+        prefilter.levels.emplace_back(6 * static_cast<size_t>(mipSize) * mipSize * 3);
+        std::vector<float> &level = prefilter.levels.back();
+        ForEachFaceRow(mipSize, pool, [&](size_t row) {
+            unsigned int face = static_cast<unsigned int>(row / mipSize);
+            unsigned int y = static_cast<unsigned int>(row % mipSize);
+            float* texel = &level[row * mipSize * 3];
+            for (unsigned int x = 0; x < mipSize; ++x, texel += 3) {
+                // prefilter.fs's tangent frame around the texel direction
+                glm::vec3 N = CubemapTexelDirection(face, x, y, mipSize);
+                glm::vec3 up = std::fabs(N.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                glm::vec3 T = glm::normalize(glm::cross(up, N));
+                glm::vec3 B = glm::cross(N, T);
+                
+                glm::vec3 color(0.0f);
+                alignas(16) float Lx[4], Ly[4], Lz[4];
+                for (size_t i = 0; i < sampleCount; i += 4) {
+#ifdef IBL_CPU_BAKER_USE_SSE
+                    // Rotate four tangent-space directions into the texel's frame at once
+                    __m128 sx = _mm_loadu_ps(&samples.x[i]);
+                    __m128 sy = _mm_loadu_ps(&samples.y[i]);
+                    __m128 sz = _mm_loadu_ps(&samples.z[i]);
+                    _mm_store_ps(Lx, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(T.x), sx), _mm_mul_ps(_mm_set1_ps(B.x), sy)),
+                                                _mm_mul_ps(_mm_set1_ps(N.x), sz)));
+                    _mm_store_ps(Ly, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(T.y), sx), _mm_mul_ps(_mm_set1_ps(B.y), sy)),
+                                                _mm_mul_ps(_mm_set1_ps(N.y), sz)));
+                    _mm_store_ps(Lz, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(T.z), sx), _mm_mul_ps(_mm_set1_ps(B.z), sy)),
+                                                _mm_mul_ps(_mm_set1_ps(N.z), sz)));
+#else
+                    for (size_t lane = 0; lane < 4; ++lane) {
+                        glm::vec3 L = T * samples.x[i + lane] + B * samples.y[i + lane] + N * samples.z[i + lane];
+                        Lx[lane] = L.x;
+                        Ly[lane] = L.y;
+                        Lz[lane] = L.z;
+                    }
+#endif
+                    for (size_t lane = 0; lane < 4; ++lane) {
+                        float weight = samples.weight[i + lane];
+                        if (weight > 0.0f)
+                            color += environment.Sample(glm::vec3(Lx[lane], Ly[lane], Lz[lane]), samples.level[i + lane]) * weight;
+                    }
+                }
+                texel[0] = color.x;
+                texel[1] = color.y;
+                texel[2] = color.z;
+            }
+        });
+    }
+    return prefilter;
+}
+
+IBLCacheTexture CubemapToCacheTexture(const HostCubemap &cubemap, unsigned int levelCount) {
+    IBLCacheTexture cached;
+    cached.target = GL_TEXTURE_CUBE_MAP;
+    cached.internalFormat = GL_RGB16F;
+    cached.format = GL_RGB;
+    cached.type = GL_HALF_FLOAT;
+    cached.width = cubemap.size;
+    cached.height = cubemap.size;
+    cached.levelCount = std::min<unsigned int>(levelCount, static_cast<unsigned int>(cubemap.levels.size()));
+    cached.faceCount = 6;
+    
+    // Levels are already face after face of tightly packed rows, as the cache stores them
+    for (unsigned int level = 0; level < cached.levelCount; ++level) {
+        size_t offset = cached.data.size();
+        const std::vector<float> &texels = cubemap.levels[level];
+        cached.data.resize(offset + texels.size() * sizeof(uint16_t));
+        for (size_t i = 0; i < texels.size(); ++i) {
+            uint16_t half = FloatToHalf(texels[i]);
+            std::memcpy(&cached.data[offset + i * sizeof(uint16_t)], &half, sizeof(half));
+        }
+    }
+    return cached;
+}
+
+IBLCacheTexture BRDFLUTToCacheTexture(const std::vector<float> &lut, unsigned int size) {
+    IBLCacheTexture cached;
+    cached.target = GL_TEXTURE_2D;
+    cached.internalFormat = GL_RG16F;
+    cached.format = GL_RG;
+    cached.type = GL_HALF_FLOAT;
+    cached.width = size;
+    cached.height = size;
+    cached.levelCount = 1;
+    cached.faceCount = 1;
+    cached.data.resize(lut.size() * sizeof(uint16_t));
+    for (size_t i = 0; i < lut.size(); ++i) {
+        uint16_t half = FloatToHalf(lut[i]);
+        std::memcpy(&cached.data[i * sizeof(uint16_t)], &half, sizeof(half));
+    }
+    return cached;
+}
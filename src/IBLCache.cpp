@@ -0,0 +1,183 @@
+#include "../include/IBLCache.h"
+#include "../include/MappedFile.h"
+#include "../include/Hash.h"
+#include <iostream>
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+namespace {
+
+const char IBL_CACHE_MAGIC[4] = {'P', 'B', 'R', 'I'};
+
+// Shaders run by the GPU bake passes: IBLBakeContext's capture stages, then the fragment stages
+const char* BAKE_SHADERS[] = {
+    "shaders/cubemap_capture.vs", "shaders/cubemap_capture.gs",
+    "shaders/equirectangular_to_cubemap.fs", "shaders/prefilter.fs"
+};
+
+// On-disk layout, little-endian: header, one record per texture, then the texel data
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t checksum;          // Hash64 chained over the records and then each texture's data
+    double bakeMilliseconds;
+    uint32_t textureCount;
+    uint32_t reserved;
+};
+
+struct TextureRecord {
+    uint32_t target;
+    uint32_t internalFormat;
+    uint32_t format;
+    uint32_t type;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t faceCount;
+    uint64_t dataOffset;        // From the start of the file
+    uint64_t dataSize;
+};
+
+static_assert(sizeof(FileHeader) == 40, "FileHeader layout changed");
+static_assert(sizeof(TextureRecord) == 48, "TextureRecord layout changed");
+
+}
+
+bool IBLCache::ComputeKey(const char* hdrPath, uint64_t &key) {
+    MappedFile hdr;
+    if (!hdr.Open(hdrPath))
+        return false;
+    
+    const uint32_t parameters[] = {IBL_CACHE_VERSION, IBL_ENVIRONMENT_SIZE, IBL_PREFILTER_SIZE, IBL_PREFILTER_MIP_LEVELS};
+    key = Hash64(hdr.GetData(), hdr.GetSize());
+    key = Hash64(parameters, sizeof(parameters), key);
+    for (const char* shaderPath : BAKE_SHADERS) {
+        MappedFile shader;
+        if (shader.Open(shaderPath))
+            key = Hash64(shader.GetData(), shader.GetSize(), key);
+    }
+    return true;
+}
+
+std::string IBLCache::GetFilePath(const std::string &directory, const char* hdrPath) {
+    std::error_code error;
+    std::string identity = std::filesystem::absolute(hdrPath, error).string();
+    std::ostringstream name;
+    name << "ibl_" << std::hex << std::setw(16) << std::setfill('0') << Hash64(identity.data(), identity.size())
+         << ".iblcache";
+    return (std::filesystem::path(directory) / name.str()).string();
+}
+
+bool IBLCache::Read(const std::string &path, uint64_t key, std::vector<IBLCacheTexture> &textures,
+                    double &bakeMilliseconds) {
+    MappedFile file;
+    if (!file.Open(path))
+        return false;
+    
+    auto reject = [&](const char* reason) {
+        std::cout << "IBL cache " << path << " " << reason << ", rebaking" << std::endl;
+        return false;
+    };
+    
+    if (!IsLittleEndian())
+        return reject("needs a little-endian host");
+    
+    const unsigned char* data = file.GetData();
+    size_t size = file.GetSize();
+    FileHeader header;
+    if (size < sizeof(header))
+        return reject("is truncated");
+    std::memcpy(&header, data, sizeof(header));
+    
+    if (std::memcmp(header.magic, IBL_CACHE_MAGIC, sizeof(header.magic)) != 0)
+        return reject("is not an IBL cache");
+    if (header.version != IBL_CACHE_VERSION)
+        return reject("is from another version");
+    if (header.key != key)
+        return reject("is stale");
+    
+    size_t recordsEnd = sizeof(header) + static_cast<size_t>(header.textureCount) * sizeof(TextureRecord);
+    if (recordsEnd > size)
+        return reject("is truncated");
+    
+    std::vector<TextureRecord> records(header.textureCount);
+    if (!records.empty())
+        std::memcpy(records.data(), data + sizeof(header), records.size() * sizeof(TextureRecord));
+    
+    uint64_t checksum = Hash64(records.data(), records.size() * sizeof(TextureRecord));
+    for (const TextureRecord &record : records) {
+        if (record.dataOffset < recordsEnd || record.dataOffset > size || record.dataSize > size - record.dataOffset)
+            return reject("is truncated");
+        checksum = Hash64(data + record.dataOffset, record.dataSize, checksum);
+    }
+    if (checksum != header.checksum)
+        return reject("failed its checksum");
+    
+    textures.resize(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        const TextureRecord &record = records[i];
+        IBLCacheTexture &texture = textures[i];
+        texture.target = record.target;
+        texture.internalFormat = record.internalFormat;
+        texture.format = record.format;
+        texture.type = record.type;
+        texture.width = record.width;
+        texture.height = record.height;
+        texture.levelCount = record.levelCount;
+        texture.faceCount = record.faceCount;
+        texture.data.assign(data + record.dataOffset, data + record.dataOffset + record.dataSize);
+    }
+    bakeMilliseconds = header.bakeMilliseconds;
+    return true;
+}
+
+bool IBLCache::Write(const std::string &path, uint64_t key, const std::vector<IBLCacheTexture> &textures,
+                     double bakeMilliseconds) {
+    if (!IsLittleEndian()) {
+        std::cout << "IBL cache not written: big-endian hosts are not supported" << std::endl;
+        return false;
+    }
+    
+    std::vector<TextureRecord> records(textures.size());
+    uint64_t offset = sizeof(FileHeader) + records.size() * sizeof(TextureRecord);
+    for (size_t i = 0; i < textures.size(); ++i) {
+        const IBLCacheTexture &texture = textures[i];
+        TextureRecord &record = records[i];
+        record.target = texture.target;
+        record.internalFormat = texture.internalFormat;
+        record.format = texture.format;
+        record.type = texture.type;
+        record.width = texture.width;
+        record.height = texture.height;
+        record.levelCount = texture.levelCount;
+        record.faceCount = texture.faceCount;
+        record.dataOffset = offset;
+        record.dataSize = texture.data.size();
+        offset += texture.data.size();
+    }
+    
+    FileHeader header;
+    std::memcpy(header.magic, IBL_CACHE_MAGIC, sizeof(header.magic));
+    header.version = IBL_CACHE_VERSION;
+    header.key = key;
+    header.checksum = Hash64(records.data(), records.size() * sizeof(TextureRecord));
+    for (const IBLCacheTexture &texture : textures)
+        header.checksum = Hash64(texture.data.data(), texture.data.size(), header.checksum);
+    header.bakeMilliseconds = bakeMilliseconds;
+    header.textureCount = static_cast<uint32_t>(textures.size());
+    header.reserved = 0;
+    
+    bool written = WriteFileReplacing(path, [&](std::ostream &out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(TextureRecord)));
+        for (const IBLCacheTexture &texture : textures)
+            out.write(reinterpret_cast<const char*>(texture.data.data()), static_cast<std::streamsize>(texture.data.size()));
+    });
+    if (!written)
+        std::cout << "Failed to write IBL cache " << path << std::endl;
+    return written;
+}
@@ -0,0 +1,337 @@
+#include "../include/Json.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const JsonValue& NullValue() {
+    static const JsonValue null;
+    return null;
+}
+
+const std::string& EmptyString() {
+    static const std::string empty;
+    return empty;
+}
+
+}
+
+// Recursive descent parser over a text buffer
+class JsonParser {
+public:
+    JsonParser(const char* text, size_t length) : cursor(text), end(text + length) {}
+    
+    bool ParseDocument(JsonValue &result, std::string &error) {
+        if (!parseValue(result, 0)) {
+            error = message;
+            return false;
+        }
+        skipWhitespace();
+        if (cursor != end) {
+            error = "Unexpected trailing characters";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Deeper documents are rejected rather than risking stack exhaustion
+    static const int MAX_DEPTH = 256;
+    
+    const char* cursor;
+    const char* end;
+    std::string message;
+    
+    bool fail(const char* text) {
+        message = text;
+        return false;
+    }
+    
+    void skipWhitespace() {
+        while (cursor != end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+            ++cursor;
+    }
+    
+    bool consume(const char* literal) {
+        size_t length = std::strlen(literal);
+        if (static_cast<size_t>(end - cursor) < length || std::strncmp(cursor, literal, length) != 0)
+            return false;
+        cursor += length;
+        return true;
+    }
+    
+    bool parseValue(JsonValue &value, int depth) {
+        if (depth > MAX_DEPTH)
+            return fail("Document nested too deeply");
+        
+        skipWhitespace();
+        if (cursor == end)
+            return fail("Unexpected end of document");
+        
+        switch (*cursor) {
+            case '{': return parseObject(value, depth);
+            case '[': return parseArray(value, depth);
+            case '"':
+                value.type = JsonValue::Type::String;
+                return parseString(value.stringValue);
+            case 't':
+                if (!consume("true"))
+                    return fail("Invalid literal");
+                value.type = JsonValue::Type::Bool;
+                value.boolValue = true;
+                return true;
+            case 'f':
+                if (!consume("false"))
+                    return fail("Invalid literal");
+                value.type = JsonValue::Type::Bool;
+                value.boolValue = false;
+                return true;
+            case 'n':
+                if (!consume("null"))
+                    return fail("Invalid literal");
+                value.type = JsonValue::Type::Null;
+                return true;
+            default:
+                return parseNumber(value);
+        }
+    }
+    
+    bool parseNumber(JsonValue &value) {
+        // strtod needs a terminated string; numbers are short, so copy the candidate characters
+        char digits[64];
+        size_t length = 0;
+        while (cursor + length != end && length + 1 < sizeof(digits) &&
+               std::strchr("+-0123456789.eE", cursor[length]) != nullptr)
+            ++length;
+        if (length == 0)
+            return fail("Unexpected character");
+        
+        std::memcpy(digits, cursor, length);
+        digits[length] = '\0';
+        char* parsedEnd = nullptr;
+        value.numberValue = std::strtod(digits, &parsedEnd);
+        if (parsedEnd != digits + length)
+            return fail("Invalid number");
+        
+        value.type = JsonValue::Type::Number;
+        cursor += length;
+        return true;
+    }
+    
+    bool parseHex4(unsigned int &codePoint) {
+        if (end - cursor < 4)
+            return fail("Truncated escape");
+        codePoint = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *cursor++;
+            codePoint <<= 4;
+            if (c >= '0' && c <= '9') codePoint |= c - '0';
+            else if (c >= 'a' && c <= 'f') codePoint |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') codePoint |= c - 'A' + 10;
+            else return fail("Invalid escape");
+        }
+        return true;
+    }
+    
+    static void appendUtf8(std::string &out, unsigned int codePoint) {
+        if (codePoint < 0x80) {
+            out += static_cast<char>(codePoint);
+        } else if (codePoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+    
+    bool parseString(std::string &out) {
+        ++cursor;  // Opening quote
+        while (cursor != end && *cursor != '"') {
+            char c = *cursor++;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (cursor == end)
+                return fail("Truncated escape");
+            
+            char escape = *cursor++;
+            switch (escape) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned int codePoint;
+                    if (!parseHex4(codePoint))
+                        return false;
+                    // Combine UTF-16 surrogate pairs
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00 && consume("\\u")) {
+                        unsigned int low;
+                        if (!parseHex4(low))
+                            return false;
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, codePoint);
+                    break;
+                }
+                default:
+                    return fail("Invalid escape");
+            }
+        }
+        if (cursor == end)
+            return fail("Unterminated string");
+        ++cursor;  // Closing quote
+        return true;
+    }
+    
+    bool parseArray(JsonValue &value, int depth) {
+        ++cursor;
+        value.type = JsonValue::Type::Array;
+        skipWhitespace();
+        if (cursor != end && *cursor == ']') {
+            ++cursor;
+            return true;
+        }
+        
+        while (true) {
+            value.elements.emplace_back();
+            if (!parseValue(value.elements.back(), depth + 1))
+                return false;
+            skipWhitespace();
+            if (cursor == end)
+                return fail("Unterminated array");
+            if (*cursor == ']') {
+                ++cursor;
+                return true;
+            }
+            if (*cursor++ != ',')
+                return fail("Expected ',' in array");
+        }
+    }
+    
+    bool parseObject(JsonValue &value, int depth) {
+        ++cursor;
+        value.type = JsonValue::Type::Object;
+        skipWhitespace();
+        if (cursor != end && *cursor == '}') {
+            ++cursor;
+            return true;
+        }
+        
+        while (true) {
+            skipWhitespace();
+            if (cursor == end || *cursor != '"')
+                return fail("Expected member name");
+            value.members.emplace_back();
+            if (!parseString(value.members.back().first))
+                return false;
+            
+            skipWhitespace();
+            if (cursor == end || *cursor++ != ':')
+                return fail("Expected ':' after member name");
+            if (!parseValue(value.members.back().second, depth + 1))
+                return false;
+            
+            skipWhitespace();
+            if (cursor == end)
+                return fail("Unterminated object");
+            if (*cursor == '}') {
+                ++cursor;
+                return true;
+            }
+            if (*cursor++ != ',')
+                return fail("Expected ',' in object");
+        }
+    }
+};
+
+JsonValue::JsonValue() : type(Type::Null), boolValue(false), numberValue(0.0) {
+}
+
+bool JsonValue::Parse(const char* text, size_t length, JsonValue &result, std::string &error) {
+    result = JsonValue();
+    JsonParser parser(text, length);
+    return parser.ParseDocument(result, error);
+}
+
+JsonValue::Type JsonValue::GetType() const {
+    return type;
+}
+
+bool JsonValue::IsNull() const {
+    return type == Type::Null;
+}
+
+bool JsonValue::IsArray() const {
+    return type == Type::Array;
+}
+
+bool JsonValue::IsObject() const {
+    return type == Type::Object;
+}
+
+bool JsonValue::IsNumber() const {
+    return type == Type::Number;
+}
+
+bool JsonValue::IsString() const {
+    return type == Type::String;
+}
+
+bool JsonValue::AsBool(bool fallback) const {
+    return type == Type::Bool ? boolValue : fallback;
+}
+
+double JsonValue::AsNumber(double fallback) const {
+    return type == Type::Number ? numberValue : fallback;
+}
+
+int JsonValue::AsInt(int fallback) const {
+    return type == Type::Number ? static_cast<int>(numberValue) : fallback;
+}
+
+const std::string& JsonValue::AsString() const {
+    return type == Type::String ? stringValue : EmptyString();
+}
+
+size_t JsonValue::Size() const {
+    if (type == Type::Array)
+        return elements.size();
+    if (type == Type::Object)
+        return members.size();
+    return 0;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return type == Type::Array && index < elements.size() ? elements[index] : NullValue();
+}
+
+const JsonValue& JsonValue::operator[](const std::string &key) const {
+    if (type == Type::Object) {
+        for (const auto &member : members) {
+            if (member.first == key)
+                return member.second;
+        }
+    }
+    return NullValue();
+}
+
+bool JsonValue::Has(const std::string &key) const {
+    return !(*this)[key].IsNull();
+}
+
+const std::vector<std::pair<std::string, JsonValue>>& JsonValue::Members() const {
+    return members;
+}
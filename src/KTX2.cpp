@@ -0,0 +1,236 @@
+#include "../include/KTX2.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// On-disk layout, little-endian: identifier, header, index, then one LevelIndex per level
+struct FileHeader {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+static_assert(sizeof(FileHeader) == 80, "FileHeader layout changed");
+static_assert(sizeof(LevelIndex) == 24, "LevelIndex layout changed");
+
+// Khronos data format descriptor values for the block formats
+const uint32_t KHR_DF_MODEL_BC1A = 128;
+const uint32_t KHR_DF_MODEL_BC4 = 131;
+const uint32_t KHR_DF_MODEL_BC5 = 132;
+const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+const uint32_t KHR_DF_VERSION_1_3 = 2;
+
+// A basic descriptor block with one 64-bit sample per channel the format stores
+std::vector<uint32_t> BuildDataFormatDescriptor(BlockFormat format, bool srgb) {
+    uint32_t model = format == BlockFormat::BC1 ? KHR_DF_MODEL_BC1A : format == BlockFormat::BC4 ? KHR_DF_MODEL_BC4 : KHR_DF_MODEL_BC5;
+    uint32_t sampleCount = format == BlockFormat::BC5 ? 2 : 1;
+    uint32_t blockSize = 24 + 16 * sampleCount;
+    
+    std::vector<uint32_t> words;
+    words.push_back(4 + blockSize);                         // dfdTotalSize
+    words.push_back(0);                                     // Khronos vendor, basic descriptor type
+    words.push_back(KHR_DF_VERSION_1_3 | (blockSize << 16));
+    words.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | ((srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16));
+    words.push_back(3 | (3 << 8));                          // 4x4x1x1 texel blocks
+    words.push_back(static_cast<uint32_t>(GetBlockBytes(format)));
+    words.push_back(0);
+    for (uint32_t sample = 0; sample < sampleCount; ++sample) {
+        words.push_back((sample * 64) | (63 << 16) | (sample << 24));
+        words.push_back(0);
+        words.push_back(0);
+        words.push_back(0xFFFFFFFFu);
+    }
+    return words;
+}
+
+size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+bool GetKTX2BlockFormat(uint32_t vkFormat, BlockFormat &format, bool &srgb) {
+    srgb = vkFormat == VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    switch (vkFormat) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK: format = BlockFormat::BC1; return true;
+        case VK_FORMAT_BC4_UNORM_BLOCK:    format = BlockFormat::BC4; return true;
+        case VK_FORMAT_BC5_UNORM_BLOCK:    format = BlockFormat::BC5; return true;
+        default:                           return false;
+    }
+}
+
+uint32_t GetKTX2Format(BlockFormat format, bool srgb) {
+    switch (format) {
+        case BlockFormat::BC1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BlockFormat::BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+        default:               return VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+}
+
+bool WriteKTX2File(const std::string &path, BlockFormat format, bool srgb, uint32_t width, uint32_t height,
+                   const std::vector<std::vector<unsigned char>> &levels) {
+    if (!IsLittleEndian()) {
+        std::cout << "KTX2 file not written: big-endian hosts are not supported" << std::endl;
+        return false;
+    }
+    
+    std::vector<uint32_t> descriptor = BuildDataFormatDescriptor(format, srgb);
+    FileHeader header = {};
+    std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(header.identifier));
+    header.vkFormat = GetKTX2Format(format, srgb);
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.faceCount = 1;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(FileHeader) + levels.size() * sizeof(LevelIndex));
+    header.dfdByteLength = static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t));
+    
+    // Level data follows the descriptor, smallest level first, each aligned to a block
+    std::vector<LevelIndex> index(levels.size());
+    size_t offset = header.dfdByteOffset + header.dfdByteLength;
+    for (size_t level = levels.size(); level-- > 0;) {
+        offset = AlignUp(offset, GetBlockBytes(format));
+        index[level].byteOffset = offset;
+        index[level].byteLength = levels[level].size();
+        index[level].uncompressedByteLength = levels[level].size();
+        offset += levels[level].size();
+    }
+    
+    bool written = WriteFileReplacing(path, [&](std::ostream &out) {
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(LevelIndex)));
+        out.write(reinterpret_cast<const char*>(descriptor.data()), header.dfdByteLength);
+        size_t end = header.dfdByteOffset + header.dfdByteLength;
+        const char padding[16] = {};
+        for (size_t level = levels.size(); level-- > 0;) {
+            out.write(padding, static_cast<std::streamsize>(index[level].byteOffset - end));
+            out.write(reinterpret_cast<const char*>(levels[level].data()), static_cast<std::streamsize>(levels[level].size()));
+            end = index[level].byteOffset + levels[level].size();
+        }
+    });
+    if (!written)
+        std::cout << "Failed to write KTX2 file " << path << std::endl;
+    return written;
+}
+
+bool KTX2File::Open(const std::string &path) {
+    Close();
+    
+    if (!file.Open(path)) {
+        std::cout << "Failed to open KTX2 file " << path << std::endl;
+        return false;
+    }
+    
+    auto reject = [&](const char* reason) {
+        std::cout << "KTX2 file " << path << " " << reason << std::endl;
+        Close();
+        return false;
+    };
+    
+    if (!IsLittleEndian())
+        return reject("needs a little-endian host");
+    
+    const unsigned char* data = file.GetData();
+    size_t size = file.GetSize();
+    FileHeader header;
+    if (size < sizeof(header))
+        return reject("is truncated");
+    std::memcpy(&header, data, sizeof(header));
+    
+    if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(header.identifier)) != 0)
+        return reject("is not a KTX2 file");
+    if (!GetKTX2BlockFormat(header.vkFormat, format, srgb))
+        return reject("has an unsupported format");
+    if (header.supercompressionScheme != 0)
+        return reject("is supercompressed");
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 ||
+        header.layerCount > 1 || header.faceCount != 1)
+        return reject("is not a 2D texture");
+    
+    // A level count of 0 asks for generated mips; only the base level is stored then
+    size_t levelCount = std::max<uint32_t>(header.levelCount, 1);
+    if (levelCount > 32)
+        return reject("has too many levels");
+    if (sizeof(header) + levelCount * sizeof(LevelIndex) > size)
+        return reject("is truncated");
+    std::vector<LevelIndex> index(levelCount);
+    std::memcpy(index.data(), data + sizeof(header), levelCount * sizeof(LevelIndex));
+    
+    width = header.pixelWidth;
+    height = header.pixelHeight;
+    levels.resize(levelCount);
+    for (size_t level = 0; level < levelCount; ++level) {
+        uint32_t levelWidth = std::max(1u, width >> level);
+        uint32_t levelHeight = std::max(1u, height >> level);
+        const LevelIndex &entry = index[level];
+        if (entry.byteOffset > size || entry.byteLength > size - entry.byteOffset)
+            return reject("is truncated");
+        if (entry.byteLength < GetCompressedSize(format, levelWidth, levelHeight))
+            return reject("has a level smaller than its size");
+        levels[level].data = data + entry.byteOffset;
+        levels[level].size = static_cast<size_t>(entry.byteLength);
+    }
+    return true;
+}
+
+void KTX2File::Close() {
+    file.Close();
+    levels.clear();
+    width = 0;
+    height = 0;
+}
+
+BlockFormat KTX2File::GetBlockFormat() const {
+    return format;
+}
+
+bool KTX2File::IsSRGB() const {
+    return srgb;
+}
+
+uint32_t KTX2File::GetWidth() const {
+    return width;
+}
+
+uint32_t KTX2File::GetHeight() const {
+    return height;
+}
+
+size_t KTX2File::GetLevelCount() const {
+    return levels.size();
+}
+
+const KTX2Level& KTX2File::GetLevel(size_t level) const {
+    return levels[level];
+}
+
+size_t KTX2File::GetFileSize() const {
+    return file.GetSize();
+}
@@ -0,0 +1,121 @@
+#include "../include/MappedFile.h"
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MAPPED_FILE_POSIX
+#endif
+
+MappedFile::MappedFile() : data(nullptr), size(0), mapped(false) {
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string &path) {
+    Close();
+
+#ifdef MAPPED_FILE_POSIX
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    
+    // Empty files cannot be mapped and hold no asset anyway
+    if (info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view != MAP_FAILED) {
+        data = static_cast<const unsigned char*>(view);
+        size = static_cast<size_t>(info.st_size);
+        mapped = true;
+        return true;
+    }
+#endif
+
+    // Read the whole file instead
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    size = static_cast<size_t>(file.tellg());
+    if (size == 0)
+        return false;
+    buffer.resize(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), size);
+    data = buffer.data();
+    return true;
+}
+
+void MappedFile::Close() {
+#ifdef MAPPED_FILE_POSIX
+    if (mapped)
+        munmap(const_cast<unsigned char*>(data), size);
+#endif
+    std::vector<unsigned char>().swap(buffer);
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+const unsigned char* MappedFile::GetData() const {
+    return data;
+}
+
+size_t MappedFile::GetSize() const {
+    return size;
+}
+
+bool MappedFile::IsOpen() const {
+    return data != nullptr;
+}
+
+bool IsLittleEndian() {
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+bool WriteFileReplacing(const std::string &path, const std::function<void(std::ostream &out)> &writer) {
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    if (!directory.empty())
+        std::filesystem::create_directories(directory, error);
+    
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        writer(out);
+        out.close();
+        if (!out) {
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+    
+    // std::filesystem::rename replaces an existing file in one step, so the old file
+    // stays readable until the new one takes its place
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
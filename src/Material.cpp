@@ -1,100 +1,219 @@
 #include "../include/Material.h"
+#include "../include/MaterialRegistry.h"
+#include <unordered_map>
+#include <iostream>
+#include <cmath>
 
 Material::Material() 
     : albedo(glm::vec3(1.0f)), 
       metallic(0.0f), 
       roughness(0.5f), 
       ao(1.0f),
+      albedoMap(0),
+      normalMap(0),
+      metallicMap(0),
+      roughnessMap(0),
+      aoMap(0),
+      ormMap(0),
       useAlbedoMap(false),
       useNormalMap(false),
       useMetallicMap(false),
       useRoughnessMap(false),
-      useAoMap(false) {
+      useAoMap(false),
+      useOrmMap(false),
+      registryID(INVALID_MATERIAL_ID) {
 }
 
-void Material::Apply(Shader &shader) {
-    // Set material properties
-    shader.setVec3("material.albedo", albedo);
-    shader.setFloat("material.metallic", metallic);
-    shader.setFloat("material.roughness", roughness);
-    shader.setFloat("material.ao", ao);
-    
-    // Set texture usage flags
-    shader.setBool("material.useAlbedoMap", useAlbedoMap);
-    shader.setBool("material.useNormalMap", useNormalMap);
-    shader.setBool("material.useMetallicMap", useMetallicMap);
-    shader.setBool("material.useRoughnessMap", useRoughnessMap);
-    shader.setBool("material.useAoMap", useAoMap);
-    
-    // Bind textures if they are used
-    if (useAlbedoMap) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, albedoMap);
-        shader.setInt("material.albedoMap", 0);
-    }
-    
-    if (useNormalMap) {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, normalMap);
-        shader.setInt("material.normalMap", 1);
-    }
+namespace {
+
+// Index uniform handles, resolved once per shader program
+std::unordered_map<unsigned int, UniformHandle> materialIndexUniforms;
+
+UniformHandle GetMaterialIndexUniform(Shader &shader) {
+    auto it = materialIndexUniforms.find(shader.ID);
+    if (it != materialIndexUniforms.end())
+        return it->second;
     
-    if (useMetallicMap) {
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, metallicMap);
-        shader.setInt("material.metallicMap", 2);
+    UniformHandle handle = shader.uniform("materialIndex");
+    materialIndexUniforms.emplace(shader.ID, handle);
+    return handle;
+}
+
+// Loader the Load*Map calls stream through, if any; held weakly, so a destroyed loader
+// leaves them loading synchronously rather than dangling
+std::weak_ptr<AsyncTextureLoader> asyncTextureLoader;
+
+// Drawing unregistered materials is reported once rather than every draw
+bool unregisteredApplyReported = false;
+
+unsigned char ToByte(float value) {
+    return static_cast<unsigned char>(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// Albedo placeholders go into sRGB textures
+unsigned char ToSRGBByte(float value) {
+    value = glm::clamp(value, 0.0f, 1.0f);
+    value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<unsigned char>(value * 255.0f + 0.5f);
+}
+
+// Load a map through the texture cache and the async loader if one is set; placeholder is
+// what a newly loaded map shows until then
+TextureRef LoadMapTexture(const char* path, MipFilter filter, const unsigned char placeholder[4]) {
+    return TextureLoader::LoadSharedTexture(path, filter, asyncTextureLoader.lock().get(), placeholder);
+}
+
+// Placeholder texel holding a scalar property in every channel
+TextureRef LoadScalarMapTexture(const char* path, float value) {
+    unsigned char placeholder[4] = {ToByte(value), ToByte(value), ToByte(value), 255};
+    return LoadMapTexture(path, MipFilter::Linear, placeholder);
+}
+
+}
+
+void Material::Apply(Shader &shader) {
+    // Scalars live in the registry's parameter buffer; only the slot index is set here
+    if (registryID != INVALID_MATERIAL_ID) {
+        shader.setInt(GetMaterialIndexUniform(shader), static_cast<int>(registryID));
+    } else if (!unregisteredApplyReported) {
+        std::cout << "Material::Apply called on an unregistered material; register materials with a "
+                  << "MaterialRegistry before drawing." << std::endl;
+        unregisteredApplyReported = true;
     }
     
-    if (useRoughnessMap) {
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, roughnessMap);
-        shader.setInt("material.roughnessMap", 3);
+    // Bind textures if they are used
+    for (unsigned int unit = 0; unit < MATERIAL_TEXTURE_UNIT_COUNT; ++unit) {
+        unsigned int texture = GetTexture(static_cast<MaterialTextureUnit>(unit));
+        if (texture != 0) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+        }
     }
-    
-    if (useAoMap) {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, aoMap);
-        shader.setInt("material.aoMap", 4);
+}
+
+unsigned int Material::GetTexture(MaterialTextureUnit unit) const {
+    switch (unit) {
+        case ALBEDO_TEXTURE_UNIT:    return useAlbedoMap ? albedoMap : 0;
+        case NORMAL_TEXTURE_UNIT:    return useNormalMap ? normalMap : 0;
+        case METALLIC_TEXTURE_UNIT:  return useMetallicMap ? metallicMap : 0;
+        case ROUGHNESS_TEXTURE_UNIT: return useRoughnessMap ? roughnessMap : 0;
+        case AO_TEXTURE_UNIT:        return useAoMap ? aoMap : 0;
+        case ORM_TEXTURE_UNIT:       return useOrmMap ? ormMap : 0;
+        default:                     return 0;
     }
 }
 
+bool Material::SameAs(const Material &other) const {
+    return MaterialKey(*this) == MaterialKey(other);
+}
+
 void Material::LoadAlbedoMap(const char* path) {
-    albedoMap = TextureLoader::LoadTexture(path, true);
-    useAlbedoMap = true;
+    unsigned char placeholder[4] = {ToSRGBByte(albedo.x), ToSRGBByte(albedo.y), ToSRGBByte(albedo.z), 255};
+    SetTexture(ALBEDO_TEXTURE_UNIT, LoadMapTexture(path, MipFilter::SRGB, placeholder));
 }
 
 void Material::LoadNormalMap(const char* path) {
-    normalMap = TextureLoader::LoadTexture(path, false);
-    useNormalMap = true;
+    SetTexture(NORMAL_TEXTURE_UNIT, LoadMapTexture(path, MipFilter::Normal, PLACEHOLDER_FLAT_NORMAL));
 }
 
 void Material::LoadMetallicMap(const char* path) {
-    metallicMap = TextureLoader::LoadTexture(path, false);
-    useMetallicMap = true;
+    SetTexture(METALLIC_TEXTURE_UNIT, LoadScalarMapTexture(path, metallic));
 }
 
 void Material::LoadRoughnessMap(const char* path) {
-    roughnessMap = TextureLoader::LoadTexture(path, false);
-    useRoughnessMap = true;
+    SetTexture(ROUGHNESS_TEXTURE_UNIT, LoadScalarMapTexture(path, roughness));
 }
 
 void Material::LoadAoMap(const char* path) {
-    aoMap = TextureLoader::LoadTexture(path, false);
-    useAoMap = true;
+    SetTexture(AO_TEXTURE_UNIT, LoadScalarMapTexture(path, ao));
+}
+
+void Material::LoadOrmMap(const char* path) {
+    unsigned char placeholder[4] = {ToByte(ao), ToByte(roughness), ToByte(metallic), 255};
+    SetOrmTexture(LoadMapTexture(path, MipFilter::Linear, placeholder));
+}
+
+void Material::PackOrmMaps(const char* aoPath, const char* roughnessPath, const char* metallicPath) {
+    // Attaching the map resets the scalars to 1, so a missing map's channel holds its scalar
+    unsigned char constants[ORM_CHANNEL_COUNT] = {ToByte(ao), ToByte(roughness), ToByte(metallic)};
+    SetOrmTexture(TextureLoader::LoadSharedORMTexture(aoPath, roughnessPath, metallicPath, constants));
+}
+
+void Material::SetAsyncTextureLoader(AsyncTextureLoader* loader) {
+    asyncTextureLoader = loader ? loader->GetHandle() : std::weak_ptr<AsyncTextureLoader>();
 }
 
 void Material::SetAlbedo(const glm::vec3 &color) {
     albedo = color;
+    Unregister();
 }
 
 void Material::SetMetallic(float value) {
     metallic = value;
+    Unregister();
 }
 
 void Material::SetRoughness(float value) {
     roughness = value;
+    Unregister();
 }
 
 void Material::SetAo(float value) {
     ao = value;
+    Unregister();
+}
+
+void Material::SetTexture(MaterialTextureUnit unit, unsigned int texture) {
+    bool used = texture != 0;
+    switch (unit) {
+        case ALBEDO_TEXTURE_UNIT:    albedoMap = texture;    useAlbedoMap = used;    break;
+        case NORMAL_TEXTURE_UNIT:    normalMap = texture;    useNormalMap = used;    break;
+        case METALLIC_TEXTURE_UNIT:  metallicMap = texture;  useMetallicMap = used;  break;
+        case ROUGHNESS_TEXTURE_UNIT: roughnessMap = texture; useRoughnessMap = used; break;
+        case AO_TEXTURE_UNIT:        aoMap = texture;        useAoMap = used;        break;
+        case ORM_TEXTURE_UNIT:       ormMap = texture;       useOrmMap = used;       break;
+        default:                     return;
+    }
+    mapReferences[unit] = TextureRef();
+    Unregister();
+    
+    // pbr.fs scales each map by its scalar; attaching one resets the scalar to 1, so the
+    // map is used as is unless a factor is set afterwards, as the glTF import does
+    if (used) {
+        switch (unit) {
+            case ALBEDO_TEXTURE_UNIT:    albedo = glm::vec3(1.0f);         break;
+            case METALLIC_TEXTURE_UNIT:  metallic = 1.0f;                  break;
+            case ROUGHNESS_TEXTURE_UNIT: roughness = 1.0f;                 break;
+            case AO_TEXTURE_UNIT:        ao = 1.0f;                        break;
+            case ORM_TEXTURE_UNIT:       ao = roughness = metallic = 1.0f; break;
+            default:                                                       break;
+        }
+    }
+    
+    // pbr.fs samples either the packed map or the separate ones, so a separate map replaces it
+    bool ormChannel = unit == METALLIC_TEXTURE_UNIT || unit == ROUGHNESS_TEXTURE_UNIT || unit == AO_TEXTURE_UNIT;
+    if (used && ormChannel) {
+        ormMap = 0;
+        useOrmMap = false;
+        mapReferences[ORM_TEXTURE_UNIT] = TextureRef();
+    }
+}
+
+void Material::SetTexture(MaterialTextureUnit unit, const TextureRef &texture) {
+    SetTexture(unit, texture.Get());
+    if (unit < MATERIAL_TEXTURE_UNIT_COUNT)
+        mapReferences[unit] = texture;
+}
+
+void Material::Unregister() {
+    registryID = INVALID_MATERIAL_ID;
+    registrySlot.reset();
+}
+
+void Material::SetOrmTexture(const TextureRef &texture) {
+    // The packed map supersedes the separate ones, which would only cost bindings
+    SetTexture(METALLIC_TEXTURE_UNIT, 0u);
+    SetTexture(ROUGHNESS_TEXTURE_UNIT, 0u);
+    SetTexture(AO_TEXTURE_UNIT, 0u);
+    SetTexture(ORM_TEXTURE_UNIT, texture);
 }
@@ -0,0 +1,128 @@
+#include "../include/MaterialRegistry.h"
+#include <iostream>
+
+MaterialKey::MaterialKey(const Material &material)
+    : albedo(material.albedo), metallic(material.metallic), roughness(material.roughness), ao(material.ao) {
+    for (unsigned int unit = 0; unit < MATERIAL_TEXTURE_UNIT_COUNT; ++unit)
+        textures[unit] = material.GetTexture(static_cast<MaterialTextureUnit>(unit));
+}
+
+bool MaterialKey::operator==(const MaterialKey &other) const {
+    if (albedo != other.albedo || metallic != other.metallic || roughness != other.roughness || ao != other.ao)
+        return false;
+    
+    for (unsigned int unit = 0; unit < MATERIAL_TEXTURE_UNIT_COUNT; ++unit) {
+        if (textures[unit] != other.textures[unit])
+            return false;
+    }
+    return true;
+}
+
+MaterialSlot::MaterialSlot(unsigned int id, const Material &material,
+                           const std::shared_ptr<std::vector<unsigned int>> &freeIDs)
+    : id(id), key(material), freeIDs(freeIDs) {
+}
+
+MaterialSlot::~MaterialSlot() {
+    if (std::shared_ptr<std::vector<unsigned int>> ids = freeIDs.lock())
+        ids->push_back(id);
+}
+
+MaterialRegistry::MaterialRegistry()
+    : freeIDs(std::make_shared<std::vector<unsigned int>>()), overflowReported(false), UBO(0) {
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialParams), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, UBO);
+}
+
+MaterialRegistry::~MaterialRegistry() {
+    glDeleteBuffers(1, &UBO);
+}
+
+void MaterialRegistry::Attach(Shader &shader) const {
+    shader.bindUniformBlock("MaterialBlock", BINDING_POINT);
+    
+    // Sampler units never change, so they are assigned once here
+    shader.use();
+    shader.setInt("albedoMap", ALBEDO_TEXTURE_UNIT);
+    shader.setInt("normalMap", NORMAL_TEXTURE_UNIT);
+    shader.setInt("metallicMap", METALLIC_TEXTURE_UNIT);
+    shader.setInt("roughnessMap", ROUGHNESS_TEXTURE_UNIT);
+    shader.setInt("aoMap", AO_TEXTURE_UNIT);
+    shader.setInt("ormMap", ORM_TEXTURE_UNIT);
+}
+
+unsigned int MaterialRegistry::Register(Material &material) {
+    if (material.registryID != INVALID_MATERIAL_ID)
+        return material.registryID;
+    
+    // Share the slot of an identical material
+    MaterialKey key(material);
+    for (unsigned int id = 0; id < slots.size(); ++id) {
+        std::shared_ptr<MaterialSlot> slot = slots[id].lock();
+        if (slot && slot->key == key) {
+            material.registrySlot = slot;
+            material.registryID = id;
+            return id;
+        }
+    }
+    
+    // Reuse a released slot before growing; another material never stands in for this one
+    unsigned int id;
+    if (!freeIDs->empty()) {
+        id = freeIDs->back();
+        freeIDs->pop_back();
+    } else if (slots.size() < MAX_MATERIALS) {
+        id = static_cast<unsigned int>(slots.size());
+        slots.emplace_back();
+    } else {
+        if (!overflowReported) {
+            std::cout << "ERROR::MATERIAL_REGISTRY: more than " << MAX_MATERIALS
+                      << " materials in use; the rest are not registered and will not be drawn." << std::endl;
+            overflowReported = true;
+        }
+        return INVALID_MATERIAL_ID;
+    }
+    
+    std::shared_ptr<MaterialSlot> slot = std::make_shared<MaterialSlot>(id, material, freeIDs);
+    slots[id] = slot;
+    material.registrySlot = slot;
+    material.registryID = id;
+    
+    writeSlot(id, material);
+    return id;
+}
+
+void MaterialRegistry::Register(Model &model) {
+    for (unsigned int i = 0; i < model.meshes.size(); i++) {
+        Register(model.meshes[i].material);
+    }
+}
+
+unsigned int MaterialRegistry::GetMaterialCount() const {
+    return static_cast<unsigned int>(slots.size() - freeIDs->size());
+}
+
+void MaterialRegistry::writeSlot(unsigned int id, const Material &material) {
+    // Pack the scalars and map flags into this material's slot
+    MaterialParams params;
+    params.albedo = material.albedo;
+    params.metallic = material.metallic;
+    params.roughness = material.roughness;
+    params.ao = material.ao;
+    params.flags = 0;
+    if (material.useAlbedoMap)    params.flags |= MATERIAL_ALBEDO_MAP;
+    if (material.useNormalMap)    params.flags |= MATERIAL_NORMAL_MAP;
+    if (material.useMetallicMap)  params.flags |= MATERIAL_METALLIC_MAP;
+    if (material.useRoughnessMap) params.flags |= MATERIAL_ROUGHNESS_MAP;
+    if (material.useAoMap)        params.flags |= MATERIAL_AO_MAP;
+    if (material.useOrmMap)       params.flags |= MATERIAL_ORM_MAP;
+    params.padding = 0.0f;
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, id * sizeof(MaterialParams), sizeof(MaterialParams), &params);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
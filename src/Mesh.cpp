@@ -1,12 +1,122 @@
 #include "../include/Mesh.h"
+#include <utility>
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, Material material) {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->material = material;
+unsigned int Mesh::liveGLObjects = 0;
+
+Mesh::Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, Material material,
+           VertexFormat format, MeshStorage storage)
+    // Reorder for the post-transform cache, overdraw and sequential vertex fetch. The
+    // arrays are bound by reference, so OptimizeMesh runs before anything is moved.
+    : Mesh(std::move(vertices), std::move(indices), OptimizeMesh(vertices, indices),
+           std::move(material), format, storage) {
+}
+
+Mesh::Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices,
+           const MeshOptimizationStats &optimizationStats, Material material,
+           VertexFormat format, MeshStorage storage) {
+    this->vertices = std::move(vertices);
+    this->material = std::move(material);
+    this->format = format;
+    this->storage = storage;
+    this->optimizationStats = optimizationStats;
+    vertexCount = this->vertices.size();
+    indexCount = indices.size();
+    ComputeBounds(this->vertices.data(), vertexCount, boundsMin, boundsMax);
+    
+    indexType = SelectIndexType(vertexCount);
+    if (indexType == GL_UNSIGNED_SHORT)
+        indices16.assign(indices.begin(), indices.end());
+    else
+        indices32 = std::move(indices);
     
     // Now that we have all the required data, set the vertex buffers and its attribute pointers
-    setupMesh();
+    const void* indexData = indexType == GL_UNSIGNED_SHORT ? static_cast<const void*>(indices16.data())
+                                                           : static_cast<const void*>(indices32.data());
+    if (format == VertexFormat::Packed) {
+        std::vector<PackedVertex> packed(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+            packed[i] = PackVertex(this->vertices[i]);
+        setupMesh(packed.data(), indexData);
+    } else {
+        setupMesh(this->vertices.data(), indexData);
+    }
+    
+    if (storage == MeshStorage::GPUOnly)
+        releaseCPUData();
+}
+
+Mesh::Mesh(const MeshBufferView &buffers, Material material, MeshStorage storage) {
+    this->material = std::move(material);
+    this->format = buffers.format;
+    this->storage = storage;
+    optimizationStats = buffers.optimizationStats;
+    vertexCount = buffers.vertexCount;
+    indexCount = buffers.indexCount;
+    indexType = buffers.indexType;
+    boundsMin = buffers.boundsMin;
+    boundsMax = buffers.boundsMax;
+    
+    setupMesh(buffers.vertexData, buffers.indexData);
+    
+    if (storage == MeshStorage::Retained) {
+        // Retained vertices are always kept at full precision
+        if (format == VertexFormat::Packed) {
+            const PackedVertex* packed = static_cast<const PackedVertex*>(buffers.vertexData);
+            vertices.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; ++i)
+                vertices[i] = UnpackVertex(packed[i]);
+        } else {
+            const Vertex* source = static_cast<const Vertex*>(buffers.vertexData);
+            vertices.assign(source, source + vertexCount);
+        }
+        if (indexType == GL_UNSIGNED_SHORT) {
+            const uint16_t* source = static_cast<const uint16_t*>(buffers.indexData);
+            indices16.assign(source, source + indexCount);
+        } else {
+            const uint32_t* source = static_cast<const uint32_t*>(buffers.indexData);
+            indices32.assign(source, source + indexCount);
+        }
+    }
+}
+
+Mesh::~Mesh() {
+    releaseGLObjects();
+}
+
+Mesh::Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)), material(std::move(other.material)),
+      format(other.format), storage(other.storage),
+      VAO(other.VAO), VBO(other.VBO), EBO(other.EBO),
+      indices16(std::move(other.indices16)), indices32(std::move(other.indices32)),
+      indexType(other.indexType), vertexCount(other.vertexCount), indexCount(other.indexCount),
+      boundsMin(other.boundsMin), boundsMax(other.boundsMax), optimizationStats(other.optimizationStats),
+      instanceBuffer(other.instanceBuffer), instanceNormalOffset(other.instanceNormalOffset) {
+    other.VAO = other.VBO = other.EBO = 0;
+}
+
+Mesh& Mesh::operator=(Mesh &&other) noexcept {
+    if (this != &other) {
+        releaseGLObjects();
+        vertices = std::move(other.vertices);
+        material = std::move(other.material);
+        format = other.format;
+        storage = other.storage;
+        VAO = other.VAO;
+        VBO = other.VBO;
+        EBO = other.EBO;
+        instanceBuffer = other.instanceBuffer;
+        instanceNormalOffset = other.instanceNormalOffset;
+        indices16 = std::move(other.indices16);
+        indices32 = std::move(other.indices32);
+        indexType = other.indexType;
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        boundsMin = other.boundsMin;
+        boundsMax = other.boundsMax;
+        optimizationStats = other.optimizationStats;
+        other.VAO = other.VBO = other.EBO = 0;
+    }
+    return *this;
 }
 
 void Mesh::Draw(Shader &shader) {
@@ -15,31 +125,157 @@ void Mesh::Draw(Shader &shader) {
     
     // Draw mesh
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    DrawElements();
     glBindVertexArray(0);
     
     // Set back to defaults
     glActiveTexture(GL_TEXTURE0);
 }
 
-void Mesh::setupMesh() {
+void Mesh::DrawElements() const {
+    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(GetIndexCount()), indexType, 0);
+}
+
+void Mesh::DrawElementsInstanced(unsigned int instanceCount) const {
+    glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(GetIndexCount()), indexType, 0, instanceCount);
+}
+
+void Mesh::SetInstanceBuffer(unsigned int instanceVBO, size_t normalMatrixOffset) {
+    if (instanceBuffer == instanceVBO && instanceNormalOffset == normalMatrixOffset)
+        return;
+    
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    
+    // Instance model matrix, one vec4 column per location
+    for (unsigned int column = 0; column < 4; ++column) {
+        unsigned int location = 5 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void*)(column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    
+    // Instance normal matrix, one vec3 column per location
+    for (unsigned int column = 0; column < 3; ++column) {
+        unsigned int location = 9 + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3),
+                              (void*)(normalMatrixOffset + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    instanceBuffer = instanceVBO;
+    instanceNormalOffset = normalMatrixOffset;
+}
+
+unsigned int Mesh::GetVAO() const {
+    return VAO;
+}
+
+const MeshOptimizationStats& Mesh::GetOptimizationStats() const {
+    return optimizationStats;
+}
+
+GLenum Mesh::GetIndexType() const {
+    return indexType;
+}
+
+size_t Mesh::GetIndexCount() const {
+    return indexCount;
+}
+
+size_t Mesh::GetIndexBufferSize() const {
+    return indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+}
+
+unsigned int Mesh::GetIndex(size_t i) const {
+    return indexType == GL_UNSIGNED_SHORT ? indices16[i] : indices32[i];
+}
+
+size_t Mesh::GetVertexCount() const {
+    return vertexCount;
+}
+
+bool Mesh::HasCPUData() const {
+    return !vertices.empty();
+}
+
+const glm::vec3& Mesh::GetBoundsMin() const {
+    return boundsMin;
+}
+
+const glm::vec3& Mesh::GetBoundsMax() const {
+    return boundsMax;
+}
+
+size_t Mesh::GetHostMemorySize() const {
+    return vertices.capacity() * sizeof(Vertex) +
+           indices16.capacity() * sizeof(uint16_t) +
+           indices32.capacity() * sizeof(uint32_t);
+}
+
+size_t Mesh::GetGPUMemorySize() const {
+    return vertexCount * GetVertexSize(format) + GetIndexBufferSize();
+}
+
+unsigned int Mesh::GetLiveGLObjectCount() {
+    return liveGLObjects;
+}
+
+GLenum Mesh::SelectIndexType(size_t vertexCount) {
+    // 8-bit indices are skipped on purpose: many GPUs lack native support and the
+    // driver widens them on upload, so 16 bits is the narrowest type worth using
+    return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void Mesh::releaseGLObjects() {
+    if (VAO == 0)
+        return;
+    
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+    liveGLObjects -= 3;
+}
+
+void Mesh::releaseCPUData() {
+    // clear() keeps the allocation, so swap with empty vectors instead
+    std::vector<Vertex>().swap(vertices);
+    std::vector<uint16_t>().swap(indices16);
+    std::vector<uint32_t>().swap(indices32);
+}
+
+void Mesh::setupMesh(const void* vertexData, const void* indexData) {
     // Create buffers/arrays
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
+    liveGLObjects += 3;
     
     glBindVertexArray(VAO);
     
     // Load data into vertex buffer
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * GetVertexSize(format), vertexData, GL_STATIC_DRAW);
     
     // Load data into element buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GetIndexBufferSize(), indexData, GL_STATIC_DRAW);
+    
     // Set the vertex attribute pointers
+    if (format == VertexFormat::Packed)
+        setupPackedAttributes();
+    else
+        setupStandardAttributes();
     
+    glBindVertexArray(0);
+}
+
+void Mesh::setupStandardAttributes() {
     // Vertex positions
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -59,6 +295,20 @@ void Mesh::setupMesh() {
     // Vertex bitangent
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+void Mesh::setupPackedAttributes() {
+    // Vertex positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)0);
     
-    glBindVertexArray(0);
+    // Octahedral normal, tangent angle and bitangent sign, normalized to [0, 1]
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex),
+                          (void*)offsetof(PackedVertex, TangentFrame));
+    
+    // Vertex texture coords as half floats
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                          (void*)offsetof(PackedVertex, TexCoords));
 }
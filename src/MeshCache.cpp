@@ -0,0 +1,308 @@
+#include "../include/MeshCache.h"
+#include "../include/Hash.h"
+#include <iostream>
+#include <cstring>
+
+namespace {
+
+const char MESH_CACHE_MAGIC[4] = {'P', 'B', 'R', 'M'};
+
+// Stream offsets are aligned so the mapped vertex data can be read in place
+const size_t STREAM_ALIGNMENT = 16;
+
+// On-disk layout. Every field is naturally aligned and stored little-endian;
+// the streams follow the tables at the offsets recorded in each MeshRecord.
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceKey;         // Identifies what the cache was built from
+    uint64_t payloadChecksum;   // Hash64 chained over the tables and then each stream
+    uint64_t payloadSize;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t vertexSize;        // sizeof(Vertex) and sizeof(PackedVertex) at build time
+    uint32_t packedVertexSize;
+};
+
+struct MeshRecord {
+    uint64_t vertexOffset;      // From the start of the file
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexType;         // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t vertexFormat;      // VertexFormat
+    int32_t material;
+    uint32_t triangleCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    float acmrBefore, atvrBefore;
+    float acmrAfter, atvrAfter;
+};
+
+struct MaterialRecord {
+    float albedo[3];
+    float metallic;
+    float roughness;
+    float ao;
+};
+
+static_assert(sizeof(FileHeader) == 48, "FileHeader layout changed");
+static_assert(sizeof(MeshRecord) == 80, "MeshRecord layout changed");
+static_assert(sizeof(MaterialRecord) == 24, "MaterialRecord layout changed");
+
+size_t AlignUp(size_t value) {
+    return (value + STREAM_ALIGNMENT - 1) & ~(STREAM_ALIGNMENT - 1);
+}
+
+size_t IndexSize(uint32_t indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+}
+
+void MeshCacheWriter::AddMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                              const MeshOptimizationStats &optimizationStats, VertexFormat format, int material) {
+    Entry entry;
+    entry.material = material;
+    entry.view.vertexCount = vertices.size();
+    entry.view.indexCount = indices.size();
+    entry.view.format = format;
+    entry.view.indexType = Mesh::SelectIndexType(vertices.size());
+    entry.view.optimizationStats = optimizationStats;
+    ComputeBounds(vertices.data(), vertices.size(), entry.view.boundsMin, entry.view.boundsMax);
+    
+    entry.vertexData.resize(vertices.size() * GetVertexSize(format));
+    if (format == VertexFormat::Packed) {
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            PackedVertex packed = PackVertex(vertices[i]);
+            std::memcpy(&entry.vertexData[i * sizeof(PackedVertex)], &packed, sizeof(PackedVertex));
+        }
+    } else if (!vertices.empty()) {
+        std::memcpy(entry.vertexData.data(), vertices.data(), entry.vertexData.size());
+    }
+    
+    entry.indexData.resize(indices.size() * IndexSize(entry.view.indexType));
+    if (entry.view.indexType == GL_UNSIGNED_SHORT) {
+        for (size_t i = 0; i < indices.size(); ++i) {
+            uint16_t index = static_cast<uint16_t>(indices[i]);
+            std::memcpy(&entry.indexData[i * sizeof(uint16_t)], &index, sizeof(uint16_t));
+        }
+    } else if (!indices.empty()) {
+        std::memcpy(entry.indexData.data(), indices.data(), entry.indexData.size());
+    }
+    
+    entries.push_back(std::move(entry));
+}
+
+void MeshCacheWriter::AddMaterial(const MeshCacheMaterial &material) {
+    materials.push_back(material);
+}
+
+bool MeshCacheWriter::Write(const std::string &path, uint64_t sourceKey) const {
+    if (!IsLittleEndian()) {
+        std::cout << "Mesh cache not written: big-endian hosts are not supported" << std::endl;
+        return false;
+    }
+    
+    // Assign every stream its aligned offset
+    size_t tablesEnd = sizeof(FileHeader) + entries.size() * sizeof(MeshRecord) + materials.size() * sizeof(MaterialRecord);
+    size_t fileSize = AlignUp(tablesEnd);
+    std::vector<MeshRecord> records(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry &entry = entries[i];
+        MeshRecord &record = records[i];
+        std::memset(&record, 0, sizeof(record));
+        record.vertexOffset = fileSize;
+        fileSize = AlignUp(fileSize + entry.vertexData.size());
+        record.indexOffset = fileSize;
+        fileSize = AlignUp(fileSize + entry.indexData.size());
+        record.vertexCount = static_cast<uint32_t>(entry.view.vertexCount);
+        record.indexCount = static_cast<uint32_t>(entry.view.indexCount);
+        record.indexType = entry.view.indexType;
+        record.vertexFormat = static_cast<uint32_t>(entry.view.format);
+        record.material = entry.material;
+        record.triangleCount = static_cast<uint32_t>(entry.view.optimizationStats.triangleCount);
+        for (int axis = 0; axis < 3; ++axis) {
+            record.boundsMin[axis] = entry.view.boundsMin[axis];
+            record.boundsMax[axis] = entry.view.boundsMax[axis];
+        }
+        record.acmrBefore = entry.view.optimizationStats.before.acmr;
+        record.atvrBefore = entry.view.optimizationStats.before.atvr;
+        record.acmrAfter = entry.view.optimizationStats.after.acmr;
+        record.atvrAfter = entry.view.optimizationStats.after.atvr;
+    }
+    
+    std::vector<unsigned char> tables(tablesEnd - sizeof(FileHeader));
+    if (!records.empty())
+        std::memcpy(tables.data(), records.data(), records.size() * sizeof(MeshRecord));
+    size_t offset = records.size() * sizeof(MeshRecord);
+    for (const MeshCacheMaterial &material : materials) {
+        MaterialRecord record = {{material.albedo.x, material.albedo.y, material.albedo.z},
+                                 material.metallic, material.roughness, material.ao};
+        std::memcpy(&tables[offset], &record, sizeof(record));
+        offset += sizeof(record);
+    }
+    
+    // The checksum chains the tables and every stream in file order, so it can be
+    // computed without assembling the file in memory
+    uint64_t checksum = Hash64(tables.data(), tables.size());
+    for (const Entry &entry : entries) {
+        checksum = Hash64(entry.vertexData.data(), entry.vertexData.size(), checksum);
+        checksum = Hash64(entry.indexData.data(), entry.indexData.size(), checksum);
+    }
+    
+    FileHeader header;
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.sourceKey = sourceKey;
+    header.payloadChecksum = checksum;
+    header.payloadSize = fileSize - sizeof(FileHeader);
+    header.meshCount = static_cast<uint32_t>(entries.size());
+    header.materialCount = static_cast<uint32_t>(materials.size());
+    header.vertexSize = sizeof(Vertex);
+    header.packedVertexSize = sizeof(PackedVertex);
+    
+    bool written = WriteFileReplacing(path, [&](std::ostream &out) {
+        const char padding[STREAM_ALIGNMENT] = {};
+        size_t end = 0;
+        auto write = [&](const void* bytes, size_t count) {
+            out.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(count));
+            end += count;
+        };
+        auto pad = [&]() { write(padding, AlignUp(end) - end); };
+        
+        write(&header, sizeof(header));
+        write(tables.data(), tables.size());
+        pad();
+        for (const Entry &entry : entries) {
+            write(entry.vertexData.data(), entry.vertexData.size());
+            pad();
+            write(entry.indexData.data(), entry.indexData.size());
+            pad();
+        }
+    });
+    if (!written)
+        std::cout << "Failed to write mesh cache " << path << std::endl;
+    return written;
+}
+
+bool MeshCache::Open(const std::string &path, uint64_t sourceKey) {
+    Close();
+    
+    if (!file.Open(path))
+        return false;
+    
+    auto reject = [&](const char* reason) {
+        std::cout << "Mesh cache " << path << " " << reason << ", rebuilding" << std::endl;
+        Close();
+        return false;
+    };
+    
+    if (!IsLittleEndian())
+        return reject("needs a little-endian host");
+    
+    const unsigned char* data = file.GetData();
+    size_t size = file.GetSize();
+    FileHeader header;
+    if (size < sizeof(header))
+        return reject("is truncated");
+    std::memcpy(&header, data, sizeof(header));
+    
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0)
+        return reject("is not a mesh cache");
+    if (header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex) ||
+        header.packedVertexSize != sizeof(PackedVertex))
+        return reject("is from another version");
+    if (header.sourceKey != sourceKey)
+        return reject("is stale");
+    if (header.payloadSize != size - sizeof(header))
+        return reject("is truncated");
+    
+    size_t tablesEnd = sizeof(header) + static_cast<size_t>(header.meshCount) * sizeof(MeshRecord) +
+                       static_cast<size_t>(header.materialCount) * sizeof(MaterialRecord);
+    if (tablesEnd > size)
+        return reject("is truncated");
+    
+    const unsigned char* materialTable = data + sizeof(header) + header.meshCount * sizeof(MeshRecord);
+    materials.resize(header.materialCount);
+    for (size_t i = 0; i < materials.size(); ++i) {
+        MaterialRecord record;
+        std::memcpy(&record, materialTable + i * sizeof(MaterialRecord), sizeof(record));
+        materials[i].albedo = glm::vec3(record.albedo[0], record.albedo[1], record.albedo[2]);
+        materials[i].metallic = record.metallic;
+        materials[i].roughness = record.roughness;
+        materials[i].ao = record.ao;
+    }
+    
+    meshes.resize(header.meshCount);
+    meshMaterials.resize(header.meshCount);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        MeshRecord record;
+        std::memcpy(&record, data + sizeof(header) + i * sizeof(MeshRecord), sizeof(record));
+        
+        if ((record.indexType != GL_UNSIGNED_SHORT && record.indexType != GL_UNSIGNED_INT) ||
+            record.vertexFormat > static_cast<uint32_t>(VertexFormat::Packed) ||
+            record.material >= static_cast<int32_t>(header.materialCount))
+            return reject("has an invalid mesh table");
+        
+        MeshBufferView &view = meshes[i];
+        view.format = static_cast<VertexFormat>(record.vertexFormat);
+        view.indexType = record.indexType;
+        view.vertexCount = record.vertexCount;
+        view.indexCount = record.indexCount;
+        size_t vertexBytes = view.vertexCount * GetVertexSize(view.format);
+        size_t indexBytes = view.indexCount * IndexSize(view.indexType);
+        if (record.vertexOffset < tablesEnd || record.vertexOffset > size || vertexBytes > size - record.vertexOffset ||
+            record.indexOffset < tablesEnd || record.indexOffset > size || indexBytes > size - record.indexOffset ||
+            record.vertexOffset % STREAM_ALIGNMENT != 0 || record.indexOffset % STREAM_ALIGNMENT != 0)
+            return reject("has an invalid mesh table");
+        view.vertexData = data + record.vertexOffset;
+        view.indexData = data + record.indexOffset;
+        view.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        view.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+        view.optimizationStats.before.acmr = record.acmrBefore;
+        view.optimizationStats.before.atvr = record.atvrBefore;
+        view.optimizationStats.after.acmr = record.acmrAfter;
+        view.optimizationStats.after.atvr = record.atvrAfter;
+        view.optimizationStats.vertexCount = record.vertexCount;
+        view.optimizationStats.triangleCount = record.triangleCount;
+        meshMaterials[i] = record.material;
+    }
+    
+    // One pass over the streams; the pages it faults in are the ones glBufferData reads next
+    uint64_t checksum = Hash64(data + sizeof(header), tablesEnd - sizeof(header));
+    for (const MeshBufferView &view : meshes) {
+        checksum = Hash64(view.vertexData, view.vertexCount * GetVertexSize(view.format), checksum);
+        checksum = Hash64(view.indexData, view.indexCount * IndexSize(view.indexType), checksum);
+    }
+    if (checksum != header.payloadChecksum)
+        return reject("failed its checksum");
+    return true;
+}
+
+void MeshCache::Close() {
+    file.Close();
+    meshes.clear();
+    meshMaterials.clear();
+    materials.clear();
+}
+
+size_t MeshCache::GetMeshCount() const {
+    return meshes.size();
+}
+
+const MeshBufferView& MeshCache::GetMesh(size_t i) const {
+    return meshes[i];
+}
+
+int MeshCache::GetMeshMaterial(size_t i) const {
+    return meshMaterials[i];
+}
+
+const std::vector<MeshCacheMaterial>& MeshCache::GetMaterials() const {
+    return materials;
+}
+
+size_t MeshCache::GetFileSize() const {
+    return file.GetSize();
+}
@@ -0,0 +1,314 @@
+#include "../include/MeshOptimizer.h"
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+
+namespace {
+
+// Scoring parameters from Forsyth's reference implementation
+const unsigned int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// Likelihood that emitting a triangle using this vertex reuses the cache, plus a
+// bonus for vertices with few triangles left so they are finished off early
+float VertexScore(int cachePosition, unsigned int remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1.0f;
+    
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // Vertices of the last triangle get a fixed score so the next one does not just reuse an edge
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+size_t CountReferencedVertices(const std::vector<unsigned int> &indices, size_t vertexCount) {
+    std::vector<bool> referenced(vertexCount, false);
+    size_t count = 0;
+    for (unsigned int index : indices) {
+        if (!referenced[index]) {
+            referenced[index] = true;
+            count++;
+        }
+    }
+    return count;
+}
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                    unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indices.empty())
+        return stats;
+    
+    // A vertex hits while fewer than cacheSize misses happened since it was last loaded
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices) {
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    
+    stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / CountReferencedVertices(indices, vertexCount);
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+    
+    // Triangles using each vertex; the live ones are kept at the front of each range
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+    
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScores[v] = VertexScore(-1, remaining[v]);
+    
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    
+    long best = static_cast<long>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+    size_t scanCursor = 0;
+    
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left: continue with the next unemitted one
+            while (emitted[scanCursor])
+                ++scanCursor;
+            best = static_cast<long>(scanCursor);
+        }
+        
+        emitted[best] = true;
+        const unsigned int* triangle = &indices[best * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+        
+        // Remove the triangle from its vertices' live lists
+        for (unsigned int k = 0; k < 3; ++k) {
+            unsigned int v = triangle[k];
+            unsigned int* list = &adjacency[adjacencyOffsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; ++j) {
+                if (list[j] == static_cast<unsigned int>(best)) {
+                    list[j] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        
+        // Move the triangle's vertices to the front of the LRU cache; the overflow
+        // past the cache size is kept for this step so evicted vertices get rescored
+        newCache.clear();
+        for (unsigned int k = 0; k < 3; ++k) {
+            if (std::find(newCache.begin(), newCache.end(), triangle[k]) == newCache.end())
+                newCache.push_back(triangle[k]);
+        }
+        for (unsigned int v : cache) {
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+        }
+        
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            unsigned int v = newCache[i];
+            cachePositions[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+            vertexScores[v] = VertexScore(cachePositions[v], remaining[v]);
+        }
+        
+        // Rescore the live triangles around cached vertices and pick the best of them
+        best = -1;
+        float bestScore = -std::numeric_limits<float>::max();
+        for (unsigned int v : newCache) {
+            const unsigned int* list = &adjacency[adjacencyOffsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; ++j) {
+                unsigned int t = list[j];
+                float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = static_cast<long>(t);
+                }
+            }
+        }
+        
+        if (newCache.size() > FORSYTH_CACHE_SIZE)
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(newCache);
+    }
+    
+    indices.swap(output);
+}
+
+void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+    
+    std::vector<unsigned int> timestamps(vertices.size(), 0);
+    unsigned int time = VERTEX_CACHE_SIZE + 1;
+    auto triangleMisses = [&](size_t t) {
+        unsigned int misses = 0;
+        for (unsigned int k = 0; k < 3; ++k) {
+            unsigned int index = indices[t * 3 + k];
+            if (time - timestamps[index] > VERTEX_CACHE_SIZE) {
+                timestamps[index] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+    auto flushCache = [&]() {
+        time += VERTEX_CACHE_SIZE + 1;
+    };
+    
+    // Hard boundaries: triangles where every vertex misses, i.e. the cache optimizer
+    // jumped to an unrelated region. Reordering there costs nothing extra.
+    std::vector<size_t> hardClusters;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (triangleMisses(t) == 3)
+            hardClusters.push_back(t);
+    }
+    if (hardClusters.empty() || hardClusters[0] != 0)
+        hardClusters.insert(hardClusters.begin(), 0);
+    hardClusters.push_back(triangleCount);
+    
+    // Soft boundaries: split further wherever the piece drawn so far, simulated from a
+    // cold cache, is already within threshold of the whole cluster's ACMR
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); ++c) {
+        size_t start = hardClusters[c];
+        size_t end = hardClusters[c + 1];
+        
+        flushCache();
+        unsigned int clusterMisses = 0;
+        for (size_t t = start; t < end; ++t)
+            clusterMisses += triangleMisses(t);
+        float clusterAcmr = static_cast<float>(clusterMisses) / (end - start);
+        
+        clusters.push_back(start);
+        flushCache();
+        size_t pieceStart = start;
+        unsigned int pieceMisses = 0;
+        for (size_t t = start; t < end; ++t) {
+            pieceMisses += triangleMisses(t);
+            float pieceAcmr = static_cast<float>(pieceMisses) / (t - pieceStart + 1);
+            if (t + 1 < end && pieceAcmr <= clusterAcmr * threshold) {
+                clusters.push_back(t + 1);
+                pieceStart = t + 1;
+                pieceMisses = 0;
+                flushCache();
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+    
+    glm::vec3 meshCentroid(0.0f);
+    for (const Vertex &vertex : vertices)
+        meshCentroid = meshCentroid + vertex.Position;
+    meshCentroid = meshCentroid / static_cast<float>(vertices.size());
+    
+    // Clusters facing away from the mesh center are likely to occlude the rest, so draw them first
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+            float faceArea = glm::length(faceNormal);
+            centroid = centroid + (p0 + p1 + p2) * (faceArea / 3.0f);
+            normal = normal + faceNormal;
+            area += faceArea;
+        }
+        
+        float normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f)
+            sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+        else
+            sortKeys[c] = 0.0f;
+    }
+    
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+    
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (size_t c : order)
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    indices.swap(output);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    const unsigned int UNUSED = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    
+    for (unsigned int &index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+MeshOptimizationStats OptimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    auto start = std::chrono::high_resolution_clock::now();
+    
+    MeshOptimizationStats stats;
+    stats.before = AnalyzeVertexCache(indices, vertices.size());
+    
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+    
+    stats.after = AnalyzeVertexCache(indices, vertices.size());
+    stats.vertexCount = vertices.size();
+    stats.triangleCount = indices.size() / 3;
+    stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
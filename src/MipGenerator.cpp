@@ -0,0 +1,296 @@
+#include "../include/MipGenerator.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MIP_GENERATOR_USE_SSE 1
+#endif
+
+namespace {
+
+// Levels with fewer rows are filtered on the calling thread
+const int PARALLEL_MIN_ROWS = 64;
+
+// Buckets of [0, 1] linear values the sRGB encoder starts its search from
+const int SRGB_ENCODE_BUCKETS = 4096;
+
+// Byte to float decoding tables of each kind of channel, and the linear values halfway
+// between neighbouring sRGB codes that encoding compares against to round as
+// LinearToSRGB(value) * 255 + 0.5 would
+struct ChannelTables {
+    float unorm[256];
+    float srgb[256];
+    float snorm[256];
+    float srgbThresholds[256];      // The last one is never reached
+    unsigned char srgbBucketCodes[SRGB_ENCODE_BUCKETS + 1];
+    
+    ChannelTables() {
+        for (int code = 0; code < 256; ++code) {
+            unorm[code] = code / 255.0f;
+            srgb[code] = SRGBToLinear(code / 255.0f);
+            snorm[code] = code * (2.0f / 255.0f) - 1.0f;
+        }
+        for (int code = 0; code < 255; ++code)
+            srgbThresholds[code] = SRGBToLinear((code + 0.5f) / 255.0f);
+        srgbThresholds[255] = 2.0f;
+        
+        // Code of each bucket's lowest value; a bucket spans at most a few codes
+        int code = 0;
+        for (int bucket = 0; bucket <= SRGB_ENCODE_BUCKETS; ++bucket) {
+            while (static_cast<float>(bucket) / SRGB_ENCODE_BUCKETS >= srgbThresholds[code])
+                code++;
+            srgbBucketCodes[bucket] = static_cast<unsigned char>(code);
+        }
+    }
+    
+    static float SRGBToLinear(float value) {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    
+    // Table channel c of an image filtered with filter decodes through
+    const float* GetDecodeTable(MipFilter filter, int c) const {
+        if (c < 3 && filter == MipFilter::SRGB)
+            return srgb;
+        if (c < 3 && filter == MipFilter::Normal)
+            return snorm;
+        return unorm;
+    }
+};
+
+const ChannelTables& GetChannelTables() {
+    static ChannelTables tables;
+    return tables;
+}
+
+unsigned char EncodeSRGB(float value, const ChannelTables &tables) {
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    int code = tables.srgbBucketCodes[static_cast<int>(value * SRGB_ENCODE_BUCKETS)];
+    while (value >= tables.srgbThresholds[code])
+        code++;
+    return static_cast<unsigned char>(code);
+}
+
+unsigned char ToByte(float value) {
+    return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Filtering works on four floats per texel whatever the component count, so a texel is
+// one SSE register; unused channels are zero
+void DecodeRow(const unsigned char* row, int width, int components, MipFilter filter, float* out) {
+    const ChannelTables &tables = GetChannelTables();
+    const float* decode[4];
+    for (int c = 0; c < 4; ++c)
+        decode[c] = tables.GetDecodeTable(filter, c);
+    
+    std::fill(out, out + static_cast<size_t>(width) * 4, 0.0f);
+    for (int x = 0; x < width; ++x) {
+        const unsigned char* texel = row + static_cast<size_t>(x) * components;
+        float* decoded = out + static_cast<size_t>(x) * 4;
+        for (int c = 0; c < components; ++c)
+            decoded[c] = decode[c][texel[c]];
+    }
+}
+
+void EncodeRow(const float* row, int width, int components, MipFilter filter, unsigned char* out) {
+    const ChannelTables &tables = GetChannelTables();
+    if (filter == MipFilter::SRGB) {
+        for (int x = 0; x < width; ++x) {
+            const float* texel = row + static_cast<size_t>(x) * 4;
+            unsigned char* encoded = out + static_cast<size_t>(x) * components;
+            for (int c = 0; c < 3; ++c)
+                encoded[c] = EncodeSRGB(texel[c], tables);
+            if (components == 4)
+                encoded[3] = ToByte(texel[3]);
+        }
+        return;
+    }
+    
+    // Normals map [-1, 1] to [0, 1] first
+    float scale[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    float bias[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    if (filter == MipFilter::Normal) {
+        for (int c = 0; c < 3; ++c) {
+            scale[c] = 0.5f;
+            bias[c] = 0.5f;
+        }
+    }
+    for (int x = 0; x < width; ++x) {
+        const float* texel = row + static_cast<size_t>(x) * 4;
+        unsigned char* encoded = out + static_cast<size_t>(x) * components;
+        for (int c = 0; c < components; ++c)
+            encoded[c] = ToByte(texel[c] * scale[c] + bias[c]);
+    }
+}
+
+// Average 2x2 footprints of two source rows into one destination row; normals are
+// renormalized, a zero-length average becoming +Z
+void FilterRow(const float* row0, const float* row1, int sourceWidth, int width, bool normalize, float* out) {
+    for (int x = 0; x < width; ++x) {
+        size_t x0 = static_cast<size_t>(std::min(2 * x, sourceWidth - 1)) * 4;
+        size_t x1 = static_cast<size_t>(std::min(2 * x + 1, sourceWidth - 1)) * 4;
+        float* texel = out + static_cast<size_t>(x) * 4;
+#ifdef MIP_GENERATOR_USE_SSE
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+        sum = _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+        if (normalize) {
+            __m128 squared = _mm_mul_ps(sum, sum);
+            __m128 dot = _mm_add_ss(_mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1))),
+                                    _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 2, 2, 2)));
+            float lengthSquared = _mm_cvtss_f32(dot);
+            if (lengthSquared < 1e-12f) {
+                _mm_storeu_ps(texel, sum);
+                texel[0] = texel[1] = 0.0f;
+                texel[2] = 1.0f;
+                continue;
+            }
+            float scale = 1.0f / std::sqrt(lengthSquared);
+            sum = _mm_mul_ps(sum, _mm_set_ps(1.0f, scale, scale, scale));
+        }
+        _mm_storeu_ps(texel, sum);
+#else
+        for (int c = 0; c < 4; ++c)
+            texel[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+        if (normalize) {
+            float lengthSquared = texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2];
+            if (lengthSquared < 1e-12f) {
+                texel[0] = texel[1] = 0.0f;
+                texel[2] = 1.0f;
+                continue;
+            }
+            float scale = 1.0f / std::sqrt(lengthSquared);
+            for (int c = 0; c < 3; ++c)
+                texel[c] *= scale;
+        }
+#endif
+    }
+}
+
+// Fraction of texels whose alpha, scaled, passes an alpha test at cutoff
+float AlphaCoverage(const float* texels, size_t count, float scale, float cutoff) {
+    size_t passing = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (texels[i * 4 + 3] * scale >= cutoff)
+            passing++;
+    }
+    return static_cast<float>(passing) / count;
+}
+
+// Alpha scale at which a level's coverage comes closest to the target; coverage only
+// grows with the scale, so a bisection brackets it
+float FindAlphaScale(const float* texels, size_t count, float cutoff, float targetCoverage) {
+    float low = 0.0f, high = 4.0f;
+    for (int i = 0; i < 16; ++i) {
+        float middle = (low + high) * 0.5f;
+        if (AlphaCoverage(texels, count, middle, cutoff) < targetCoverage)
+            low = middle;
+        else
+            high = middle;
+    }
+    // Coverage moves in steps, so take whichever side lands closer
+    float lowError = std::fabs(AlphaCoverage(texels, count, low, cutoff) - targetCoverage);
+    float highError = std::fabs(AlphaCoverage(texels, count, high, cutoff) - targetCoverage);
+    return lowError < highError ? low : high;
+}
+
+void ForEachRow(int rows, ThreadPool* pool, const std::function<void(size_t)> &body) {
+    if (pool && rows >= PARALLEL_MIN_ROWS)
+        pool->ParallelFor(static_cast<size_t>(rows), body);
+    else
+        for (int row = 0; row < rows; ++row)
+            body(static_cast<size_t>(row));
+}
+
+}
+
+const unsigned char* MipChain::GetLevelData(size_t index) const {
+    return pixels.data() + levels[index].offset;
+}
+
+int GetMipLevelCount(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1)
+        levels++;
+    return levels;
+}
+
+MipChain GenerateMipChain(const unsigned char* pixels, int width, int height, int components, MipFilter filter,
+                          ThreadPool* pool, float alphaCoverageCutoff) {
+    // GL has no one- or two-channel sRGB formats, and two-channel normals are rebuilt in the shader
+    if (components < 3)
+        filter = MipFilter::Linear;
+    bool preserveCoverage = filter == MipFilter::SRGB && components == 4 && alphaCoverageCutoff > 0.0f;
+    
+    MipChain chain;
+    chain.levels.reserve(GetMipLevelCount(width, height) - 1);
+    size_t bytes = 0;
+    for (int levelWidth = width, levelHeight = height; levelWidth > 1 || levelHeight > 1;) {
+        levelWidth = std::max(1, levelWidth / 2);
+        levelHeight = std::max(1, levelHeight / 2);
+        MipChain::Level level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.offset = bytes;
+        chain.levels.push_back(level);
+        bytes += static_cast<size_t>(levelWidth) * levelHeight * components;
+    }
+    chain.pixels.resize(bytes);
+    if (chain.levels.empty())
+        return chain;
+    
+    float targetCoverage = 0.0f;
+    if (preserveCoverage) {
+        size_t passing = 0;
+        size_t texels = static_cast<size_t>(width) * height;
+        unsigned char threshold = static_cast<unsigned char>(std::ceil(alphaCoverageCutoff * 255.0f));
+        for (size_t i = 0; i < texels; ++i) {
+            if (pixels[i * 4 + 3] >= threshold)
+                passing++;
+        }
+        targetCoverage = static_cast<float>(passing) / texels;
+        // Fully opaque or fully cut out images have nothing to keep
+        preserveCoverage = passing > 0 && passing < texels;
+    }
+    
+    // The level above, unrounded; level 1 decodes its source rows from the bytes instead
+    std::vector<float> previous, current;
+    int sourceWidth = width, sourceHeight = height;
+    bool normalize = filter == MipFilter::Normal;
+    for (size_t index = 0; index < chain.levels.size(); ++index) {
+        const MipChain::Level &level = chain.levels[index];
+        current.resize(static_cast<size_t>(level.width) * level.height * 4);
+        unsigned char* levelPixels = chain.pixels.data() + level.offset;
+        ForEachRow(level.height, pool, [&](size_t y) {
+            size_t y0 = std::min<size_t>(2 * y, sourceHeight - 1);
+            size_t y1 = std::min<size_t>(2 * y + 1, sourceHeight - 1);
+            float* out = current.data() + y * level.width * 4;
+            if (index == 0) {
+                // Two decoded source rows, reused across the rows a thread filters
+                thread_local std::vector<float> rows;
+                rows.resize(static_cast<size_t>(sourceWidth) * 8);
+                size_t rowBytes = static_cast<size_t>(sourceWidth) * components;
+                DecodeRow(pixels + y0 * rowBytes, sourceWidth, components, filter, rows.data());
+                DecodeRow(pixels + y1 * rowBytes, sourceWidth, components, filter, rows.data() + sourceWidth * 4);
+                FilterRow(rows.data(), rows.data() + sourceWidth * 4, sourceWidth, level.width, normalize, out);
+            } else {
+                FilterRow(previous.data() + y0 * sourceWidth * 4, previous.data() + y1 * sourceWidth * 4,
+                          sourceWidth, level.width, normalize, out);
+            }
+            EncodeRow(out, level.width, components, filter, levelPixels + y * level.width * components);
+        });
+        
+        // Only the stored alpha is scaled; the next level filters the unscaled values
+        if (preserveCoverage) {
+            size_t texels = static_cast<size_t>(level.width) * level.height;
+            float scale = FindAlphaScale(current.data(), texels, alphaCoverageCutoff, targetCoverage);
+            for (size_t i = 0; i < texels; ++i)
+                levelPixels[i * 4 + 3] = ToByte(current[i * 4 + 3] * scale);
+        }
+        
+        previous.swap(current);
+        sourceWidth = level.width;
+        sourceHeight = level.height;
+    }
+    return chain;
+}
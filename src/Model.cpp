@@ -1,11 +1,52 @@
 #include "../include/Model.h"
+#include "../include/Transforms.h"
+#include "../include/MeshCache.h"
+#include "../include/Hash.h"
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
 #include <cmath>
+#include <algorithm>
+#include <utility>
+#include <chrono>
 
-Model::Model() {
+std::string Model::meshCacheDirectory;
+
+namespace {
+
+// Stable text description of a mesh source; floats in hex so they round-trip exactly
+std::string DescribeSource(const char* kind, std::initializer_list<double> parameters, VertexFormat format) {
+    std::ostringstream description;
+    description << kind << std::hexfloat;
+    for (double parameter : parameters)
+        description << " " << parameter;
+    description << " format " << static_cast<int>(format);
+    return description.str();
 }
 
-void Model::CreateSphere(unsigned int xSegments, unsigned int ySegments, float radius, Material material) {
+}
+
+Model::Model() : meshStorage(MeshStorage::GPUOnly), instanceVBO(0), instanceCapacity(0), textureBytes(0) {
+}
+
+Model::~Model() {
+    if (instanceVBO != 0)
+        glDeleteBuffers(1, &instanceVBO);
+    if (!textures.empty())
+        glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+}
+
+void Model::SetMeshStorage(MeshStorage storage) {
+    meshStorage = storage;
+}
+
+void Model::CreateSphere(unsigned int xSegments, unsigned int ySegments, float radius, Material material,
+                         VertexFormat format) {
+    std::string identity = DescribeSource("sphere", {double(xSegments), double(ySegments), radius}, format);
+    if (loadCachedMesh(identity, material, format))
+        return;
+    
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -58,10 +99,14 @@ void Model::CreateSphere(unsigned int xSegments, unsigned int ySegments, float r
         }
     }
     
-    meshes.push_back(Mesh(vertices, indices, material));
+    addGeneratedMesh(identity, std::move(vertices), std::move(indices), material, format);
 }
 
-void Model::CreateCube(float size, Material material) {
+void Model::CreateCube(float size, Material material, VertexFormat format) {
+    std::string identity = DescribeSource("cube", {size}, format);
+    if (loadCachedMesh(identity, material, format))
+        return;
+    
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -172,10 +217,14 @@ void Model::CreateCube(float size, Material material) {
     indices.push_back(20); indices.push_back(21); indices.push_back(22);
     indices.push_back(22); indices.push_back(23); indices.push_back(20);
     
-    meshes.push_back(Mesh(vertices, indices, material));
+    addGeneratedMesh(identity, std::move(vertices), std::move(indices), material, format);
 }
 
-void Model::CreatePlane(float width, float height, Material material) {
+void Model::CreatePlane(float width, float height, Material material, VertexFormat format) {
+    std::string identity = DescribeSource("plane", {width, height}, format);
+    if (loadCachedMesh(identity, material, format))
+        return;
+    
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     
@@ -221,13 +270,194 @@ void Model::CreatePlane(float width, float height, Material material) {
     indices.push_back(3);
     indices.push_back(0);
     
-    meshes.push_back(Mesh(vertices, indices, material));
+    addGeneratedMesh(identity, std::move(vertices), std::move(indices), material, format);
+}
+
+bool Model::LoadModel(const std::string &path, VertexFormat format, unsigned int threadCount) {
+    // The cache is keyed on the file's size and modification time, so editing the
+    // model invalidates it without hashing the whole file on every load
+    std::string cachePath;
+    uint64_t sourceKey = 0;
+    std::error_code sizeError, timeError;
+    std::string absolutePath = std::filesystem::absolute(path, sizeError).string();
+    std::string identity = DescribeSource(("gltf " + absolutePath).c_str(), {}, format);
+    uintmax_t fileSize = std::filesystem::file_size(path, sizeError);
+    auto modified = std::filesystem::last_write_time(path, timeError).time_since_epoch().count();
+    if (!sizeError && !timeError) {
+        cachePath = getMeshCachePath(identity);
+        std::string sourceVersion = identity + " " + std::to_string(fileSize) + " " + std::to_string(modified);
+        sourceKey = Hash64(sourceVersion.data(), sourceVersion.size());
+    }
+    
+    loadStats = GLTFLoadStats();
+    auto cacheStart = std::chrono::high_resolution_clock::now();
+    MeshCache cache;
+    bool cached = !cachePath.empty() && cache.Open(cachePath, sourceKey);
+    double cacheMilliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - cacheStart).count();
+    
+    GLTFScene scene;
+    {
+        ThreadPool pool(threadCount);
+        if (!GLTFLoader::Load(path, pool, scene, loadStats, !cached))
+            return false;
+    }
+    loadStats.fromMeshCache = cached;
+    loadStats.meshCacheMilliseconds = cacheMilliseconds;
+    
+    if (!cached && !cachePath.empty()) {
+        cacheStart = std::chrono::high_resolution_clock::now();
+        MeshCacheWriter writer;
+        for (const GLTFMaterial &source : scene.materials)
+            writer.AddMaterial({source.albedo, source.metallic, source.roughness, source.ao});
+        for (const GLTFPrimitive &primitive : scene.primitives) {
+            if (!primitive.vertices.empty())
+                writer.AddMesh(primitive.vertices, primitive.indices, primitive.optimizationStats, format,
+                               primitive.material);
+        }
+        if (writer.Write(cachePath, sourceKey))
+            std::cout << "Wrote mesh cache " << cachePath << std::endl;
+        loadStats.meshCacheMilliseconds = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - cacheStart).count();
+    }
+    
+    auto uploadStart = std::chrono::high_resolution_clock::now();
+    
+    // Images that failed to decode stay 0 and leave their material map disabled
+    std::vector<unsigned int> imageTextures(scene.images.size(), 0);
+    for (size_t i = 0; i < scene.images.size(); ++i) {
+        GLTFImage &image = scene.images[i];
+        if (image.pixels.empty())
+            continue;
+        imageTextures[i] = TextureLoader::CreateTexture(image.pixels.data(), image.width, image.height,
+                                                        image.components, image.filter, &image.mips);
+        textures.push_back(imageTextures[i]);
+        textureBytes += image.pixels.size() + image.mips.pixels.size();
+        std::vector<unsigned char>().swap(image.pixels);
+        image.mips = MipChain();
+    }
+    
+    std::vector<Material> materials(scene.materials.size());
+    for (size_t i = 0; i < scene.materials.size(); ++i) {
+        const GLTFMaterial &source = scene.materials[i];
+        for (unsigned int unit = 0; unit < MATERIAL_TEXTURE_UNIT_COUNT; ++unit) {
+            if (source.images[unit] >= 0)
+                materials[i].SetTexture(static_cast<MaterialTextureUnit>(unit), imageTextures[source.images[unit]]);
+        }
+        
+        // Factors after the maps, which reset them; pbr.fs multiplies the two
+        materials[i].SetAlbedo(source.albedo);
+        materials[i].SetMetallic(source.metallic);
+        materials[i].SetRoughness(source.roughness);
+        materials[i].SetAo(source.ao);
+    }
+    
+    size_t vertexCount = 0, triangleCount = 0;
+    if (cached) {
+        // Mapped streams go straight to glBufferData
+        meshes.reserve(meshes.size() + cache.GetMeshCount());
+        for (size_t i = 0; i < cache.GetMeshCount(); ++i) {
+            const MeshBufferView &buffers = cache.GetMesh(i);
+            vertexCount += buffers.vertexCount;
+            triangleCount += buffers.indexCount / 3;
+            size_t material = static_cast<size_t>(cache.GetMeshMaterial(i));
+            meshes.emplace_back(buffers, material < materials.size() ? materials[material] : Material(), meshStorage);
+        }
+    } else {
+        meshes.reserve(meshes.size() + scene.primitives.size());
+        for (GLTFPrimitive &primitive : scene.primitives) {
+            if (primitive.vertices.empty())
+                continue;
+            vertexCount += primitive.vertices.size();
+            triangleCount += primitive.indices.size() / 3;
+            Material material = primitive.material >= 0 ? materials[primitive.material] : Material();
+            meshes.emplace_back(std::move(primitive.vertices), std::move(primitive.indices), primitive.optimizationStats,
+                                material, format, meshStorage);
+        }
+    }
+    loadStats.uploadMilliseconds = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - uploadStart).count();
+    
+    std::cout << "Loaded " << path << (cached ? " (mesh cache)" : "") << ": " << meshes.size() << " meshes, "
+              << vertexCount << " vertices, " << triangleCount << " triangles, " << textures.size() << " textures"
+              << std::endl;
+    return true;
 }
 
-bool Model::LoadModel(const std::string &path) {
-    // To be implemented using Assimp library
-    std::cout << "Model loading from file not implemented yet." << std::endl;
-    return false;
+const GLTFLoadStats& Model::GetLoadStats() const {
+    return loadStats;
+}
+
+void Model::SetMeshCacheDirectory(const std::string &directory) {
+    meshCacheDirectory = directory;
+}
+
+std::string Model::getMeshCachePath(const std::string &identity) {
+    if (meshCacheDirectory.empty())
+        return std::string();
+    
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << Hash64(identity.data(), identity.size()) << ".meshcache";
+    return (std::filesystem::path(meshCacheDirectory) / name.str()).string();
+}
+
+bool Model::loadCachedMesh(const std::string &identity, const Material &material, VertexFormat format) {
+    std::string cachePath = getMeshCachePath(identity);
+    MeshCache cache;
+    if (cachePath.empty() || !cache.Open(cachePath, Hash64(identity.data(), identity.size())))
+        return false;
+    
+    if (cache.GetMeshCount() != 1 || cache.GetMesh(0).format != format) {
+        std::cout << "Mesh cache " << cachePath << " does not match " << identity << ", rebuilding" << std::endl;
+        return false;
+    }
+    
+    // Generated meshes take the caller's material rather than the cached parameters
+    meshes.emplace_back(cache.GetMesh(0), material, meshStorage);
+    return true;
+}
+
+void Model::addGeneratedMesh(const std::string &identity, std::vector<Vertex> &&vertices,
+                             std::vector<unsigned int> &&indices, const Material &material, VertexFormat format) {
+    MeshOptimizationStats optimizationStats = OptimizeMesh(vertices, indices);
+    
+    std::string cachePath = getMeshCachePath(identity);
+    if (!cachePath.empty()) {
+        MeshCacheWriter writer;
+        writer.AddMaterial({material.albedo, material.metallic, material.roughness, material.ao});
+        writer.AddMesh(vertices, indices, optimizationStats, format, 0);
+        writer.Write(cachePath, Hash64(identity.data(), identity.size()));
+    }
+    
+    meshes.emplace_back(std::move(vertices), std::move(indices), optimizationStats, material, format, meshStorage);
+}
+
+size_t Model::GetIndexBufferSize() const {
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.GetIndexBufferSize();
+    return bytes;
+}
+
+size_t Model::GetIndexCount() const {
+    size_t count = 0;
+    for (const Mesh &mesh : meshes)
+        count += mesh.GetIndexCount();
+    return count;
+}
+
+size_t Model::GetHostMemorySize() const {
+    size_t bytes = instanceNormalMatrices.capacity() * sizeof(glm::mat3);
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.GetHostMemorySize();
+    return bytes;
+}
+
+size_t Model::GetGPUMemorySize() const {
+    size_t bytes = instanceCapacity * (sizeof(glm::mat4) + sizeof(glm::mat3)) + textureBytes;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.GetGPUMemorySize();
+    return bytes;
 }
 
 void Model::Draw(Shader &shader) {
@@ -235,3 +465,40 @@ void Model::Draw(Shader &shader) {
         meshes[i].Draw(shader);
     }
 }
+
+void Model::DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count) {
+    if (count == 0)
+        return;
+    
+    // Normal matrices are computed once per instance here instead of per vertex
+    instanceNormalMatrices.resize(count);
+    ComputeNormalMatrices(transforms, instanceNormalMatrices.data(), count);
+    
+    if (instanceVBO == 0)
+        glGenBuffers(1, &instanceVBO);
+    
+    // Grow the buffer geometrically; otherwise orphan it so the upload never stalls on the previous draw
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (count > instanceCapacity)
+        instanceCapacity = std::max(count, instanceCapacity * 2);
+    size_t normalMatrixOffset = instanceCapacity * sizeof(glm::mat4);
+    glBufferData(GL_ARRAY_BUFFER, normalMatrixOffset + instanceCapacity * sizeof(glm::mat3), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+    glBufferSubData(GL_ARRAY_BUFFER, normalMatrixOffset, count * sizeof(glm::mat3), instanceNormalMatrices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        meshes[i].SetInstanceBuffer(instanceVBO, normalMatrixOffset);
+        meshes[i].material.Apply(shader);
+        
+        glBindVertexArray(meshes[i].GetVAO());
+        meshes[i].DrawElementsInstanced(static_cast<unsigned int>(count));
+    }
+    
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Model::DrawInstanced(Shader &shader, const std::vector<glm::mat4> &transforms) {
+    DrawInstanced(shader, transforms.data(), transforms.size());
+}
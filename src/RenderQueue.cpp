@@ -0,0 +1,125 @@
+#include "../include/RenderQueue.h"
+#include "../include/Transforms.h"
+#include <algorithm>
+
+RenderQueue::RenderQueue(MaterialRegistry &registry) : registry(registry) {
+}
+
+void RenderQueue::Submit(Shader &shader, Model &model, const glm::mat4 &transform) {
+    uint32_t transformIndex = static_cast<uint32_t>(transforms.size());
+    transforms.push_back(transform);
+    
+    for (unsigned int i = 0; i < model.meshes.size(); i++) {
+        Mesh &mesh = model.meshes[i];
+        unsigned int materialID = registry.Register(mesh.material);
+        if (materialID == INVALID_MATERIAL_ID)
+            continue;
+        
+        // Program in the top bits, then material, then VAO, so equal state ends up adjacent
+        DrawCommand command;
+        command.sortKey = (static_cast<uint64_t>(shader.ID & 0xFFFFu) << 48) |
+                          (static_cast<uint64_t>(materialID & 0xFFFFu) << 32) |
+                          static_cast<uint64_t>(mesh.GetVAO());
+        command.shader = &shader;
+        command.mesh = &mesh;
+        command.transformIndex = transformIndex;
+        commands.push_back(command);
+    }
+}
+
+void RenderQueue::Flush() {
+    stats = RenderStats();
+    
+    // One batched pass computes every object's normal matrix
+    normalMatrices.resize(transforms.size());
+    ComputeNormalMatrices(transforms.data(), normalMatrices.data(), transforms.size());
+    
+    // Sort indices rather than the commands themselves
+    order.resize(commands.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return commands[a].sortKey < commands[b].sortKey;
+    });
+    
+    // Bindings made outside the queue are unknown, so start from a clean slate
+    unsigned int currentProgram = 0;
+    unsigned int currentMaterial = INVALID_MATERIAL_ID;
+    unsigned int currentVAO = 0;
+    unsigned int boundTextures[MATERIAL_TEXTURE_UNIT_COUNT] = { 0 };
+    const ProgramUniforms *uniforms = nullptr;
+    
+    for (uint32_t index : order) {
+        const DrawCommand &command = commands[index];
+        Shader &shader = *command.shader;
+        const Material &material = command.mesh->material;
+        
+        if (shader.ID != currentProgram) {
+            shader.use();
+            uniforms = &GetProgramUniforms(shader);
+            currentProgram = shader.ID;
+            currentMaterial = INVALID_MATERIAL_ID;
+            stats.programBinds++;
+        } else {
+            stats.programBindsSkipped++;
+        }
+        
+        if (material.registryID != currentMaterial) {
+            shader.setInt(uniforms->materialIndex, static_cast<int>(material.registryID));
+            
+            // Only touch texture units whose binding actually changes
+            for (unsigned int unit = 0; unit < MATERIAL_TEXTURE_UNIT_COUNT; ++unit) {
+                unsigned int texture = material.GetTexture(static_cast<MaterialTextureUnit>(unit));
+                if (texture == 0 || boundTextures[unit] == texture) {
+                    if (texture != 0)
+                        stats.textureBindsSkipped++;
+                    continue;
+                }
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                boundTextures[unit] = texture;
+                stats.textureBinds++;
+            }
+            
+            currentMaterial = material.registryID;
+            stats.materialBinds++;
+        } else {
+            stats.materialBindsSkipped++;
+        }
+        
+        unsigned int vao = command.mesh->GetVAO();
+        if (vao != currentVAO) {
+            glBindVertexArray(vao);
+            currentVAO = vao;
+            stats.vaoBinds++;
+        } else {
+            stats.vaoBindsSkipped++;
+        }
+        
+        shader.setMat4(uniforms->model, transforms[command.transformIndex]);
+        shader.setMat3(uniforms->normalMatrix, normalMatrices[command.transformIndex]);
+        command.mesh->DrawElements();
+        stats.drawCalls++;
+    }
+    
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+    commands.clear();
+    transforms.clear();
+}
+
+const RenderStats& RenderQueue::GetStats() const {
+    return stats;
+}
+
+const RenderQueue::ProgramUniforms& RenderQueue::GetProgramUniforms(Shader &shader) {
+    auto it = programUniforms.find(shader.ID);
+    if (it != programUniforms.end())
+        return it->second;
+    
+    ProgramUniforms uniforms;
+    uniforms.model = shader.uniform("model");
+    uniforms.normalMatrix = shader.uniform("normalMatrix");
+    uniforms.materialIndex = shader.uniform("materialIndex");
+    return programUniforms.emplace(shader.ID, uniforms).first->second;
+}
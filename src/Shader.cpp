@@ -1,118 +1,304 @@
 #include "../include/Shader.h"
+#include <vector>
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    // 1. Retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    
-    // Ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    
-    try {
-        // Open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        
-        // Read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        
-        // Close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        
-        // Convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (std::ifstream::failure& e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-    }
-    
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+UniformLookupStats Shader::lookupStats;
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines,
+               const char* geometryPath) {
+    // 1. Retrieve the source code of each stage from its file
+    std::string vertexCode = readSource(vertexPath, defines);
+    std::string fragmentCode = readSource(fragmentPath, defines);
+    std::string geometryCode = geometryPath ? readSource(geometryPath, defines) : std::string();
     
     // 2. Compile shaders
-    unsigned int vertex, fragment;
-    
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    
-    // Fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexCode, "VERTEX");
+    unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fragmentCode, "FRAGMENT");
+    unsigned int geometry = geometryPath ? compileStage(GL_GEOMETRY_SHADER, geometryCode, "GEOMETRY") : 0;
     
     // Shader program
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
+    if (geometry != 0)
+        glAttachShader(ID, geometry);
     glAttachShader(ID, fragment);
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
     
+    // Cache every active uniform location up front
+    reflectUniforms();
+    
     // Delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+    if (geometry != 0)
+        glDeleteShader(geometry);
+}
+
+Shader::~Shader() {
+    if (ID != 0)
+        glDeleteProgram(ID);
+}
+
+Shader::Shader(Shader &&other) noexcept
+    : ID(other.ID), uniformLocations(std::move(other.uniformLocations)) {
+    other.ID = 0;
+}
+
+Shader& Shader::operator=(Shader &&other) noexcept {
+    if (this != &other) {
+        if (ID != 0)
+            glDeleteProgram(ID);
+        ID = other.ID;
+        uniformLocations = std::move(other.uniformLocations);
+        other.ID = 0;
+    }
+    return *this;
+}
+
+std::string Shader::readSource(const char* path, const std::vector<std::string> &defines) {
+    std::ifstream file;
+    
+    // Ensure ifstream objects can throw exceptions
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    
+    try {
+        file.open(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        file.close();
+        return injectDefines(resolveIncludes(stream.str(), path), defines);
+    }
+    catch (std::ifstream::failure& e) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << ": " << e.what() << std::endl;
+        return std::string();
+    }
+}
+
+std::string Shader::resolveIncludes(const std::string &source, const char* path) {
+    const std::string directive = "#include \"";
+    if (source.find(directive) == std::string::npos)
+        return source;
+    
+    std::string directory(path);
+    size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+    
+    std::stringstream lines(source);
+    std::string line;
+    std::string resolved;
+    while (std::getline(lines, line)) {
+        size_t end = line.rfind('"');
+        if (line.compare(0, directive.size(), directive) != 0 || end < directive.size()) {
+            resolved += line + "\n";
+            continue;
+        }
+        
+        std::string includePath = directory + line.substr(directive.size(), end - directive.size());
+        std::ifstream file(includePath);
+        if (!file) {
+            std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << " (from " << path << ")" << std::endl;
+            continue;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        resolved += stream.str();
+        if (!resolved.empty() && resolved.back() != '\n')
+            resolved += "\n";
+    }
+    return resolved;
+}
+
+unsigned int Shader::compileStage(GLenum stage, const std::string &source, const std::string &type) {
+    const char* code = source.c_str();
+    unsigned int shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    checkCompileErrors(shader, type);
+    return shader;
 }
 
 void Shader::use() {
     glUseProgram(ID);
 }
 
+bool Shader::bindUniformBlock(const std::string &blockName, unsigned int bindingPoint) const {
+    unsigned int blockIndex = glGetUniformBlockIndex(ID, blockName.c_str());
+    if (blockIndex == GL_INVALID_INDEX)
+        return false;
+    
+    glUniformBlockBinding(ID, blockIndex, bindingPoint);
+    return true;
+}
+
+UniformHandle Shader::uniform(const std::string &name) const {
+    UniformHandle handle;
+    handle.location = findLocation(name);
+    return handle;
+}
+
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(findLocation(name), (int)value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(findLocation(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(findLocation(name), value);
 }
 
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(findLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec2(const std::string &name, float x, float y) const {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(findLocation(name), x, y);
 }
 
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(findLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec3(const std::string &name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(findLocation(name), x, y, z);
 }
 
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(findLocation(name), 1, &value[0]);
 }
 
 void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(findLocation(name), x, y, z, w);
 }
 
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(findLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(findLocation(name), 1, GL_FALSE, &mat[0][0]);
 }
 
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(findLocation(name), 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setBool(UniformHandle handle, bool value) const {
+    glUniform1i(handle.location, (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const {
+    glUniform1i(handle.location, value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const {
+    glUniform1f(handle.location, value);
+}
+
+void Shader::setVec2(UniformHandle handle, const glm::vec2 &value) const {
+    glUniform2fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3 &value) const {
+    glUniform3fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setVec4(UniformHandle handle, const glm::vec4 &value) const {
+    glUniform4fv(handle.location, 1, &value[0]);
+}
+
+void Shader::setMat2(UniformHandle handle, const glm::mat2 &mat) const {
+    glUniformMatrix2fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setMat3(UniformHandle handle, const glm::mat3 &mat) const {
+    glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+}
+
+const UniformLookupStats& Shader::GetLookupStats() {
+    return lookupStats;
+}
+
+void Shader::ResetLookupStats() {
+    lookupStats = UniformLookupStats();
+}
+
+std::string Shader::injectDefines(const std::string &source, const std::vector<std::string> &defines) {
+    if (defines.empty())
+        return source;
+    
+    std::string defineBlock;
+    for (const std::string &define : defines)
+        defineBlock += "#define " + define + "\n";
+    
+    // #version must stay the first statement, so insert right after its line
+    size_t versionPos = source.find("#version");
+    if (versionPos == std::string::npos)
+        return defineBlock + source;
+    
+    size_t lineEnd = source.find('\n', versionPos);
+    if (lineEnd == std::string::npos)
+        return source + "\n" + defineBlock;
+    
+    return source.substr(0, lineEnd + 1) + defineBlock + source.substr(lineEnd + 1);
+}
+
+void Shader::reflectUniforms() {
+    uniformLocations.clear();
+    
+    int uniformCount = 0;
+    int maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    if (uniformCount <= 0 || maxNameLength <= 0)
+        return;
+    
+    std::vector<char> nameBuffer(maxNameLength);
+    for (int i = 0; i < uniformCount; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, (GLuint)i, maxNameLength, &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        
+        int location = glGetUniformLocation(ID, name.c_str());
+        lookupStats.driverLookups++;
+        
+        // Members of uniform blocks have no location
+        if (location < 0)
+            continue;
+        
+        uniformLocations[name] = location;
+        
+        // Arrays are reported once as "name[0]"; register the bare name and every element
+        const std::string arraySuffix = "[0]";
+        if (name.size() > arraySuffix.size() &&
+            name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0) {
+            std::string baseName = name.substr(0, name.size() - arraySuffix.size());
+            uniformLocations[baseName] = location;
+            
+            for (int element = 1; element < size; ++element) {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                int elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                lookupStats.driverLookups++;
+                if (elementLocation >= 0)
+                    uniformLocations[elementName] = elementLocation;
+            }
+        }
+    }
+}
+
+int Shader::findLocation(const std::string &name) const {
+    lookupStats.hashedLookups++;
+    
+    // Names missing from the table are inactive; -1 makes glUniform* a no-op, as before
+    auto it = uniformLocations.find(name);
+    return it != uniformLocations.end() ? it->second : -1;
 }
 
 void Shader::checkCompileErrors(unsigned int shader, std::string type) {
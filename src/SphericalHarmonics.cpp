@@ -0,0 +1,117 @@
+#include "../include/SphericalHarmonics.h"
+#include <vector>
+#include <cmath>
+
+namespace {
+
+// Cosine-lobe convolution per band divided by pi (A_l / pi), times the normalization
+// constant of each basis function in evaluation order
+const float SH_SCALE[SH_COEFFICIENT_COUNT] = {
+    1.0f * 0.282095f,
+    (2.0f / 3.0f) * 0.488603f, (2.0f / 3.0f) * 0.488603f, (2.0f / 3.0f) * 0.488603f,
+    0.25f * 1.092548f, 0.25f * 1.092548f, 0.25f * 0.315392f, 0.25f * 1.092548f, 0.25f * 0.546274f
+};
+
+// Unnormalized basis polynomials: 1, y, z, x, xy, yz, 3z^2 - 1, xz, x^2 - y^2
+void EvaluateBasis(const glm::vec3 &d, float basis[SH_COEFFICIENT_COUNT]) {
+    basis[0] = 1.0f;
+    basis[1] = d.y;
+    basis[2] = d.z;
+    basis[3] = d.x;
+    basis[4] = d.x * d.y;
+    basis[5] = d.y * d.z;
+    basis[6] = 3.0f * d.z * d.z - 1.0f;
+    basis[7] = d.x * d.z;
+    basis[8] = d.x * d.x - d.y * d.y;
+}
+
+// Normalized basis values (Y_lm) used for projection
+const float SH_NORMALIZATION[SH_COEFFICIENT_COUNT] = {
+    0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f
+};
+
+// Radiance-weighted basis sums of one row, plus the row's total solid angle
+struct RowSum {
+    double rgb[SH_COEFFICIENT_COUNT][3] = {};
+    double solidAngle = 0.0;
+};
+
+}
+
+glm::vec3 CubemapTexelDirection(unsigned int face, unsigned int x, unsigned int y, unsigned int size) {
+    // Face coordinates in [-1, 1]; rows run along the t axis of the GL cube map table
+    float s = 2.0f * (x + 0.5f) / size - 1.0f;
+    float t = 2.0f * (y + 0.5f) / size - 1.0f;
+    glm::vec3 direction;
+    switch (face) {
+        case 0: direction = glm::vec3( 1.0f,   -t,   -s); break;
+        case 1: direction = glm::vec3(-1.0f,   -t,    s); break;
+        case 2: direction = glm::vec3(    s, 1.0f,    t); break;
+        case 3: direction = glm::vec3(    s,-1.0f,   -t); break;
+        case 4: direction = glm::vec3(    s,   -t, 1.0f); break;
+        default: direction = glm::vec3(  -s,   -t,-1.0f); break;
+    }
+    return glm::normalize(direction);
+}
+
+IrradianceSH ProjectIrradianceSH(const float *faces, unsigned int size, ThreadPool *pool) {
+    // One partial sum per row keeps the reduction free of locks and its result
+    // independent of the thread count
+    std::vector<RowSum> rows(6 * size);
+    auto projectRow = [&](size_t row) {
+        unsigned int face = static_cast<unsigned int>(row / size);
+        unsigned int y = static_cast<unsigned int>(row % size);
+        const float* texel = faces + row * size * 3;
+        RowSum &sum = rows[row];
+        float t = 2.0f * (y + 0.5f) / size - 1.0f;
+        for (unsigned int x = 0; x < size; ++x, texel += 3) {
+            // Solid angle of the texel: its area on the face over (1 + s^2 + t^2)^(3/2)
+            float s = 2.0f * (x + 0.5f) / size - 1.0f;
+            float lengthSquared = 1.0f + s * s + t * t;
+            float weight = 4.0f / (size * size * lengthSquared * std::sqrt(lengthSquared));
+            
+            float basis[SH_COEFFICIENT_COUNT];
+            EvaluateBasis(CubemapTexelDirection(face, x, y, size), basis);
+            for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i) {
+                float w = basis[i] * SH_NORMALIZATION[i] * weight;
+                sum.rgb[i][0] += texel[0] * w;
+                sum.rgb[i][1] += texel[1] * w;
+                sum.rgb[i][2] += texel[2] * w;
+            }
+            sum.solidAngle += weight;
+        }
+    };
+    if (pool)
+        pool->ParallelFor(rows.size(), projectRow);
+    else
+        for (size_t row = 0; row < rows.size(); ++row)
+            projectRow(row);
+    
+    RowSum total;
+    for (const RowSum &row : rows) {
+        for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+            for (int c = 0; c < 3; ++c)
+                total.rgb[i][c] += row.rgb[i][c];
+        total.solidAngle += row.solidAngle;
+    }
+    
+    // The texel weights sum to slightly less than 4 pi; rescale so a constant environment projects exactly
+    double normalization = total.solidAngle > 0.0 ? 4.0 * M_PI / total.solidAngle : 0.0;
+    IrradianceSH sh;
+    for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i) {
+        double scale = normalization * SH_SCALE[i];
+        sh.coefficients[i] = glm::vec3(static_cast<float>(total.rgb[i][0] * scale),
+                                       static_cast<float>(total.rgb[i][1] * scale),
+                                       static_cast<float>(total.rgb[i][2] * scale));
+    }
+    return sh;
+}
+
+glm::vec3 EvaluateIrradianceSH(const IrradianceSH &sh, const glm::vec3 &normal) {
+    float basis[SH_COEFFICIENT_COUNT];
+    EvaluateBasis(normal, basis);
+    glm::vec3 irradiance(0.0f);
+    for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+        irradiance += sh.coefficients[i] * basis[i];
+    return glm::max(irradiance, glm::vec3(0.0f));
+}
@@ -1,43 +1,376 @@
 #include "../include/TextureLoader.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#include "../include/MappedFile.h"
+#include "../include/Hash.h"
+#include "../include/KTX2.h"
 #include <iostream>
 #include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <algorithm>
+
+struct TextureCacheEntry {
+    unsigned int texture = 0;
+    size_t bytes = 0;
+    bool cached = false;                    // Listed under contentKey and pathKeys
+    uint64_t contentKey = 0;
+    std::vector<std::string> pathKeys;
+    std::weak_ptr<AsyncTextureLoader> asyncLoader;     // Expired if the loader went first
+    
+    ~TextureCacheEntry();
+};
+
+namespace {
+
+// Cached textures by canonical path and by contents; the entries remove themselves
+struct TextureCache {
+    std::unordered_map<std::string, std::weak_ptr<TextureCacheEntry>> byPath;
+    std::unordered_map<uint64_t, std::weak_ptr<TextureCacheEntry>> byContent;
+    TextureCacheStats stats;
+};
+
+TextureCache& GetTextureCache() {
+    static TextureCache cache;
+    return cache;
+}
+
+bool IsKTX2Path(const char* path) {
+    return std::filesystem::path(path).extension() == ".ktx2";
+}
+
+// The same file loaded in another color space, or filtered as normals, is a different texture
+std::string PathKey(const char* path, MipFilter filter) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    const char* suffix = filter == MipFilter::SRGB ? "|srgb" : filter == MipFilter::Normal ? "|normal" : "|linear";
+    return (error ? std::string(path) : canonical.generic_string()) + suffix;
+}
+
+}
+
+TextureCacheEntry::~TextureCacheEntry() {
+    if (cached) {
+        TextureCache &cache = GetTextureCache();
+        for (const std::string &key : pathKeys)
+            cache.byPath.erase(key);
+        cache.byContent.erase(contentKey);
+        cache.stats.liveTextures--;
+        cache.stats.liveBytes -= bytes;
+    }
+    if (std::shared_ptr<AsyncTextureLoader> loader = asyncLoader.lock())
+        loader->Cancel(texture);
+    glDeleteTextures(1, &texture);
+}
+
+unsigned int TextureRef::Get() const {
+    return entry ? entry->texture : 0;
+}
+
+double TextureCacheStats::GetHitRate() const {
+    return requests > 0 ? static_cast<double>(pathHits + contentHits) / requests : 0.0;
+}
 
 unsigned int TextureLoader::LoadTexture(const char* path, bool gamma) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    if (IsKTX2Path(path))
+        return LoadCompressedTexture(path);
     
     int width, height, nrComponents;
     unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
     if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        
+        unsigned int textureID = CreateTexture(data, width, height, nrComponents, gamma ? MipFilter::SRGB : MipFilter::Linear);
         stbi_image_free(data);
+        return textureID;
     }
-    else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+    
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    return textureID;
+}
+
+unsigned int TextureLoader::CreateTexture(const unsigned char* pixels, int width, int height, int components,
+                                          MipFilter filter, const MipChain* mips) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    
+    MipChain generated;
+    if (!mips) {
+        generated = GenerateMipChain(pixels, width, height, components, filter);
+        mips = &generated;
+    }
+    
+    // Rows of 1- and 3-component images are not 4-byte aligned in general
+    GLenum format = GetPixelFormat(components);
+    GLint unpackAlignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    AllocateStorage(width, height, static_cast<int>(mips->levels.size()) + 1, components, filter == MipFilter::SRGB);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+    for (size_t i = 0; i < mips->levels.size(); ++i) {
+        const MipChain::Level &level = mips->levels[i];
+        glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i + 1), 0, 0, level.width, level.height, format,
+                        GL_UNSIGNED_BYTE, mips->GetLevelData(i));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
+    return textureID;
+}
+
+GLenum TextureLoader::GetInternalFormat(int components, bool srgb) {
+    if (components == 1)
+        return GL_R8;
+    if (components == 2)
+        return GL_RG8;
+    if (components == 3)
+        return srgb ? GL_SRGB8 : GL_RGB8;
+    return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+}
+
+GLenum TextureLoader::GetPixelFormat(int components) {
+    if (components == 1)
+        return GL_RED;
+    if (components == 2)
+        return GL_RG;
+    if (components == 3)
+        return GL_RGB;
+    return GL_RGBA;
+}
+
+void TextureLoader::AllocateStorage(int width, int height, int levels, int components, bool srgb) {
+    GLenum internalFormat = GetInternalFormat(components, srgb);
+    if (GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+    } else {
+        GLenum format = GetPixelFormat(components);
+        for (int level = 0; level < levels; ++level)
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(1, width >> level), std::max(1, height >> level),
+                         0, format, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+}
+
+unsigned int TextureLoader::LoadCompressedTexture(const char* path) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    KTX2File file;
+    if (!file.Open(path))
+        return textureID;
+    
+    // RGTC is core; BC1 needs S3TC, and EXT_texture_sRGB for its sRGB variant
+    BlockFormat format = file.GetBlockFormat();
+    bool srgb = file.IsSRGB();
+    GLenum internalFormat = GL_COMPRESSED_RED_RGTC1;
+    bool native = true;
+    if (format == BlockFormat::BC1) {
+        internalFormat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        native = GLEW_EXT_texture_compression_s3tc && (!srgb || GLEW_EXT_texture_sRGB);
+    } else if (format == BlockFormat::BC5) {
+        internalFormat = GL_COMPRESSED_RG_RGTC2;
     }
     
+    static bool reportedFallback = false;
+    if (!native && !reportedFallback) {
+        std::cout << "S3TC textures are not supported; decoding BC1 on the CPU" << std::endl;
+        reportedFallback = true;
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLsizei levelCount = static_cast<GLsizei>(file.GetLevelCount());
+    for (GLsizei level = 0; level < levelCount; ++level) {
+        unsigned int width = std::max(1u, file.GetWidth() >> level);
+        unsigned int height = std::max(1u, file.GetHeight() >> level);
+        const KTX2Level &blocks = file.GetLevel(level);
+        if (native) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+                                   static_cast<GLsizei>(GetCompressedSize(format, width, height)), blocks.data);
+        } else {
+            std::vector<unsigned char> rgba = DecompressImage(blocks.data, width, height, format);
+            glTexImage2D(GL_TEXTURE_2D, level, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+    }
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    
     return textureID;
 }
 
+TextureRef TextureLoader::LoadSharedTexture(const char* path, MipFilter filter, AsyncTextureLoader* asyncLoader,
+                                            const unsigned char placeholder[4]) {
+    TextureCache &cache = GetTextureCache();
+    cache.stats.requests++;
+    TextureRef ref;
+    
+    std::string pathKey = PathKey(path, filter);
+    auto byPath = cache.byPath.find(pathKey);
+    if (byPath != cache.byPath.end() && (ref.entry = byPath->second.lock())) {
+        cache.stats.pathHits++;
+        cache.stats.bytesSaved += ref.entry->bytes;
+        return ref;
+    }
+    
+    // Unreadable files are not cached; LoadTexture reports them
+    MappedFile file;
+    if (!file.Open(path)) {
+        ref.entry = std::make_shared<TextureCacheEntry>();
+        ref.entry->texture = LoadTexture(path, filter == MipFilter::SRGB);
+        return ref;
+    }
+    
+    uint64_t contentKey = Hash64(file.GetData(), file.GetSize(), static_cast<uint64_t>(filter));
+    auto byContent = cache.byContent.find(contentKey);
+    if (byContent != cache.byContent.end()) {
+        if (std::shared_ptr<TextureCacheEntry> shared = byContent->second.lock()) {
+            ref.entry = shared;
+            ref.entry->pathKeys.push_back(pathKey);
+            cache.byPath[pathKey] = ref.entry;
+            cache.stats.contentHits++;
+            cache.stats.bytesSaved += ref.entry->bytes;
+            return ref;
+        }
+    }
+    
+    // Full mip chain adds a third
+    ref.entry = std::make_shared<TextureCacheEntry>();
+    TextureCacheEntry &entry = *ref.entry;
+    int width = 0, height = 0, components = 0;
+    if (stbi_info_from_memory(file.GetData(), static_cast<int>(file.GetSize()), &width, &height, &components))
+        entry.bytes = static_cast<size_t>(width) * height * components * 4 / 3;
+    
+    if (IsKTX2Path(path)) {
+        // Compressed files carry their mips and upload without decoding, so there is
+        // nothing to do in the background; the blocks are about the size of the file
+        entry.texture = LoadCompressedTexture(path);
+        entry.bytes = file.GetSize();
+    } else if (asyncLoader) {
+        entry.texture = asyncLoader->LoadTexture(path, filter, placeholder);
+        entry.asyncLoader = asyncLoader->GetHandle();
+    } else {
+        // Decode the mapped file rather than reading it again
+        unsigned char* data = stbi_load_from_memory(file.GetData(), static_cast<int>(file.GetSize()),
+                                                    &width, &height, &components, 0);
+        if (data) {
+            entry.texture = CreateTexture(data, width, height, components, filter);
+            stbi_image_free(data);
+        } else {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            glGenTextures(1, &entry.texture);
+            return ref;
+        }
+    }
+    
+    entry.cached = true;
+    entry.contentKey = contentKey;
+    entry.pathKeys.push_back(pathKey);
+    cache.byPath[pathKey] = ref.entry;
+    cache.byContent[contentKey] = ref.entry;
+    cache.stats.liveTextures++;
+    cache.stats.liveBytes += entry.bytes;
+    return ref;
+}
+
+TextureRef TextureLoader::LoadSharedORMTexture(const char* occlusionPath, const char* roughnessPath,
+                                               const char* metallicPath, const unsigned char constants[ORM_CHANNEL_COUNT]) {
+    TextureCache &cache = GetTextureCache();
+    cache.stats.requests++;
+    TextureRef ref;
+    
+    const char* paths[ORM_CHANNEL_COUNT] = {occlusionPath, roughnessPath, metallicPath};
+    std::string pathKey = "orm";
+    for (int channel = 0; channel < ORM_CHANNEL_COUNT; ++channel)
+        pathKey += paths[channel] ? "|" + PathKey(paths[channel], MipFilter::Linear) : "|" + std::to_string(constants[channel]);
+    auto byPath = cache.byPath.find(pathKey);
+    if (byPath != cache.byPath.end() && (ref.entry = byPath->second.lock())) {
+        cache.stats.pathHits++;
+        cache.stats.bytesSaved += ref.entry->bytes;
+        return ref;
+    }
+    
+    // The content key combines each file's hash, or the constant standing in for it
+    MappedFile files[ORM_CHANNEL_COUNT];
+    uint64_t parts[ORM_CHANNEL_COUNT];
+    for (int channel = 0; channel < ORM_CHANNEL_COUNT; ++channel) {
+        parts[channel] = constants[channel];
+        if (!paths[channel])
+            continue;
+        if (!files[channel].Open(paths[channel])) {
+            std::cout << "Texture failed to load at path: " << paths[channel] << std::endl;
+            ref.entry = std::make_shared<TextureCacheEntry>();
+            glGenTextures(1, &ref.entry->texture);
+            return ref;
+        }
+        parts[channel] = Hash64(files[channel].GetData(), files[channel].GetSize());
+    }
+    uint64_t contentKey = Hash64(parts, sizeof(parts), 3);
+    auto byContent = cache.byContent.find(contentKey);
+    if (byContent != cache.byContent.end()) {
+        if (std::shared_ptr<TextureCacheEntry> shared = byContent->second.lock()) {
+            ref.entry = shared;
+            ref.entry->pathKeys.push_back(pathKey);
+            cache.byPath[pathKey] = ref.entry;
+            cache.stats.contentHits++;
+            cache.stats.bytesSaved += ref.entry->bytes;
+            return ref;
+        }
+    }
+    
+    ChannelSource sources[ORM_CHANNEL_COUNT];
+    unsigned char* decoded[ORM_CHANNEL_COUNT] = {nullptr, nullptr, nullptr};
+    bool failed = false;
+    for (int channel = 0; channel < ORM_CHANNEL_COUNT; ++channel) {
+        ChannelSource &source = sources[channel];
+        source.constant = constants[channel];
+        if (!paths[channel])
+            continue;
+        decoded[channel] = stbi_load_from_memory(files[channel].GetData(), static_cast<int>(files[channel].GetSize()),
+                                                 &source.width, &source.height, &source.components, 0);
+        if (!decoded[channel]) {
+            std::cout << "Texture failed to load at path: " << paths[channel] << std::endl;
+            failed = true;
+        }
+        source.pixels = decoded[channel];
+    }
+    
+    ref.entry = std::make_shared<TextureCacheEntry>();
+    TextureCacheEntry &entry = *ref.entry;
+    if (!failed) {
+        int width, height;
+        std::vector<unsigned char> packed = PackChannels(sources, ORM_CHANNEL_COUNT, width, height);
+        entry.texture = CreateTexture(packed.data(), width, height, ORM_CHANNEL_COUNT, MipFilter::Linear);
+        entry.bytes = packed.size() * 4 / 3;
+    }
+    for (unsigned char* pixels : decoded)
+        stbi_image_free(pixels);
+    if (failed) {
+        glGenTextures(1, &entry.texture);
+        return ref;
+    }
+    
+    entry.cached = true;
+    entry.contentKey = contentKey;
+    entry.pathKeys.push_back(pathKey);
+    cache.byPath[pathKey] = ref.entry;
+    cache.byContent[contentKey] = ref.entry;
+    cache.stats.liveTextures++;
+    cache.stats.liveBytes += entry.bytes;
+    return ref;
+}
+
+const TextureCacheStats& TextureLoader::GetCacheStats() {
+    return GetTextureCache().stats;
+}
+
 unsigned int TextureLoader::LoadCubemap(const std::vector<std::string>& faces) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
@@ -0,0 +1,128 @@
+#include "../include/ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount) : pendingTasks(0), stopping(false) {
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    
+    workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+        pendingTasks++;
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    tasksFinished.wait(lock, [this] { return pendingTasks == 0; });
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &body) {
+    size_t sliceCount = std::min<size_t>(workers.size(), count);
+    if (sliceCount == 0)
+        return;
+    
+    // One task per worker instead of one per iteration keeps the shared queue out of the loop
+    std::vector<Slice> slices(sliceCount);
+    for (size_t i = 0; i < sliceCount; ++i) {
+        slices[i].begin = count * i / sliceCount;
+        slices[i].end = count * (i + 1) / sliceCount;
+    }
+    for (size_t i = 0; i < sliceCount; ++i)
+        Submit([&slices, &body, i] { runSlices(slices, i, body); });
+    Wait();
+}
+
+void ThreadPool::runSlices(std::vector<Slice> &slices, size_t own, const std::function<void(size_t)> &body) {
+    Slice &slice = slices[own];
+    while (true) {
+        size_t i = 0;
+        bool claimed = false;
+        {
+            std::lock_guard<std::mutex> lock(slice.mutex);
+            if (slice.begin < slice.end) {
+                i = slice.begin++;
+                claimed = true;
+            }
+        }
+        if (claimed) {
+            body(i);
+            continue;
+        }
+        
+        // Pick the slice with the most work left; only one lock is ever held at a time
+        size_t victim = own;
+        size_t largest = 0;
+        for (size_t v = 0; v < slices.size(); ++v) {
+            if (v == own)
+                continue;
+            std::lock_guard<std::mutex> lock(slices[v].mutex);
+            size_t remaining = slices[v].end - slices[v].begin;
+            if (remaining > largest) {
+                largest = remaining;
+                victim = v;
+            }
+        }
+        if (victim == own)
+            return;
+        
+        // Take the back half, or the last iteration; the owner keeps working from the front
+        size_t stolenBegin, stolenEnd;
+        {
+            std::lock_guard<std::mutex> lock(slices[victim].mutex);
+            Slice &target = slices[victim];
+            if (target.begin >= target.end)
+                continue;
+            stolenEnd = target.end;
+            stolenBegin = target.begin + (target.end - target.begin) / 2;
+            target.end = stolenBegin;
+        }
+        std::lock_guard<std::mutex> lock(slice.mutex);
+        slice.begin = stolenBegin;
+        slice.end = stolenEnd;
+    }
+}
+
+unsigned int ThreadPool::GetThreadCount() const {
+    return static_cast<unsigned int>(workers.size());
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        
+        task();
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingTasks--;
+            if (pendingTasks == 0)
+                tasksFinished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#include "../include/Transforms.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORMS_USE_SSE 1
+#endif
+
+// transpose(inverse(M)) equals the cofactor matrix divided by the determinant.
+// With columns a, b, c its columns are (b x c, c x a, a x b) / det.
+glm::mat3 ComputeNormalMatrix(const glm::mat4 &model) {
+    glm::vec3 a(model[0][0], model[0][1], model[0][2]);
+    glm::vec3 b(model[1][0], model[1][1], model[1][2]);
+    glm::vec3 c(model[2][0], model[2][1], model[2][2]);
+    
+    glm::vec3 bc = glm::cross(b, c);
+    float invDet = 1.0f / glm::dot(a, bc);
+    
+    return glm::mat3(bc * invDet, glm::cross(c, a) * invDet, glm::cross(a, b) * invDet);
+}
+
+void ComputeNormalMatrices(const glm::mat4 *models, glm::mat3 *normalMatrices, size_t count) {
+    size_t i = 0;
+    
+#ifdef TRANSFORMS_USE_SSE
+    // Four transforms per iteration: transpose their columns into one register per component
+    for (; i + 4 <= count; i += 4) {
+        const float *m0 = &models[i + 0][0][0];
+        const float *m1 = &models[i + 1][0][0];
+        const float *m2 = &models[i + 2][0][0];
+        const float *m3 = &models[i + 3][0][0];
+        
+        __m128 ax = _mm_loadu_ps(m0), ay = _mm_loadu_ps(m1), az = _mm_loadu_ps(m2), aw = _mm_loadu_ps(m3);
+        _MM_TRANSPOSE4_PS(ax, ay, az, aw);
+        __m128 bx = _mm_loadu_ps(m0 + 4), by = _mm_loadu_ps(m1 + 4), bz = _mm_loadu_ps(m2 + 4), bw = _mm_loadu_ps(m3 + 4);
+        _MM_TRANSPOSE4_PS(bx, by, bz, bw);
+        __m128 cx = _mm_loadu_ps(m0 + 8), cy = _mm_loadu_ps(m1 + 8), cz = _mm_loadu_ps(m2 + 8), cw = _mm_loadu_ps(m3 + 8);
+        _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+        
+        // Cofactor columns
+        __m128 n0x = _mm_sub_ps(_mm_mul_ps(by, cz), _mm_mul_ps(bz, cy));
+        __m128 n0y = _mm_sub_ps(_mm_mul_ps(bz, cx), _mm_mul_ps(bx, cz));
+        __m128 n0z = _mm_sub_ps(_mm_mul_ps(bx, cy), _mm_mul_ps(by, cx));
+        __m128 n1x = _mm_sub_ps(_mm_mul_ps(cy, az), _mm_mul_ps(cz, ay));
+        __m128 n1y = _mm_sub_ps(_mm_mul_ps(cz, ax), _mm_mul_ps(cx, az));
+        __m128 n1z = _mm_sub_ps(_mm_mul_ps(cx, ay), _mm_mul_ps(cy, ax));
+        __m128 n2x = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        __m128 n2y = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        __m128 n2z = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+        
+        // det = a . (b x c)
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, n0x), _mm_mul_ps(ay, n0y)), _mm_mul_ps(az, n0z));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        
+        n0x = _mm_mul_ps(n0x, invDet); n0y = _mm_mul_ps(n0y, invDet); n0z = _mm_mul_ps(n0z, invDet);
+        n1x = _mm_mul_ps(n1x, invDet); n1y = _mm_mul_ps(n1y, invDet); n1z = _mm_mul_ps(n1z, invDet);
+        n2x = _mm_mul_ps(n2x, invDet); n2y = _mm_mul_ps(n2y, invDet); n2z = _mm_mul_ps(n2z, invDet);
+        
+        // Back to one 9-float matrix per transform: floats 0-3, 4-7, then 8
+        _MM_TRANSPOSE4_PS(n0x, n0y, n0z, n1x);
+        _MM_TRANSPOSE4_PS(n1y, n1z, n2x, n2y);
+        
+        float *out0 = &normalMatrices[i + 0][0][0];
+        float *out1 = &normalMatrices[i + 1][0][0];
+        float *out2 = &normalMatrices[i + 2][0][0];
+        float *out3 = &normalMatrices[i + 3][0][0];
+        _mm_storeu_ps(out0, n0x); _mm_storeu_ps(out0 + 4, n1y);
+        _mm_storeu_ps(out1, n0y); _mm_storeu_ps(out1 + 4, n1z);
+        _mm_storeu_ps(out2, n0z); _mm_storeu_ps(out2 + 4, n2x);
+        _mm_storeu_ps(out3, n1x); _mm_storeu_ps(out3 + 4, n2y);
+        
+        alignas(16) float last[4];
+        _mm_store_ps(last, n2z);
+        out0[8] = last[0];
+        out1[8] = last[1];
+        out2[8] = last[2];
+        out3[8] = last[3];
+    }
+#endif
+    
+    for (; i < count; ++i)
+        normalMatrices[i] = ComputeNormalMatrix(models[i]);
+}
@@ -0,0 +1,141 @@
+#include "../include/VertexFormat.h"
+#include "../include/HalfFloat.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+const float PI = 3.14159265359f;
+
+float SignNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+// Octahedral mapping of a unit vector to [-1, 1]^2
+glm::vec2 OctEncode(const glm::vec3 &n) {
+    float invL1 = 1.0f / (std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z));
+    glm::vec2 p(n.x * invL1, n.y * invL1);
+    if (n.z < 0.0f) {
+        p = glm::vec2((1.0f - std::fabs(p.y)) * SignNotZero(p.x),
+                      (1.0f - std::fabs(p.x)) * SignNotZero(p.y));
+    }
+    return p;
+}
+
+glm::vec3 OctDecode(const glm::vec2 &p) {
+    glm::vec3 n(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// Orthonormal basis around n (Duff et al. 2017); pbr.vs builds the same basis
+void BuildBasis(const glm::vec3 &n, glm::vec3 &b1, glm::vec3 &b2) {
+    float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    b1 = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    b2 = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+}
+
+uint32_t QuantizeUnorm10(float value) {
+    float clamped = std::min(std::max(value, 0.0f), 1.0f);
+    return static_cast<uint32_t>(std::lround(clamped * 1023.0f));
+}
+
+float AngleBetweenDegrees(const glm::vec3 &a, const glm::vec3 &b) {
+    float cosine = glm::dot(glm::normalize(a), glm::normalize(b));
+    return std::acos(std::min(std::max(cosine, -1.0f), 1.0f)) * 180.0f / PI;
+}
+
+}
+
+PackedVertex PackVertex(const Vertex &vertex) {
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    
+    glm::vec3 normal = glm::normalize(vertex.Normal);
+    glm::vec2 oct = OctEncode(normal);
+    uint32_t octX = QuantizeUnorm10(oct.x * 0.5f + 0.5f);
+    uint32_t octY = QuantizeUnorm10(oct.y * 0.5f + 0.5f);
+    
+    // The tangent angle is measured in the basis of the *quantized* normal,
+    // exactly as the shader will reconstruct it
+    glm::vec3 decodedNormal = OctDecode(glm::vec2(octX / 1023.0f * 2.0f - 1.0f, octY / 1023.0f * 2.0f - 1.0f));
+    glm::vec3 b1, b2;
+    BuildBasis(decodedNormal, b1, b2);
+    glm::vec3 tangent = vertex.Tangent - decodedNormal * glm::dot(decodedNormal, vertex.Tangent);
+    float angle = std::atan2(glm::dot(tangent, b2), glm::dot(tangent, b1));
+    uint32_t angleBits = QuantizeUnorm10(angle / (2.0f * PI) + 0.5f);
+    
+    // Right-handed frames store 3, left-handed 0
+    bool rightHanded = glm::dot(glm::cross(normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+    uint32_t signBits = rightHanded ? 3u : 0u;
+    
+    packed.TangentFrame = octX | (octY << 10) | (angleBits << 20) | (signBits << 30);
+    packed.TexCoords[0] = FloatToHalf(vertex.TexCoords.x);
+    packed.TexCoords[1] = FloatToHalf(vertex.TexCoords.y);
+    return packed;
+}
+
+Vertex UnpackVertex(const PackedVertex &packed) {
+    Vertex vertex;
+    vertex.Position = packed.Position;
+    
+    float octX = (packed.TangentFrame & 0x3FFu) / 1023.0f * 2.0f - 1.0f;
+    float octY = ((packed.TangentFrame >> 10) & 0x3FFu) / 1023.0f * 2.0f - 1.0f;
+    float angle = (((packed.TangentFrame >> 20) & 0x3FFu) / 1023.0f - 0.5f) * 2.0f * PI;
+    float sign = ((packed.TangentFrame >> 30) & 0x3u) != 0 ? 1.0f : -1.0f;
+    
+    vertex.Normal = OctDecode(glm::vec2(octX, octY));
+    glm::vec3 b1, b2;
+    BuildBasis(vertex.Normal, b1, b2);
+    vertex.Tangent = b1 * std::cos(angle) + b2 * std::sin(angle);
+    vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * sign;
+    vertex.TexCoords = glm::vec2(HalfToFloat(packed.TexCoords[0]), HalfToFloat(packed.TexCoords[1]));
+    return vertex;
+}
+
+size_t GetVertexSize(VertexFormat format) {
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+void ComputeBounds(const Vertex *vertices, size_t count, glm::vec3 &boundsMin, glm::vec3 &boundsMax) {
+    if (count == 0) {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        return;
+    }
+    
+    boundsMin = boundsMax = vertices[0].Position;
+    for (size_t i = 1; i < count; ++i) {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+}
+
+VertexPackingReport AnalyzeVertexPacking(const Vertex *vertices, size_t count) {
+    VertexPackingReport report;
+    report.vertexCount = count;
+    report.standardBytes = count * sizeof(Vertex);
+    report.packedBytes = count * sizeof(PackedVertex);
+    
+    for (size_t i = 0; i < count; ++i) {
+        const Vertex &original = vertices[i];
+        Vertex decoded = UnpackVertex(PackVertex(original));
+        
+        report.maxNormalErrorDegrees = std::max(report.maxNormalErrorDegrees, AngleBetweenDegrees(original.Normal, decoded.Normal));
+        
+        // Compare against the tangent made orthogonal to the normal, which is what can be represented
+        glm::vec3 normal = glm::normalize(original.Normal);
+        glm::vec3 tangent = original.Tangent - normal * glm::dot(normal, original.Tangent);
+        report.maxTangentErrorDegrees = std::max(report.maxTangentErrorDegrees, AngleBetweenDegrees(tangent, decoded.Tangent));
+        
+        if (glm::dot(original.Bitangent, decoded.Bitangent) < 0.0f)
+            report.bitangentFlips++;
+        
+        glm::vec2 uvError = original.TexCoords - decoded.TexCoords;
+        report.maxTexCoordError = std::max(report.maxTexCoordError, std::max(std::fabs(uvError.x), std::fabs(uvError.y)));
+    }
+    return report;
+}
@@ -1,5 +1,8 @@
 #include <iostream>
 #include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -9,13 +12,24 @@
 #include "../include/Shader.h"
 #include "../include/Camera.h"
 #include "../include/Material.h"
+#include "../include/AsyncTextureLoader.h"
 #include "../include/Model.h"
 #include "../include/IBL.h"
+#include "../include/FrameUniforms.h"
+#include "../include/MaterialRegistry.h"
+#include "../include/RenderQueue.h"
+#include "../include/Benchmark.h"
 
 // Window settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 
+// GPU and upload time per frame spent baking an environment switched to at runtime
+const double ENVIRONMENT_BAKE_BUDGET_MS = 2.0;
+
+// Decoded material map bytes streamed to the GPU per frame
+const size_t TEXTURE_UPLOAD_BUDGET_BYTES = 4 << 20;
+
 // Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f;
@@ -33,8 +47,13 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
 unsigned int loadCubemap(std::vector<std::string> faces);
 unsigned int setupSkyboxVAO();
+int runRenderer(GLFWwindow* window, const std::string &benchmark, const std::string &benchmarkArgument);
 
-int main() {
+int main(int argc, char** argv) {
+    // Optional benchmark mode: --bench-<name> [count or file]
+    std::string benchmark = argc > 1 ? argv[1] : "";
+    std::string benchmarkArgument = argc > 2 ? argv[2] : "";
+    
     // Initialize GLFW
     if (!glfwInit()) {
         std::cout << "Failed to initialize GLFW" << std::endl;
@@ -73,13 +92,46 @@ int main() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
     
+    int result = runRenderer(window, benchmark, benchmarkArgument);
+    
+    // Every mesh has been destroyed with the context still current
+    if (Mesh::GetLiveGLObjectCount() != 0)
+        std::cout << "Leaked mesh GL objects: " << Mesh::GetLiveGLObjectCount() << std::endl;
+    
+    // Clean up
+    glfwTerminate();
+    return result;
+}
+
+// Build the scene and run the render loop or the requested benchmark. Everything
+// owning GL objects lives in this scope so it is released before the context.
+int runRenderer(GLFWwindow* window, const std::string &benchmark, const std::string &benchmarkArgument) {
+    unsigned int benchmarkCount = static_cast<unsigned int>(std::strtoul(benchmarkArgument.c_str(), nullptr, 10));
+    
     // Create shaders
     Shader pbrShader("shaders/pbr.vs", "shaders/pbr.fs");
+    Shader pbrPackedShader("shaders/pbr.vs", "shaders/pbr.fs", {"PACKED_VERTEX"});
     Shader skyboxShader("shaders/skybox.vs", "shaders/skybox.fs");
     
+    // Shared per-frame camera/light block
+    FrameUniforms frameUniforms;
+    frameUniforms.Attach(pbrShader);
+    frameUniforms.Attach(pbrPackedShader);
+    frameUniforms.Attach(skyboxShader);
+    
+    // Shared material parameter block
+    MaterialRegistry materialRegistry;
+    materialRegistry.Attach(pbrShader);
+    materialRegistry.Attach(pbrPackedShader);
+    
     // Setup skybox VAO
     unsigned int skyboxVAO = setupSkyboxVAO();
     
+    // Material maps are decoded in the background and streamed in within a per-frame budget.
+    // Materials and cached maps keep only handles to the loader, which expire with it.
+    AsyncTextureLoader textureLoader;
+    Material::SetAsyncTextureLoader(&textureLoader);
+    
     // Create models
     Model sphereModel;
     Model cubeModel;
@@ -104,16 +156,68 @@ int main() {
     plasticMaterial.SetRoughness(0.7f);
     plasticMaterial.SetAo(1.0f);
     
-    // Create scene objects
-    sphereModel.CreateSphere(64, 32, 1.0f, goldMaterial);
+    // Reuse optimized meshes across runs. The packing report compares against the
+    // source vertices and the load benchmarks measure decoding, so they bypass it.
+    if (benchmark != "--vertex-format-report" && benchmark != "--bench-load" && benchmark != "--bench-mesh-cache")
+        Model::SetMeshCacheDirectory("cache");
+    
+    // Reuse the baked IBL maps of an unchanged environment
+    IBL::SetCacheDirectory("cache");
+    
+    // The packing report reads vertices back, so keep them in host memory for it
+    if (benchmark == "--vertex-format-report") {
+        sphereModel.SetMeshStorage(MeshStorage::Retained);
+        cubeModel.SetMeshStorage(MeshStorage::Retained);
+        planeModel.SetMeshStorage(MeshStorage::Retained);
+    }
+    
+    // Create scene objects; the sphere uses the compact vertex layout
+    sphereModel.CreateSphere(64, 32, 1.0f, goldMaterial, VertexFormat::Packed);
     cubeModel.CreateCube(1.0f, ironMaterial);
     planeModel.CreatePlane(10.0f, 10.0f, plasticMaterial);
     
+    // Give every unique material its parameter slot up front
+    materialRegistry.Register(sphereModel);
+    materialRegistry.Register(cubeModel);
+    materialRegistry.Register(planeModel);
+    
+    // Report what narrow index storage saves across the scene, and the mesh memory budget
+    size_t indexBytes = 0, wideIndexBytes = 0, hostBytes = 0, gpuBytes = 0;
+    for (const Model* sceneModel : {&sphereModel, &cubeModel, &planeModel}) {
+        indexBytes += sceneModel->GetIndexBufferSize();
+        wideIndexBytes += sceneModel->GetIndexCount() * sizeof(uint32_t);
+        hostBytes += sceneModel->GetHostMemorySize();
+        gpuBytes += sceneModel->GetGPUMemorySize();
+    }
+    std::cout << "Index buffers: " << indexBytes << " bytes (" << wideIndexBytes - indexBytes
+              << " saved over 32-bit indices)" << std::endl;
+    std::cout << "Mesh memory: " << hostBytes << " bytes host, " << gpuBytes << " bytes GPU" << std::endl;
+    const TextureCacheStats &textureCache = TextureLoader::GetCacheStats();
+    if (textureCache.requests > 0)
+        std::cout << "Texture cache: " << textureCache.liveTextures << " textures for " << textureCache.requests
+                  << " maps, hit rate " << textureCache.GetHitRate() * 100.0 << "%, " << textureCache.bytesSaved
+                  << " bytes saved" << std::endl;
+    RenderQueue renderQueue(materialRegistry);
+    
     // Setup IBL
     IBL ibl;
     std::cout << "Loading environment map..." << std::endl;
     ibl.LoadEnvironmentMap("resources/textures/hdr/environment.hdr");
     std::cout << "Environment map loaded!" << std::endl;
+    frameUniforms.SetIrradianceSH(ibl.GetIrradianceSH());
+    
+    // HDR environments the E key cycles through
+    std::vector<std::string> environments;
+    std::error_code directoryError;
+    for (const auto &entry : std::filesystem::directory_iterator("resources/textures/hdr", directoryError))
+        if (entry.path().extension() == ".hdr")
+            environments.push_back(entry.path().generic_string());
+    std::sort(environments.begin(), environments.end());
+    if (environments.size() > 1)
+        ibl.PrepareEnvironmentStreaming();
+    auto environment = std::find(environments.begin(), environments.end(), "resources/textures/hdr/environment.hdr");
+    size_t environmentIndex = environment != environments.end() ? environment - environments.begin() : 0;
+    bool environmentKeyDown = false;
     
     // Set up light positions
     std::vector<glm::vec3> lightPositions = {
@@ -131,8 +235,66 @@ int main() {
         glm::vec3(300.0f, 300.0f, 300.0f)
     };
     
+    // Lights are static, so they are copied into the frame block once
+    frameUniforms.SetLights(lightPositions, lightColors);
+    
+    // Frame statistics, reported once per second
+    float lastStatsReport = glfwGetTime();
+    
+    // Run the requested benchmark instead of the interactive scene
+    if (benchmark == "--bench-instancing") {
+        RunInstancingBenchmark(window, frameUniforms, materialRegistry, ibl, benchmarkCount ? benchmarkCount : 10000);
+        return 0;
+    }
+    if (benchmark == "--vertex-format-report") {
+        ReportVertexPacking("Sphere", sphereModel);
+        ReportVertexPacking("Cube", cubeModel);
+        ReportVertexPacking("Plane", planeModel);
+        return 0;
+    }
+    if (benchmark == "--mesh-optimization-report") {
+        ReportMeshOptimization("Sphere", sphereModel);
+        ReportMeshOptimization("Cube", cubeModel);
+        ReportMeshOptimization("Plane", planeModel);
+        return 0;
+    }
+    if (benchmark == "--bench-load") {
+        RunLoadBenchmark(benchmarkArgument);
+        return 0;
+    }
+    if (benchmark == "--bench-mesh-cache") {
+        RunMeshCacheBenchmark(benchmarkArgument);
+        return 0;
+    }
+    if (benchmark == "--irradiance-sh-report") {
+        ReportIrradianceSH(ibl);
+        return 0;
+    }
+    if (benchmark == "--bench-prefilter") {
+        RunPrefilterBenchmark(ibl);
+        return 0;
+    }
+    if (benchmark == "--brdf-lut-report") {
+        ReportBRDFLookUpTexture(ibl);
+        return 0;
+    }
+    if (benchmark == "--cpu-bake-report") {
+        ReportCPUBake(ibl, "resources/textures/hdr/environment.hdr");
+        return 0;
+    }
+    if (benchmark == "--bench-normal-matrix") {
+        RunNormalMatrixBenchmark(window, frameUniforms, materialRegistry, benchmarkCount ? benchmarkCount : 64);
+        return 0;
+    }
+    if (benchmark == "--bench-mips") {
+        RunMipBenchmark(benchmarkCount ? benchmarkCount : 2048);
+        return 0;
+    }
+    
     // Render loop
     while (!glfwWindowShouldClose(window)) {
+        Shader::ResetLookupStats();
+        
         // Calculate delta time
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -141,6 +303,19 @@ int main() {
         // Process input
         processInput(window);
         
+        // Switch environments without a hitch: the next one is baked within a per-frame budget
+        bool environmentKey = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+        if (environmentKey && !environmentKeyDown && environments.size() > 1) {
+            environmentIndex = (environmentIndex + 1) % environments.size();
+            ibl.RequestEnvironmentMap(environments[environmentIndex].c_str());
+        }
+        environmentKeyDown = environmentKey;
+        if (ibl.UpdateEnvironmentBake(ENVIRONMENT_BAKE_BUDGET_MS))
+            frameUniforms.SetIrradianceSH(ibl.GetIrradianceSH());
+        
+        // Swap in material maps whose upload finished
+        textureLoader.Update(TEXTURE_UPLOAD_BUDGET_BYTES);
+        
         // Clear buffers
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -149,49 +324,65 @@ int main() {
         glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
         
+        // Upload camera and light data shared by all programs
+        frameUniforms.SetCamera(projection, view, camera.Position);
+        frameUniforms.SetTime(currentFrame);
+        frameUniforms.Upload();
+        
         // Set up PBR shader
         pbrShader.use();
-        pbrShader.setMat4("projection", projection);
-        pbrShader.setMat4("view", view);
-        pbrShader.setVec3("camPos", camera.Position);
-        
-        // Set up lights
-        for (unsigned int i = 0; i < lightPositions.size(); i++) {
-            pbrShader.setVec3("lightPositions[" + std::to_string(i) + "]", lightPositions[i]);
-            pbrShader.setVec3("lightColors[" + std::to_string(i) + "]", lightColors[i]);
-        }
         
         // Apply IBL
         ibl.Apply(pbrShader);
+        pbrPackedShader.use();
+        ibl.Apply(pbrPackedShader);
         
-        // Draw sphere
+        // Queue sphere
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-2.0f, 0.0f, 0.0f));
-        pbrShader.setMat4("model", model);
-        sphereModel.Draw(pbrShader);
+        renderQueue.Submit(pbrPackedShader, sphereModel, model);
         
-        // Draw cube
+        // Queue cube
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        pbrShader.setMat4("model", model);
-        cubeModel.Draw(pbrShader);
+        renderQueue.Submit(pbrShader, cubeModel, model);
         
-        // Draw plane
+        // Queue plane
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, -1.5f, 0.0f));
-        pbrShader.setMat4("model", model);
-        planeModel.Draw(pbrShader);
+        renderQueue.Submit(pbrShader, planeModel, model);
+        
+        // Draw the scene sorted by program, material and VAO
+        renderQueue.Flush();
         
         // Draw skybox
         ibl.DrawSkybox(skyboxShader, skyboxVAO);
         
+        // Report per-frame statistics
+        if (currentFrame - lastStatsReport >= 1.0f) {
+            const UniformLookupStats &lookups = Shader::GetLookupStats();
+            const RenderStats &render = renderQueue.GetStats();
+            std::cout << "Uniform lookups per frame: " << lookups.driverLookups << " driver, "
+                      << lookups.hashedLookups << " hashed" << std::endl;
+            std::cout << "Draws: " << render.drawCalls
+                      << ", state changes avoided: " << render.programBindsSkipped << " program, "
+                      << render.materialBindsSkipped << " material, "
+                      << render.textureBindsSkipped << " texture, "
+                      << render.vaoBindsSkipped << " VAO" << std::endl;
+            const AsyncTextureStats &textures = textureLoader.GetStats();
+            if (textures.queueDepth > 0 || textures.completedTextures > 0 || textures.failedTextures > 0)
+                std::cout << "Textures: " << textures.queueDepth << " queued (" << textures.decoding << " decoding), "
+                          << textures.completedTextures << " loaded, " << textures.uploadedBytes / 1024
+                          << " KB uploaded last frame, decode " << textures.GetDecodeThroughput() << " MB/s, mips "
+                          << textures.mipMilliseconds << " ms" << std::endl;
+            lastStatsReport = currentFrame;
+        }
+        
         // Swap buffers and poll events
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
     
-    // Clean up
-    glfwTerminate();
     return 0;
 }
 
@@ -0,0 +1,137 @@
+// Builds the renderer's scene meshes against a counting GL stub and checks that every
+// buffer is allocated exactly once and that no VAO or buffer outlives its Mesh. GLEW
+// resolves GL entry points through function pointers, so the stub installs itself by
+// assigning them; no context or display is needed.
+#include "../include/Model.h"
+#include <iostream>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// GL objects and allocations seen by the stub
+struct GLCounts {
+    GLuint nextName = 1;
+    std::set<GLuint> liveVertexArrays;
+    std::set<GLuint> liveBuffers;
+    std::map<GLenum, GLuint> boundBuffers;
+    std::map<GLuint, unsigned int> bufferDataCalls;     // Per buffer name
+    unsigned int invalidCalls = 0;                      // Deletes of unknown names, data for no buffer
+};
+
+GLCounts counts;
+
+void GLAPIENTRY CountingGenVertexArrays(GLsizei n, GLuint* arrays) {
+    for (GLsizei i = 0; i < n; ++i) {
+        arrays[i] = counts.nextName++;
+        counts.liveVertexArrays.insert(arrays[i]);
+    }
+}
+
+void GLAPIENTRY CountingDeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    for (GLsizei i = 0; i < n; ++i) {
+        if (arrays[i] != 0 && counts.liveVertexArrays.erase(arrays[i]) == 0)
+            counts.invalidCalls++;
+    }
+}
+
+void GLAPIENTRY CountingGenBuffers(GLsizei n, GLuint* buffers) {
+    for (GLsizei i = 0; i < n; ++i) {
+        buffers[i] = counts.nextName++;
+        counts.liveBuffers.insert(buffers[i]);
+    }
+}
+
+void GLAPIENTRY CountingDeleteBuffers(GLsizei n, const GLuint* buffers) {
+    for (GLsizei i = 0; i < n; ++i) {
+        if (buffers[i] != 0 && counts.liveBuffers.erase(buffers[i]) == 0)
+            counts.invalidCalls++;
+    }
+}
+
+void GLAPIENTRY CountingBindBuffer(GLenum target, GLuint buffer) {
+    counts.boundBuffers[target] = buffer;
+}
+
+void GLAPIENTRY CountingBufferData(GLenum target, GLsizeiptr, const void*, GLenum) {
+    GLuint buffer = counts.boundBuffers[target];
+    if (counts.liveBuffers.count(buffer) == 0)
+        counts.invalidCalls++;
+    counts.bufferDataCalls[buffer]++;
+}
+
+void GLAPIENTRY IgnoreBindVertexArray(GLuint) {
+}
+
+void GLAPIENTRY IgnoreEnableVertexAttribArray(GLuint) {
+}
+
+void GLAPIENTRY IgnoreVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {
+}
+
+void InstallCountingGL() {
+    glGenVertexArrays = CountingGenVertexArrays;
+    glDeleteVertexArrays = CountingDeleteVertexArrays;
+    glGenBuffers = CountingGenBuffers;
+    glDeleteBuffers = CountingDeleteBuffers;
+    glBindBuffer = CountingBindBuffer;
+    glBufferData = CountingBufferData;
+    glBindVertexArray = IgnoreBindVertexArray;
+    glEnableVertexAttribArray = IgnoreEnableVertexAttribArray;
+    glVertexAttribPointer = IgnoreVertexAttribPointer;
+}
+
+unsigned int failures = 0;
+
+void Check(bool condition, const char* description) {
+    if (!condition) {
+        std::cout << "FAILED: " << description << std::endl;
+        failures++;
+    }
+}
+
+}
+
+int main() {
+    InstallCountingGL();
+    
+    {
+        // The scene main.cpp builds, in the same vertex formats
+        Material material;
+        Model sphereModel;
+        Model cubeModel;
+        Model planeModel;
+        sphereModel.CreateSphere(64, 32, 1.0f, material, VertexFormat::Packed);
+        cubeModel.CreateCube(1.0f, material);
+        planeModel.CreatePlane(10.0f, 10.0f, material);
+        
+        // Moving meshes around, as vector growth does, must not duplicate their objects
+        std::vector<Mesh> moved;
+        for (int i = 0; i < 4; ++i) {
+            Model model;
+            model.CreateCube(1.0f, material);
+            moved.push_back(std::move(model.meshes[0]));
+        }
+        
+        size_t meshCount = sphereModel.meshes.size() + cubeModel.meshes.size() + planeModel.meshes.size() + moved.size();
+        Check(meshCount == 7, "each primitive builds one mesh");
+        Check(counts.liveVertexArrays.size() == meshCount, "one VAO per mesh");
+        Check(counts.liveBuffers.size() == meshCount * 2, "one vertex and one index buffer per mesh");
+        Check(Mesh::GetLiveGLObjectCount() == meshCount * 3, "Mesh counts the objects it owns");
+        for (const std::pair<const GLuint, unsigned int> &buffer : counts.bufferDataCalls)
+            Check(buffer.second == 1, "exactly one glBufferData per buffer");
+        Check(counts.bufferDataCalls.size() == counts.liveBuffers.size(), "every buffer is allocated");
+    }
+    
+    Check(counts.liveVertexArrays.empty(), "no VAO outlives its mesh");
+    Check(counts.liveBuffers.empty(), "no buffer outlives its mesh");
+    Check(Mesh::GetLiveGLObjectCount() == 0, "Mesh counts no live objects");
+    Check(counts.invalidCalls == 0, "no GL call on a deleted or unknown name");
+    
+    if (failures != 0)
+        return 1;
+    std::cout << "Mesh GL objects: all checks passed" << std::endl;
+    return 0;
+}
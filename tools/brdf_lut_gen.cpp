@@ -0,0 +1,67 @@
+// Build step: integrates the split-sum BRDF lookup table on the CPU and writes it as
+// a header of half floats that IBL compiles in, so startup needs no bake pass for it.
+//
+// Usage: brdf_lut_gen <output header> [size]
+
+#include "../include/BRDFIntegrator.h"
+#include "../include/HalfFloat.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <output header> [size]" << std::endl;
+        return 1;
+    }
+    
+    unsigned int size = argc > 2 ? static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10)) : 512;
+    if (size < 2 || size > 4096) {
+        std::cout << "BRDF LUT size must be between 2 and 4096, got " << (argc > 2 ? argv[2] : "") << std::endl;
+        return 1;
+    }
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    ThreadPool pool;
+    std::vector<float> lut = GenerateBRDFLUT(size, &pool);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    std::ostringstream header;
+    header << "// Generated by tools/brdf_lut_gen.cpp at build time; do not edit\n"
+           << "#pragma once\n\n"
+           << "#include <cstdint>\n\n"
+           << "// Split-sum BRDF scale and bias (see BRDFIntegrator.h) as RG half floats,\n"
+           << "// columns over NdotV and rows over roughness\n"
+           << "const unsigned int EMBEDDED_BRDF_LUT_SIZE = " << size << ";\n"
+           << "const uint16_t EMBEDDED_BRDF_LUT[] = {";
+    header << std::hex << std::setfill('0');
+    for (size_t i = 0; i < lut.size(); ++i) {
+        header << (i % 16 == 0 ? "\n    " : " ") << "0x" << std::setw(4) << FloatToHalf(lut[i]) << ",";
+    }
+    header << "\n};\n";
+    
+    // Write under a temporary name so an interrupted build never leaves a partial header
+    std::string path = argv[1];
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        out << header.str();
+        if (!out) {
+            std::cout << "Failed to write " << path << std::endl;
+            return 1;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cout << "Failed to write " << path << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Integrated " << size << "x" << size << " BRDF LUT on " << pool.GetThreadCount()
+              << " threads in " << milliseconds << " ms" << std::endl;
+    return 0;
+}
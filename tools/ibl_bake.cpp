@@ -0,0 +1,174 @@
+// Offline IBL baker: writes the same cache file the renderer's GPU bake does, using only
+// the CPU, so the asset pipeline can bake environments on machines without a GPU. The
+// cache key hashes the bake shaders, so run it from the directory that holds shaders/.
+//
+// Usage: ibl_bake <environment.hdr> [cache directory] [threads]
+//        ibl_bake --bench <environment.hdr> [max threads]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "../include/IBLCPUBaker.h"
+#include "../include/IBLCache.h"
+#include "../include/SphericalHarmonics.h"
+#include "../include/BRDFIntegrator.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <cstdlib>
+
+namespace {
+
+// Sizes the renderer does not cache but the baker writes alongside the cached maps
+const unsigned int IRRADIANCE_SIZE = 32;
+const unsigned int IRRADIANCE_SOURCE_SIZE = 32;
+const unsigned int SH_SOURCE_SIZE = 64;
+const unsigned int BRDF_LUT_SIZE = 512;
+const unsigned int BENCHMARK_BRDF_LUT_SIZE = 128;   // Keeps the single-threaded runs short
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Everything one bake produces, with the time each stage took
+struct BakeResult {
+    HostCubemap environment;
+    HostCubemap irradiance;
+    HostCubemap prefilter;
+    IrradianceSH sh;
+    std::vector<float> brdfLUT;
+    double milliseconds[5] = {};
+};
+
+const char* STAGE_NAMES[5] = {"environment", "SH", "irradiance", "prefilter", "BRDF LUT"};
+
+BakeResult Bake(const EquirectangularImage &image, unsigned int brdfLUTSize, ThreadPool &pool) {
+    BakeResult result;
+    auto start = std::chrono::high_resolution_clock::now();
+    result.environment = BakeEnvironmentCubemap(image, IBL_ENVIRONMENT_SIZE, &pool);
+    result.milliseconds[0] = MillisecondsSince(start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    unsigned int shLevel = 0;
+    while (result.environment.GetLevelSize(shLevel) > SH_SOURCE_SIZE)
+        shLevel++;
+    result.sh = ProjectIrradianceSH(result.environment.levels[shLevel].data(), result.environment.GetLevelSize(shLevel), &pool);
+    result.milliseconds[1] = MillisecondsSince(start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    result.irradiance = BakeIrradianceCubemap(result.environment, IRRADIANCE_SIZE, IRRADIANCE_SOURCE_SIZE, &pool);
+    result.milliseconds[2] = MillisecondsSince(start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    result.prefilter = BakePrefilterCubemap(result.environment, IBL_PREFILTER_SIZE, IBL_PREFILTER_MIP_LEVELS, &pool);
+    result.milliseconds[3] = MillisecondsSince(start);
+    
+    start = std::chrono::high_resolution_clock::now();
+    result.brdfLUT = GenerateBRDFLUT(brdfLUTSize, &pool);
+    result.milliseconds[4] = MillisecondsSince(start);
+    return result;
+}
+
+double TotalMilliseconds(const BakeResult &result) {
+    double total = 0.0;
+    for (double milliseconds : result.milliseconds)
+        total += milliseconds;
+    return total;
+}
+
+// Bake with 1..maxThreads workers and print each stage's time and the speedup over one thread
+int RunScalingBenchmark(const EquirectangularImage &image, unsigned int maxThreads) {
+    std::cout << "threads";
+    for (const char* name : STAGE_NAMES)
+        std::cout << std::setw(13) << name;
+    std::cout << std::setw(13) << "total" << std::setw(10) << "speedup" << std::endl;
+    
+    double baseline = 0.0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (unsigned int threads = 1; threads <= maxThreads; ++threads) {
+        ThreadPool pool(threads);
+        BakeResult result = Bake(image, BENCHMARK_BRDF_LUT_SIZE, pool);
+        double total = TotalMilliseconds(result);
+        if (threads == 1)
+            baseline = total;
+        
+        std::cout << std::setw(7) << threads;
+        for (double milliseconds : result.milliseconds)
+            std::cout << std::setw(10) << milliseconds << " ms";
+        std::cout << std::setw(10) << total << " ms" << std::setw(9) << baseline / total << "x" << std::endl;
+    }
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+    int first = benchmark ? 2 : 1;
+    if (argc <= first) {
+        std::cout << "Usage: " << argv[0] << " <environment.hdr> [cache directory] [threads]" << std::endl;
+        std::cout << "       " << argv[0] << " --bench <environment.hdr> [max threads]" << std::endl;
+        return 1;
+    }
+    
+    const char* hdrPath = argv[first];
+    EquirectangularImage image;
+    auto loadStart = std::chrono::high_resolution_clock::now();
+    {
+        // Scanlines are decoded on every hardware thread
+        ThreadPool loadPool;
+        if (!LoadEquirectangularImage(hdrPath, image, &loadPool))
+            return 1;
+    }
+    std::cout << "Loaded " << hdrPath << " (" << image.width << "x" << image.height << ") in "
+              << MillisecondsSince(loadStart) << " ms" << std::endl;
+    
+    if (benchmark) {
+        unsigned int maxThreads = argc > first + 1 ? static_cast<unsigned int>(std::strtoul(argv[first + 1], nullptr, 10))
+                                                   : std::max(1u, std::thread::hardware_concurrency());
+        return RunScalingBenchmark(image, std::max(1u, maxThreads));
+    }
+    
+    // A key computed without the shader sources would never match the renderer's
+    if (!std::filesystem::exists("shaders/prefilter.fs")) {
+        std::cout << "shaders/ not found; run from the directory the renderer runs in so the cache key matches" << std::endl;
+        return 1;
+    }
+    uint64_t key = 0;
+    if (!IBLCache::ComputeKey(hdrPath, key)) {
+        std::cout << "Failed to read " << hdrPath << std::endl;
+        return 1;
+    }
+    
+    std::string directory = argc > first + 1 ? argv[first + 1] : "cache";
+    unsigned int threads = argc > first + 2 ? static_cast<unsigned int>(std::strtoul(argv[first + 2], nullptr, 10)) : 0;
+    ThreadPool pool(threads);
+    BakeResult result = Bake(image, BRDF_LUT_SIZE, pool);
+    double bakeMilliseconds = TotalMilliseconds(result);
+    
+    // The renderer reads the environment and prefilter maps; the irradiance cubemap and
+    // BRDF LUT follow them for tools that validate against a reference
+    std::vector<IBLCacheTexture> textures;
+    textures.push_back(CubemapToCacheTexture(result.environment, static_cast<unsigned int>(result.environment.levels.size())));
+    textures.push_back(CubemapToCacheTexture(result.prefilter, IBL_PREFILTER_MIP_LEVELS));
+    textures.push_back(CubemapToCacheTexture(result.irradiance, 1));
+    textures.push_back(BRDFLUTToCacheTexture(result.brdfLUT, BRDF_LUT_SIZE));
+    
+    std::string path = IBLCache::GetFilePath(directory, hdrPath);
+    if (!IBLCache::Write(path, key, textures, bakeMilliseconds))
+        return 1;
+    
+    std::cout << "Baked on " << pool.GetThreadCount() << " threads in " << bakeMilliseconds << " ms:";
+    for (int stage = 0; stage < 5; ++stage)
+        std::cout << " " << STAGE_NAMES[stage] << " " << result.milliseconds[stage] << " ms" << (stage < 4 ? "," : "");
+    std::cout << std::endl;
+    std::cout << "Irradiance SH (RGB per coefficient):" << std::endl;
+    for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+        std::cout << "  " << result.sh.coefficients[i].x << " " << result.sh.coefficients[i].y << " "
+                  << result.sh.coefficients[i].z << std::endl;
+    std::cout << "Wrote " << path << std::endl;
+    return 0;
+}
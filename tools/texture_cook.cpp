@@ -0,0 +1,165 @@
+// Offline texture cooker: converts a material map to a block-compressed KTX2 file with a
+// precomputed mip chain, which TextureLoader uploads without decoding or glGenerateMipmap.
+// Albedo maps become sRGB BC1, normal maps two-channel BC5 and scalar maps (metallic,
+// roughness, AO; red channel) BC4. The orm kind packs occlusion, roughness and metallic
+// maps into the R, G and B channels of one linear BC1 texture, loaded with
+// Material::LoadOrmMap; a number in place of an input fills that channel with a constant.
+//
+// Usage: texture_cook <albedo|normal|scalar> <input image> <output.ktx2> [threads]
+//        texture_cook orm <occlusion> <roughness> <metallic> <output.ktx2> [threads]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "../include/BlockCompression.h"
+#include "../include/KTX2.h"
+#include "../include/ThreadPool.h"
+#include "../include/ChannelPacking.h"
+#include "../include/MipGenerator.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+
+unsigned char ToByte(float value) {
+    return static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// Decode the occlusion, roughness and metallic inputs and pack them into an RGBA image;
+// an input that parses as a number is a constant channel
+bool LoadORMImage(char** inputs, std::vector<unsigned char> &rgba, int &width, int &height) {
+    ChannelSource sources[ORM_CHANNEL_COUNT];
+    unsigned char* decoded[ORM_CHANNEL_COUNT] = {nullptr, nullptr, nullptr};
+    bool loaded = true;
+    for (int channel = 0; channel < ORM_CHANNEL_COUNT && loaded; ++channel) {
+        char* end = nullptr;
+        float constant = std::strtof(inputs[channel], &end);
+        if (end != inputs[channel] && *end == '\0') {
+            sources[channel].constant = ToByte(constant);
+            continue;
+        }
+        ChannelSource &source = sources[channel];
+        decoded[channel] = stbi_load(inputs[channel], &source.width, &source.height, &source.components, 0);
+        if (!decoded[channel]) {
+            std::cout << "Failed to load " << inputs[channel] << ": " << stbi_failure_reason() << std::endl;
+            loaded = false;
+        }
+        source.pixels = decoded[channel];
+    }
+    
+    if (loaded) {
+        // Alpha is opaque so the RGBA chain matches what the BC1 decode returns
+        std::vector<unsigned char> rgb = PackChannels(sources, ORM_CHANNEL_COUNT, width, height);
+        rgba.resize(static_cast<size_t>(width) * height * 4);
+        for (size_t texel = 0; texel < rgba.size() / 4; ++texel) {
+            for (int c = 0; c < 3; ++c)
+                rgba[texel * 4 + c] = rgb[texel * 3 + c];
+            rgba[texel * 4 + 3] = 255;
+        }
+    }
+    for (unsigned char* pixels : decoded)
+        stbi_image_free(pixels);
+    return loaded;
+}
+
+// Root mean square error over the channels a format keeps
+double MeasureRMSE(const std::vector<unsigned char> &source, const std::vector<unsigned char> &decoded, BlockFormat format) {
+    int channels = format == BlockFormat::BC1 ? 3 : format == BlockFormat::BC5 ? 2 : 1;
+    double sum = 0.0;
+    size_t texels = source.size() / 4;
+    for (size_t i = 0; i < texels; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            double difference = static_cast<double>(source[i * 4 + c]) - decoded[i * 4 + c];
+            sum += difference * difference;
+        }
+    }
+    return std::sqrt(sum / (static_cast<double>(texels) * channels));
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::string kindName = argc > 1 ? argv[1] : "";
+    int inputCount = kindName == "orm" ? ORM_CHANNEL_COUNT : 1;
+    if (argc < 3 + inputCount) {
+        std::cout << "Usage: " << argv[0] << " <albedo|normal|scalar> <input image> <output.ktx2> [threads]" << std::endl;
+        std::cout << "       " << argv[0] << " orm <occlusion> <roughness> <metallic> <output.ktx2> [threads]" << std::endl;
+        return 1;
+    }
+    const char* outputPath = argv[2 + inputCount];
+    const char* threadArgument = argc > 3 + inputCount ? argv[3 + inputCount] : nullptr;
+    
+    MipFilter filter;
+    BlockFormat format;
+    if (kindName == "albedo") {
+        filter = MipFilter::SRGB;
+        format = BlockFormat::BC1;
+    } else if (kindName == "normal") {
+        filter = MipFilter::Normal;
+        format = BlockFormat::BC5;
+    } else if (kindName == "scalar") {
+        filter = MipFilter::Linear;
+        format = BlockFormat::BC4;
+    } else if (kindName == "orm") {
+        // Each channel is filtered on its own, like a scalar map
+        filter = MipFilter::Linear;
+        format = BlockFormat::BC1;
+    } else {
+        std::cout << "Unknown map kind " << kindName << "; expected albedo, normal, scalar or orm" << std::endl;
+        return 1;
+    }
+    
+    // Rows stay in file order, as TextureLoader::LoadTexture uploads them
+    int width, height, components;
+    std::vector<unsigned char> level;
+    if (kindName == "orm") {
+        if (!LoadORMImage(argv + 2, level, width, height))
+            return 1;
+        components = ORM_CHANNEL_COUNT;
+    } else {
+        unsigned char* pixels = stbi_load(argv[2], &width, &height, &components, 4);
+        if (!pixels) {
+            std::cout << "Failed to load " << argv[2] << ": " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        level.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(pixels);
+    }
+    
+    unsigned int threads = threadArgument ? static_cast<unsigned int>(std::strtoul(threadArgument, nullptr, 10)) : 0;
+    ThreadPool pool(threads);
+    auto start = std::chrono::high_resolution_clock::now();
+    
+    // BC1 drops alpha, so there is no alpha-test coverage to keep
+    MipChain mips = GenerateMipChain(level.data(), width, height, 4, filter, &pool, 0.0f);
+    std::vector<std::vector<unsigned char>> levels;
+    levels.push_back(CompressImage(level.data(), width, height, format, &pool));
+    double baseRMSE = MeasureRMSE(level, DecompressImage(levels[0].data(), width, height, format), format);
+    size_t uncompressedBytes = static_cast<size_t>(width) * height * components;
+    for (size_t i = 0; i < mips.levels.size(); ++i) {
+        const MipChain::Level &mip = mips.levels[i];
+        levels.push_back(CompressImage(mips.GetLevelData(i), mip.width, mip.height, format, &pool));
+        uncompressedBytes += static_cast<size_t>(mip.width) * mip.height * components;
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    
+    if (!WriteKTX2File(outputPath, format, filter == MipFilter::SRGB, width, height, levels))
+        return 1;
+    
+    size_t compressedBytes = 0;
+    for (const std::vector<unsigned char> &blocks : levels)
+        compressedBytes += blocks.size();
+    const char* formatNames[] = {"BC1", "BC4", "BC5"};
+    std::cout << "Cooked " << (kindName == "orm" ? "ORM maps" : argv[2]) << " (" << width << "x" << height << ", " << components << " channels) to "
+              << formatNames[static_cast<int>(format)] << " with " << levels.size() << " levels in " << milliseconds
+              << " ms on " << pool.GetThreadCount() << " threads" << std::endl;
+    std::cout << "GPU memory: " << compressedBytes << " bytes, " << static_cast<double>(uncompressedBytes) / compressedBytes
+              << "x smaller than the uncompressed chain; level 0 RMSE " << baseRMSE << std::endl;
+    std::cout << "Wrote " << outputPath << std::endl;
+    return 0;
+}